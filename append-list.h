@@ -0,0 +1,106 @@
+#pragma once
+
+#include "arena-resource.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+
+/**
+ * Append-only list of 32-bit values: positions of calls of one user, ids of names with one n-gram.
+ * Values are kept in blocks of doubling size (4, 8, 16, ...), so the i-th one is found in O(1)
+ * and a block is allocated only when all previous ones are full: no allocation per call.
+ * Blocks are shared between copies and claimed atomically as call_log_t chunks are,
+ * the list of blocks is copied on write. An empty list allocates nothing
+ */
+class append_list_t {
+public:
+  static constexpr size_t first_block_bits = 2;
+
+  uint32_t operator[](size_t i) const {
+    size_t block = block_of(i);
+    return (*blocks)[block]->values[i - block_begin(block)];
+  }
+
+  size_t size() const {
+    return count;
+  }
+
+  bool empty() const {
+    return count == 0;
+  }
+
+  /**
+   * Append value, allocating blocks from resource
+   */
+  void push_back(uint32_t value, std::pmr::memory_resource *resource) {
+    append(&value, &value + 1, resource);
+  }
+
+  /**
+   * Append values [first, last), claiming every block they go to once
+   */
+  void append(const uint32_t *first, const uint32_t *last, std::pmr::memory_resource *resource) {
+    while (first != last) {
+      size_t block = block_of(count);
+      size_t offset = count - block_begin(block);
+      if (offset == 0) {
+        own(resource).push_back(allocate_shared_in<block_t>(resource, block_size(block)));
+      }
+      size_t added = std::min(static_cast<size_t>(last - first), block_size(block) - offset);
+      if (size_t expected = offset; !blocks->back()->claimed.compare_exchange_strong(expected, offset + added)) {
+        auto copy = allocate_shared_in<block_t>(resource, block_size(block));
+        std::copy(blocks->back()->values.begin(), blocks->back()->values.begin() + offset, copy->values.begin());
+        copy->claimed.store(offset + added, std::memory_order_relaxed);
+        own(resource).back() = std::move(copy);
+      }
+      std::copy(first, first + added, blocks->back()->values.begin() + offset);
+      first += added;
+      count += added;
+    }
+  }
+
+private:
+  struct block_t {
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+    block_t(size_t size, const allocator_type &allocator) : values(size, allocator) {}
+
+    std::pmr::vector<uint32_t> values;
+    // count of values handed out to some copy of the list
+    std::atomic<size_t> claimed{0};
+  };
+
+  using blocks_t = std::pmr::vector<std::shared_ptr<block_t>>;
+
+  // block b holds values [block_begin(b), block_begin(b + 1))
+  static size_t block_of(size_t i) {
+    return 63 - static_cast<size_t>(__builtin_clzll((i >> first_block_bits) + 1));
+  }
+
+  static size_t block_begin(size_t block) {
+    return ((size_t{1} << block) - 1) << first_block_bits;
+  }
+
+  static size_t block_size(size_t block) {
+    return size_t{1} << (block + first_block_bits);
+  }
+
+  /**
+   * @return list of blocks for modification, cloned first if it is shared with a copy
+   */
+  blocks_t &own(std::pmr::memory_resource *resource) {
+    if (blocks == nullptr) {
+      blocks = allocate_shared_in<blocks_t>(resource);
+    } else if (blocks.use_count() > 1) {
+      blocks = allocate_shared_in<blocks_t>(resource, *blocks);
+    }
+    return *blocks;
+  }
+
+  std::shared_ptr<blocks_t> blocks;
+  size_t count{0};
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+/**
+ * Allocate T from resource in a shared_ptr whose control block lives there too.
+ * Allocator-aware T (pmr containers, types declaring allocator_type) gets resource for its own allocations
+ */
+template <typename T, typename... Args>
+std::shared_ptr<T> allocate_shared_in(std::pmr::memory_resource *resource, Args &&...args) {
+  return std::allocate_shared<T>(std::pmr::polymorphic_allocator<T>(resource), std::forward<Args>(args)...);
+}
+
+/**
+ * Monotonic arena: allocation bumps a pointer in the current block and deallocation does nothing.
+ * Blocks grow geometrically and are kept by reset, which rewinds the arena in O(1),
+ * so a refill after reset reuses them without going upstream. Not thread-safe
+ */
+class arena_resource_t : public std::pmr::memory_resource {
+public:
+  static constexpr size_t default_block_size = 64 * 1024;
+
+  explicit arena_resource_t(size_t first_block_size = default_block_size,
+                            std::pmr::memory_resource *upstream = std::pmr::get_default_resource())
+      : first_block_size(std::max(first_block_size, size_t{64})), upstream(upstream) {}
+
+  arena_resource_t(const arena_resource_t &) = delete;
+  arena_resource_t &operator=(const arena_resource_t &) = delete;
+
+  ~arena_resource_t() override {
+    for (const block_t &block : blocks) {
+      upstream->deallocate(block.bytes, block.size, alignof(std::max_align_t));
+    }
+  }
+
+  /**
+   * Make all allocated memory free again without returning blocks upstream.
+   * Objects allocated before are gone: their destructors must not run afterwards
+   */
+  void reset() {
+    current = 0;
+    used = 0;
+  }
+
+  /**
+   * @return bytes of blocks taken from upstream
+   */
+  size_t capacity() const {
+    size_t total = 0;
+    for (const block_t &block : blocks) {
+      total += block.size;
+    }
+    return total;
+  }
+
+private:
+  struct block_t {
+    char *bytes;
+    size_t size;
+  };
+
+  void *do_allocate(size_t bytes, size_t alignment) override {
+    while (true) {
+      if (current < blocks.size()) {
+        const block_t &block = blocks[current];
+        auto address = reinterpret_cast<uintptr_t>(block.bytes + used);
+        size_t offset = used + ((alignment - address % alignment) % alignment);
+        if (offset + bytes <= block.size) {
+          used = offset + bytes;
+          return block.bytes + offset;
+        }
+        if (current + 1 < blocks.size()) {
+          // a retained block too small for this request stays unused until the next reset
+          ++current;
+          used = 0;
+          continue;
+        }
+      }
+      size_t size = blocks.empty() ? first_block_size : blocks.back().size * 2;
+      size = std::max(size, bytes + alignment);
+      blocks.push_back({static_cast<char *>(upstream->allocate(size, alignof(std::max_align_t))), size});
+      current = blocks.size() - 1;
+      used = 0;
+    }
+  }
+
+  void do_deallocate(void *, size_t, size_t) override {}
+
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+
+  size_t first_block_size;
+  std::pmr::memory_resource *upstream;
+  std::vector<block_t> blocks;
+  // block allocations are served from and bytes used in it
+  size_t current{0};
+  size_t used{0};
+};
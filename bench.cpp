@@ -0,0 +1,273 @@
+#include "benchmark/benchmark.h"
+
+#include "generator.h"
+#include "phone-book.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+namespace {
+
+std::atomic<size_t> allocated_bytes{0};
+
+/**
+ * Bytes allocated by operator new while the meter runs, paused together with benchmark timing
+ */
+class allocation_meter_t {
+public:
+  allocation_meter_t() : started(allocated_bytes.load(std::memory_order_relaxed)) {}
+
+  void pause() {
+    total += allocated_bytes.load(std::memory_order_relaxed) - started;
+  }
+
+  void resume() {
+    started = allocated_bytes.load(std::memory_order_relaxed);
+  }
+
+  size_t bytes() {
+    pause();
+    resume();
+    return total;
+  }
+
+private:
+  size_t started;
+  size_t total{0};
+};
+
+/**
+ * Report per operation counters: every iteration runs ops_per_iteration operations
+ */
+void report(benchmark::State &state, size_t ops_per_iteration, allocation_meter_t &meter) {
+  double ops = static_cast<double>(state.iterations()) * static_cast<double>(ops_per_iteration);
+  state.counters["ops/s"] = benchmark::Counter(ops, benchmark::Counter::kIsRate);
+  state.counters["ns/op"] = benchmark::Counter(ops * 1e-9, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+  state.counters["bytes/op"] = benchmark::Counter(static_cast<double>(meter.bytes()) / ops);
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  state.counters["peak_rss"] =
+      benchmark::Counter(static_cast<double>(usage.ru_maxrss) * 1024, benchmark::Counter::kDefaults,
+                         benchmark::Counter::OneK::kIs1024);
+}
+
+std::vector<user_t> gen_users(size_t users_count, size_t name_length, generator_t &gen) {
+  std::vector<user_t> users(users_count);
+  for (user_t &user : users) {
+    // name before number: the order GCC evaluates the arguments of create_user(gen_str(...), gen_str(...))
+    // in main-hard.cpp, which the language leaves unspecified, so the data matches those tests with GCC only
+    user.name = gen_str(name_length, name_length, gen);
+    user.number = gen_str(5, 10, gen);
+  }
+  return users;
+}
+
+std::vector<call_t> gen_calls(const std::vector<user_t> &users, size_t calls_count, generator_t &gen) {
+  std::vector<call_t> calls(calls_count);
+  for (call_t &call : calls) {
+    call = {users[gen() % users.size()].number, static_cast<double>(gen() % 1000) / 10};
+  }
+  return calls;
+}
+
+phone_book_t gen_book(size_t users_count, size_t name_length, size_t calls_count, generator_t &gen) {
+  std::vector<user_t> users = gen_users(users_count, name_length, gen);
+  phone_book_t book;
+  book.create_users(users);
+  book.add_calls(gen_calls(users, calls_count, gen));
+  return book;
+}
+
+void create_users(benchmark::State &state) {
+  generator_t gen(7850);
+  std::vector<user_t> users = gen_users(state.range(0), state.range(1), gen);
+  allocation_meter_t meter;
+  for (auto _ : state) {
+    phone_book_t book;
+    for (const user_t &user : users) {
+      benchmark::DoNotOptimize(book.create_user(user.number, user.name));
+    }
+    state.PauseTiming();
+    meter.pause();
+    book.clear();
+    meter.resume();
+    state.ResumeTiming();
+  }
+  report(state, users.size(), meter);
+}
+
+void create_users_bulk(benchmark::State &state) {
+  generator_t gen(7850);
+  std::vector<user_t> users = gen_users(state.range(0), state.range(1), gen);
+  allocation_meter_t meter;
+  for (auto _ : state) {
+    phone_book_t book;
+    benchmark::DoNotOptimize(book.create_users(users));
+    state.PauseTiming();
+    meter.pause();
+    book.clear();
+    meter.resume();
+    state.ResumeTiming();
+  }
+  report(state, users.size(), meter);
+}
+
+template <bool arena>
+void fill_and_clear(benchmark::State &state) {
+  generator_t gen(16734);
+  std::vector<user_t> users = gen_users(state.range(0), 4, gen);
+  phone_book_t book = arena ? phone_book_t::with_arena() : phone_book_t();
+  allocation_meter_t meter;
+  for (auto _ : state) {
+    for (const user_t &user : users) {
+      benchmark::DoNotOptimize(book.create_user(user.number, user.name));
+    }
+    book.clear();
+  }
+  report(state, users.size(), meter);
+}
+
+void add_calls(benchmark::State &state) {
+  generator_t gen(1500);
+  std::vector<user_t> users = gen_users(state.range(0), 10, gen);
+  std::vector<call_t> calls = gen_calls(users, state.range(1), gen);
+  phone_book_t base;
+  base.create_users(users);
+  allocation_meter_t meter;
+  for (auto _ : state) {
+    // copies are O(1), the first modifications clone what they touch as they would in a fresh book
+    phone_book_t book = base;
+    for (const call_t &call : calls) {
+      benchmark::DoNotOptimize(book.add_call(call));
+    }
+    state.PauseTiming();
+    meter.pause();
+    book.clear();
+    meter.resume();
+    state.ResumeTiming();
+  }
+  report(state, calls.size(), meter);
+}
+
+void get_calls(benchmark::State &state) {
+  generator_t gen(15);
+  size_t calls_count = state.range(0);
+  size_t page = state.range(1);
+  size_t queries_count = state.range(2);
+  const phone_book_t book = gen_book(1000, 10, calls_count, gen);
+  std::vector<size_t> positions(queries_count);
+  for (size_t &pos : positions) {
+    pos = gen() % calls_count;
+  }
+  allocation_meter_t meter;
+  for (auto _ : state) {
+    for (size_t pos : positions) {
+      benchmark::DoNotOptimize(book.get_calls(pos, page));
+    }
+  }
+  report(state, queries_count, meter);
+}
+
+template <bool by_name>
+void search_users(benchmark::State &state) {
+  generator_t gen(19);
+  size_t users_count = state.range(0);
+  size_t prefix_length = state.range(1);
+  size_t count = state.range(2);
+  size_t queries_count = state.range(3);
+  const phone_book_t book = gen_book(users_count, 8, users_count, gen);
+  std::vector<std::string> prefixes(queries_count);
+  for (std::string &prefix : prefixes) {
+    prefix = gen_str(prefix_length, prefix_length, gen);
+  }
+  allocation_meter_t meter;
+  for (auto _ : state) {
+    for (const std::string &prefix : prefixes) {
+      if constexpr (by_name) {
+        benchmark::DoNotOptimize(book.search_users_by_name(prefix, count));
+      } else {
+        benchmark::DoNotOptimize(book.search_users_by_number(prefix, count));
+      }
+    }
+  }
+  report(state, queries_count, meter);
+}
+
+} // namespace
+
+// replacements of the global allocation functions: gcc takes them for the library ones and warns about free
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void *operator new(size_t size) {
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+// used by std::pmr::new_delete_resource
+void *operator new(size_t size, std::align_val_t alignment) {
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  auto align = static_cast<size_t>(alignment);
+  if (void *ptr = std::aligned_alloc(align, (std::max(size, size_t{1}) + align - 1) / align * align)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t, std::align_val_t) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+  std::free(ptr);
+}
+#pragma GCC diagnostic pop
+
+BENCHMARK(create_users)
+    ->ArgNames({"users", "name_len"})
+    ->Args({30'000, 4})
+    ->Args({30'000, 20})
+    ->Args({100'000, 10})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(create_users_bulk)
+    ->ArgNames({"users", "name_len"})
+    ->Args({30'000, 4})
+    ->Args({30'000, 20})
+    ->Args({100'000, 10})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(fill_and_clear, false)->ArgNames({"users"})->Arg(300)->Arg(10'000);
+BENCHMARK_TEMPLATE(fill_and_clear, true)->ArgNames({"users"})->Arg(300)->Arg(10'000);
+BENCHMARK(add_calls)
+    ->ArgNames({"users", "calls"})
+    ->Args({1, 100'000})
+    ->Args({10'000, 100'000})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(get_calls)->ArgNames({"calls", "page", "queries"})->Args({100'000, 100, 10'000})->Args({100'000, 1, 10'000});
+BENCHMARK_TEMPLATE(search_users, false)
+    ->ArgNames({"users", "prefix_len", "count", "queries"})
+    ->Args({100'000, 0, 100, 1'000})
+    ->Args({100'000, 2, 20, 10'000})
+    ->Args({100'000, 4, 20, 10'000});
+BENCHMARK_TEMPLATE(search_users, true)
+    ->ArgNames({"users", "prefix_len", "count", "queries"})
+    ->Args({100'000, 0, 100, 1'000})
+    ->Args({100'000, 2, 20, 10'000})
+    ->Args({100'000, 4, 20, 10'000});
+
+BENCHMARK_MAIN();
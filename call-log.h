@@ -0,0 +1,84 @@
+#pragma once
+
+#include "arena-resource.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+/**
+ * Append-only call history stored as fixed-size chunks.
+ * Each record is a dictionary-encoded user id plus duration (12 bytes, kept as two parallel arrays per chunk),
+ * growth never moves existing records and indexed access is O(1).
+ * Chunks are shared between copies of the log. A copy appends to a shared tail chunk in place if no other copy
+ * has appended to it yet (records are claimed atomically), otherwise it clones the tail first.
+ * Chunks are allocated from the memory resource of the allocator
+ */
+class call_log_t {
+public:
+  static constexpr size_t chunk_size = 1024;
+
+  using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+  explicit call_log_t(const allocator_type &allocator = {}) : chunks(allocator) {}
+
+  call_log_t(const call_log_t &other, const allocator_type &allocator = {})
+      : chunks(other.chunks, allocator), count(other.count) {}
+
+  void push_back(uint32_t user_id, double duration_s) {
+    size_t offset = count % chunk_size;
+    if (offset == 0) {
+      chunks.push_back(allocate_shared_in<chunk_t>(chunks.get_allocator().resource()));
+    }
+    if (size_t expected = offset; !chunks.back()->claimed.compare_exchange_strong(expected, offset + 1)) {
+      auto copy = allocate_shared_in<chunk_t>(chunks.get_allocator().resource());
+      std::copy(chunks.back()->user_ids, chunks.back()->user_ids + offset, copy->user_ids);
+      std::copy(chunks.back()->durations_s, chunks.back()->durations_s + offset, copy->durations_s);
+      copy->claimed.store(offset + 1, std::memory_order_relaxed);
+      chunks.back() = std::move(copy);
+    }
+    chunk_t &chunk = *chunks.back();
+    chunk.user_ids[offset] = user_id;
+    chunk.durations_s[offset] = duration_s;
+    ++count;
+  }
+
+  uint32_t user_id(size_t pos) const {
+    return chunks[pos / chunk_size]->user_ids[pos % chunk_size];
+  }
+
+  double duration_s(size_t pos) const {
+    return chunks[pos / chunk_size]->durations_s[pos % chunk_size];
+  }
+
+  size_t size() const {
+    return count;
+  }
+
+  bool empty() const {
+    return count == 0;
+  }
+
+  void clear() {
+    chunks.clear();
+    count = 0;
+  }
+
+private:
+  struct chunk_t {
+    // user-provided on purpose: records are left uninitialized, they are written before they become visible
+    chunk_t() {}
+
+    uint32_t user_ids[chunk_size];
+    double durations_s[chunk_size];
+    // count of records handed out to some copy of the log
+    std::atomic<size_t> claimed{0};
+  };
+
+  std::pmr::vector<std::shared_ptr<chunk_t>> chunks;
+  size_t count{0};
+};
@@ -0,0 +1,107 @@
+#include "concurrent-phone-book.h"
+
+#include <algorithm>
+
+concurrent_phone_book_t::concurrent_phone_book_t(size_t publish_interval)
+    : publish_interval(std::max<size_t>(publish_interval, 1)), current(new phone_book_t()) {}
+
+concurrent_phone_book_t::~concurrent_phone_book_t() {
+  delete current.load();
+}
+
+bool concurrent_phone_book_t::create_user(const std::string &number, const std::string &name) {
+  bool created = book.create_user(number, name);
+  written();
+  return created;
+}
+
+bool concurrent_phone_book_t::add_call(const call_t &call) {
+  bool added = book.add_call(call);
+  written();
+  return added;
+}
+
+std::vector<bool> concurrent_phone_book_t::create_users(const std::vector<user_t> &new_users) {
+  std::vector<bool> created = book.create_users(new_users);
+  written();
+  return created;
+}
+
+std::vector<bool> concurrent_phone_book_t::add_calls(const std::vector<call_t> &new_calls) {
+  std::vector<bool> added = book.add_calls(new_calls);
+  written();
+  return added;
+}
+
+bool concurrent_phone_book_t::remove_user(const std::string &number) {
+  bool removed = book.remove_user(number);
+  written();
+  return removed;
+}
+
+bool concurrent_phone_book_t::rename_user(const std::string &number, const std::string &new_name) {
+  bool renamed = book.rename_user(number, new_name);
+  written();
+  return renamed;
+}
+
+void concurrent_phone_book_t::clear() {
+  book.clear();
+  publish();
+}
+
+void concurrent_phone_book_t::publish() {
+  unpublished = 0;
+  // indexed once here rather than by the first search by substring on every version
+  book.update_name_grams();
+  // the copy shares everything with the writer's book, which clones what it touches from now on
+  epochs.retire(current.exchange(new phone_book_t(book)));
+}
+
+std::vector<call_t> concurrent_phone_book_t::get_calls(size_t start_pos, size_t count) const {
+  return read([&](const phone_book_t &version) { return version.get_calls(start_pos, count); });
+}
+
+std::vector<call_t> concurrent_phone_book_t::get_calls_for_user(const std::string &number, size_t start_pos,
+                                                                size_t count) const {
+  return read([&](const phone_book_t &version) { return version.get_calls_for_user(number, start_pos, count); });
+}
+
+std::vector<user_info_t> concurrent_phone_book_t::search_users_by_number(const std::string &number_prefix,
+                                                                         size_t count) const {
+  return read([&](const phone_book_t &version) { return version.search_users_by_number(number_prefix, count); });
+}
+
+std::vector<std::vector<user_info_t>>
+concurrent_phone_book_t::search_users_by_number_multi(const std::vector<std::string> &number_prefixes,
+                                                      size_t count) const {
+  return read(
+      [&](const phone_book_t &version) { return version.search_users_by_number_multi(number_prefixes, count); });
+}
+
+std::vector<user_info_t> concurrent_phone_book_t::search_users_by_name(const std::string &name_prefix,
+                                                                       size_t count) const {
+  return read([&](const phone_book_t &version) { return version.search_users_by_name(name_prefix, count); });
+}
+
+std::vector<user_info_t> concurrent_phone_book_t::search_users_by_name_substring(const std::string &fragment,
+                                                                                 size_t count) const {
+  return read([&](const phone_book_t &version) { return version.search_users_by_name_substring(fragment, count); });
+}
+
+std::vector<user_info_t> concurrent_phone_book_t::search_users_by_name_fuzzy(const std::string &name_prefix,
+                                                                             size_t max_distance, size_t count) const {
+  return read([&](const phone_book_t &version) {
+    return version.search_users_by_name_fuzzy(name_prefix, max_distance, count);
+  });
+}
+
+size_t concurrent_phone_book_t::size() const {
+  return read([](const phone_book_t &version) { return version.size(); });
+}
+
+void concurrent_phone_book_t::written() {
+  if (++unpublished >= publish_interval) {
+    publish();
+  }
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "epoch-domain.h"
+#include "phone-book.h"
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Phone book for one writer thread and any number of reader threads.
+ * The writer modifies its own book and publishes O(1) copies of it as immutable versions,
+ * readers query the latest published version without locks and never wait for the writer.
+ * Replaced versions are freed by the writer once no reader can hold them
+ */
+class concurrent_phone_book_t {
+public:
+  /**
+   * @param publish_interval -- count of writer operations after which a new version is published automatically
+   */
+  explicit concurrent_phone_book_t(size_t publish_interval = 1);
+
+  concurrent_phone_book_t(const concurrent_phone_book_t &) = delete;
+  concurrent_phone_book_t &operator=(const concurrent_phone_book_t &) = delete;
+
+  /**
+   * No reader may be active
+   */
+  ~concurrent_phone_book_t();
+
+  /**
+   * Writer: same as phone_book_t::create_user
+   */
+  bool create_user(const std::string &number, const std::string &name);
+
+  /**
+   * Writer: same as phone_book_t::add_call
+   */
+  bool add_call(const call_t &call);
+
+  /**
+   * Writer: same as phone_book_t::create_users, counted as one operation
+   */
+  std::vector<bool> create_users(const std::vector<user_t> &new_users);
+
+  /**
+   * Writer: same as phone_book_t::add_calls, counted as one operation
+   */
+  std::vector<bool> add_calls(const std::vector<call_t> &new_calls);
+
+  /**
+   * Writer: same as phone_book_t::remove_user
+   */
+  bool remove_user(const std::string &number);
+
+  /**
+   * Writer: same as phone_book_t::rename_user
+   */
+  bool rename_user(const std::string &number, const std::string &new_name);
+
+  /**
+   * Writer: remove everything and publish the empty book
+   */
+  void clear();
+
+  /**
+   * Writer: make all operations applied so far visible to readers
+   */
+  void publish();
+
+  /**
+   * Reader: same as phone_book_t::get_calls on the latest published version
+   */
+  std::vector<call_t> get_calls(size_t start_pos, size_t count) const;
+
+  /**
+   * Reader: same as phone_book_t::get_calls_for_user on the latest published version
+   */
+  std::vector<call_t> get_calls_for_user(const std::string &number, size_t start_pos, size_t count) const;
+
+  /**
+   * Reader: same as phone_book_t::search_users_by_number on the latest published version
+   */
+  std::vector<user_info_t> search_users_by_number(const std::string &number_prefix, size_t count = -1) const;
+
+  /**
+   * Reader: same as phone_book_t::search_users_by_number_multi on the latest published version
+   */
+  std::vector<std::vector<user_info_t>> search_users_by_number_multi(const std::vector<std::string> &number_prefixes,
+                                                                     size_t count = -1) const;
+
+  /**
+   * Reader: same as phone_book_t::search_users_by_name on the latest published version
+   */
+  std::vector<user_info_t> search_users_by_name(const std::string &name_prefix, size_t count = -1) const;
+
+  /**
+   * Reader: same as phone_book_t::search_users_by_name_substring on the latest published version
+   */
+  std::vector<user_info_t> search_users_by_name_substring(const std::string &fragment, size_t count = -1) const;
+
+  /**
+   * Reader: same as phone_book_t::search_users_by_name_fuzzy on the latest published version
+   */
+  std::vector<user_info_t> search_users_by_name_fuzzy(const std::string &name_prefix, size_t max_distance,
+                                                      size_t count = -1) const;
+
+  /**
+   * Reader: count of users in the latest published version
+   */
+  size_t size() const;
+
+  /**
+   * Reader: run several queries against one published version.
+   * Views obtained from the version must not outlive the call
+   * @return result of f(const phone_book_t &)
+   */
+  template <typename F>
+  auto read(F &&f) const {
+    auto guard = epochs.enter();
+    return f(*current.load());
+  }
+
+private:
+  void written();
+
+  phone_book_t book;
+  size_t publish_interval;
+  size_t unpublished{0};
+  std::atomic<const phone_book_t *> current;
+  mutable epoch_domain_t epochs;
+};
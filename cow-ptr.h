@@ -0,0 +1,47 @@
+#pragma once
+
+#include "arena-resource.h"
+
+#include <memory>
+#include <memory_resource>
+
+/**
+ * Copy-on-write holder: copies share the value, the first write through a shared holder clones it.
+ * Gives O(1) copies of the owner while keeping value semantics.
+ * Values are allocated from the memory resource, allocator-aware values use it for their own allocations
+ */
+template <typename T>
+class cow_ptr_t {
+public:
+  explicit cow_ptr_t(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : ptr(allocate_shared_in<T>(resource)), resource(resource) {}
+
+  const T &operator*() const {
+    return *ptr;
+  }
+
+  const T *operator->() const {
+    return ptr.get();
+  }
+
+  /**
+   * @return value for modification, cloned first if it is shared with another holder
+   */
+  T &write() {
+    if (ptr.use_count() > 1) {
+      ptr = allocate_shared_in<T>(resource, *ptr);
+    }
+    return *ptr;
+  }
+
+  /**
+   * Replace value with an empty one without cloning the shared value first
+   */
+  void reset() {
+    ptr = allocate_shared_in<T>(resource);
+  }
+
+private:
+  std::shared_ptr<T> ptr;
+  std::pmr::memory_resource *resource;
+};
@@ -0,0 +1,84 @@
+#include "durable-phone-book.h"
+
+#include <cstdio>
+#include <stdexcept>
+#include <utility>
+
+#include <unistd.h>
+
+durable_phone_book_t::durable_phone_book_t(std::string snapshot_path, std::string log_path,
+                                           group_commit_t group_commit)
+    : snapshot_path(std::move(snapshot_path)), log_path(std::move(log_path)), group_commit(group_commit) {
+  if (::access(this->snapshot_path.c_str(), F_OK) == 0) {
+    current = phone_book_t::open_mapped(this->snapshot_path);
+  }
+  bool replayed = write_ahead_log_t::replay(this->log_path, state(), [this](const log_record_t &record) {
+    if (record.type == log_record_t::type_t::create_user) {
+      current.create_user(std::string(record.number), std::string(record.name));
+    } else {
+      current.add_call({std::string(record.number), record.duration_s});
+    }
+  });
+  if (!replayed) {
+    write_ahead_log_t::create(this->log_path, state());
+  }
+  log = std::make_unique<write_ahead_log_t>(this->log_path, group_commit);
+}
+
+bool durable_phone_book_t::create_user(const std::string &number, const std::string &name) {
+  if (!current.create_user(number, name)) {
+    return false;
+  }
+  log->append_create_user(number, name);
+  return true;
+}
+
+bool durable_phone_book_t::add_call(const call_t &call) {
+  if (!current.add_call(call)) {
+    return false;
+  }
+  log->append_add_call(call.number, call.duration_s);
+  return true;
+}
+
+std::vector<bool> durable_phone_book_t::create_users(const std::vector<user_t> &new_users) {
+  std::vector<bool> created = current.create_users(new_users);
+  for (size_t i = 0; i < new_users.size(); ++i) {
+    if (created[i]) {
+      log->append_create_user(new_users[i].number, new_users[i].name);
+    }
+  }
+  return created;
+}
+
+std::vector<bool> durable_phone_book_t::add_calls(const std::vector<call_t> &new_calls) {
+  std::vector<bool> added = current.add_calls(new_calls);
+  for (size_t i = 0; i < new_calls.size(); ++i) {
+    if (added[i]) {
+      log->append_add_call(new_calls[i].number, new_calls[i].duration_s);
+    }
+  }
+  return added;
+}
+
+void durable_phone_book_t::sync() {
+  log->sync();
+}
+
+void durable_phone_book_t::checkpoint() {
+  log->sync();
+  // save replaces the snapshot atomically; once it is in place, recovery skips the old log:
+  // its base is behind the snapshot
+  current.save(snapshot_path);
+  log.reset();
+  write_ahead_log_t::create(log_path, state());
+  log = std::make_unique<write_ahead_log_t>(log_path, group_commit);
+}
+
+const phone_book_t &durable_phone_book_t::book() const {
+  return current;
+}
+
+log_base_t durable_phone_book_t::state() const {
+  return {current.size(), current.calls_count()};
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "phone-book.h"
+#include "write-ahead-log.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Phone book that survives crashes: every successful create_user and add_call is appended
+ * to a write-ahead log synced in groups, and checkpoint saves a snapshot and starts an empty log.
+ * Opening maps the latest snapshot and replays the log on top of it
+ */
+class durable_phone_book_t {
+public:
+  /**
+   * Recover the book from snapshot_path and log_path, either of them may be missing
+   * @throws std::runtime_error if the files cannot be read or do not match each other
+   */
+  durable_phone_book_t(std::string snapshot_path, std::string log_path, group_commit_t group_commit = {});
+
+  durable_phone_book_t(const durable_phone_book_t &) = delete;
+  durable_phone_book_t &operator=(const durable_phone_book_t &) = delete;
+
+  /**
+   * Same as phone_book_t::create_user, the user is durable after the next group commit
+   */
+  bool create_user(const std::string &number, const std::string &name);
+
+  /**
+   * Same as phone_book_t::add_call, the call is durable after the next group commit
+   */
+  bool add_call(const call_t &call);
+
+  /**
+   * Same as phone_book_t::create_users, created users are durable after the next group commit
+   */
+  std::vector<bool> create_users(const std::vector<user_t> &new_users);
+
+  /**
+   * Same as phone_book_t::add_calls, added calls are durable after the next group commit
+   */
+  std::vector<bool> add_calls(const std::vector<call_t> &new_calls);
+
+  /**
+   * Wait until all operations applied so far are on disk
+   * @throws std::runtime_error if the log cannot be written
+   */
+  void sync();
+
+  /**
+   * Save a snapshot of the book and replace the log with an empty one, so the next recovery
+   * replays nothing older than this call
+   * @throws std::runtime_error if the snapshot or the log cannot be written
+   */
+  void checkpoint();
+
+  /**
+   * @return book for queries
+   */
+  const phone_book_t &book() const;
+
+private:
+  log_base_t state() const;
+
+  std::string snapshot_path;
+  std::string log_path;
+  group_commit_t group_commit;
+  phone_book_t current;
+  std::unique_ptr<write_ahead_log_t> log;
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <vector>
+
+/**
+ * Epoch-based reclamation for objects unpublished by a single owner thread.
+ * Readers announce the epoch they entered in, the owner frees a retired object only after
+ * every reader that could have seen it has left. Entering and leaving never block on the owner
+ */
+class epoch_domain_t {
+public:
+  static constexpr size_t max_readers = 128;
+
+  /**
+   * Announcement of an active reader, released on destruction
+   */
+  class guard_t {
+  public:
+    guard_t(const guard_t &) = delete;
+    guard_t &operator=(const guard_t &) = delete;
+
+    ~guard_t() {
+      slot->store(idle, std::memory_order_release);
+    }
+
+  private:
+    friend class epoch_domain_t;
+
+    explicit guard_t(std::atomic<uint64_t> *slot) : slot(slot) {}
+
+    std::atomic<uint64_t> *slot;
+  };
+
+  epoch_domain_t() = default;
+  epoch_domain_t(const epoch_domain_t &) = delete;
+  epoch_domain_t &operator=(const epoch_domain_t &) = delete;
+
+  /**
+   * Frees everything retired, no reader may be active
+   */
+  ~epoch_domain_t() {
+    for (const retired_t &object : retired) {
+      object.destroy(object.object);
+    }
+  }
+
+  /**
+   * Enter a read-side critical section: objects loaded inside it stay alive until the guard is destroyed.
+   * Waits only if more than max_readers readers are active at once
+   */
+  guard_t enter() {
+    thread_local size_t hint = std::hash<std::thread::id>{}(std::this_thread::get_id());
+    for (;;) {
+      for (size_t i = 0; i < max_readers; ++i, ++hint) {
+        std::atomic<uint64_t> &slot = slots[hint % max_readers].epoch;
+        uint64_t expected = idle;
+        if (slot.load(std::memory_order_relaxed) == idle && slot.compare_exchange_strong(expected, epoch.load())) {
+          return guard_t(&slot);
+        }
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  /**
+   * Hand over an object already unreachable for new readers, it is deleted once no reader can hold it.
+   * Called by the owner thread only
+   */
+  template <typename T>
+  void retire(const T *object) {
+    retired.push_back({epoch.fetch_add(1), object, [](const void *p) { delete static_cast<const T *>(p); }});
+    reclaim();
+  }
+
+  /**
+   * Free retired objects no active reader can hold. Called by the owner thread only
+   */
+  void reclaim() {
+    uint64_t min_active = idle;
+    for (const slot_t &slot : slots) {
+      min_active = std::min(min_active, slot.epoch.load());
+    }
+    size_t kept = 0;
+    for (const retired_t &object : retired) {
+      if (object.epoch < min_active) {
+        object.destroy(object.object);
+      } else {
+        retired[kept++] = object;
+      }
+    }
+    retired.resize(kept);
+  }
+
+  /**
+   * @return count of retired objects waiting for readers to leave
+   */
+  size_t pending() const {
+    return retired.size();
+  }
+
+private:
+  static constexpr uint64_t idle = std::numeric_limits<uint64_t>::max();
+
+  struct alignas(64) slot_t {
+    std::atomic<uint64_t> epoch{idle};
+  };
+
+  struct retired_t {
+    uint64_t epoch;
+    const void *object;
+    void (*destroy)(const void *);
+  };
+
+  // operations on slots and epoch are sequentially consistent: a reader either announced its epoch before
+  // the owner scanned the slots or it loads the object pointer after the object was unpublished
+  slot_t slots[max_readers];
+  std::atomic<uint64_t> epoch{0};
+  std::vector<retired_t> retired;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Deterministic pseudo-random generator for reproducible workloads
+ */
+class generator_t {
+public:
+  explicit generator_t(uint32_t seed = 0xcdf8a2dd) : seed(seed % MOD) {}
+
+  uint32_t operator()() {
+    seed = (A * seed + B) % MOD;
+    return static_cast<uint32_t>(seed);
+  }
+
+private:
+  static constexpr uint64_t MOD = 1e9;
+  static constexpr uint64_t A = 0x6b253d97 % MOD;
+  static constexpr uint64_t B = 0x468e9f20 % MOD;
+
+  uint64_t seed{};
+};
+
+inline std::string gen_str(size_t min_len, size_t max_len, generator_t &gen) {
+  assert(min_len <= max_len);
+  size_t len = min_len + gen() % (max_len - min_len + 1);
+  std::string res;
+  res.reserve(len);
+  for (size_t i = 0; i < len; ++i) {
+    res += 'a' + gen() % ('z' - 'a' + 1);
+  }
+  return res;
+}
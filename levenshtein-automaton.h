@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Levenshtein automaton of a pattern with bounded distance, run over a text byte by byte.
+ * A state is the row of edit distances between every prefix of the pattern and the text read so far,
+ * capped at max_distance + 1, so a walk over a trie of texts keeps one row per depth
+ * and cuts a branch as soon as no continuation of it can come within max_distance of the pattern
+ */
+class levenshtein_automaton_t {
+public:
+  using state_t = std::vector<uint32_t>;
+
+  levenshtein_automaton_t(std::string_view pattern, size_t max_distance)
+      : pattern(pattern), cap(static_cast<uint32_t>(std::min(max_distance, pattern.size()) + 1)) {}
+
+  /**
+   * @return max_distance, at most the pattern size: every text is that close to the pattern by a prefix
+   */
+  size_t max_distance() const {
+    return cap - 1;
+  }
+
+  /**
+   * @return state before reading any text
+   */
+  state_t start() const {
+    state_t state(pattern.size() + 1);
+    for (size_t j = 0; j < state.size(); ++j) {
+      state[j] = std::min(static_cast<uint32_t>(j), cap);
+    }
+    return state;
+  }
+
+  /**
+   * @return state after reading byte c in state
+   */
+  state_t step(const state_t &state, char c) const {
+    state_t next(state.size());
+    next[0] = std::min(state[0] + 1, cap);
+    for (size_t j = 1; j < next.size(); ++j) {
+      uint32_t replace = state[j - 1] + (pattern[j - 1] == c ? 0 : 1);
+      next[j] = std::min({replace, state[j] + 1, next[j - 1] + 1, cap});
+    }
+    return next;
+  }
+
+  /**
+   * @return edit distance between the pattern and the text read, or a value above max_distance
+   */
+  static size_t distance(const state_t &state) {
+    return state.back();
+  }
+
+  /**
+   * @return lower bound of the distance between the pattern and any continuation of the text read
+   */
+  static size_t min_distance(const state_t &state) {
+    return *std::min_element(state.begin(), state.end());
+  }
+
+  /**
+   * @return the least edit distance between the pattern and a prefix of text, or a value above max_distance
+   */
+  size_t prefix_distance(std::string_view text) const {
+    state_t state = start();
+    size_t best = distance(state);
+    for (size_t i = 0; i < text.size() && min_distance(state) < best; ++i) {
+      state = step(state, text[i]);
+      best = std::min(best, distance(state));
+    }
+    return best;
+  }
+
+private:
+  std::string pattern;
+  uint32_t cap;
+};
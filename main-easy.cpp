@@ -1,8 +1,15 @@
 #include "gtest/gtest.h"
 
+#include "concurrent-phone-book.h"
+#include "durable-phone-book.h"
 #include "phone-book.h"
+#include "query-executor.h"
+#include "sharded-phone-book.h"
+#include "trace-replay.h"
 #include "utils.h"
 
+#include <thread>
+
 TEST(Easy, SimpleTest) {
   phone_book_t book;
 
@@ -513,3 +520,1105 @@ TEST(Easy, ClearSizeEmpty) {
   ASSERT_EQ(book.search_users_by_number("", 100), std::vector<user_info_t>());
   ASSERT_EQ(book.search_users_by_name("", 100), std::vector<user_info_t>());
 }
+
+TEST(Easy, MaxLengthNumbers) {
+  phone_book_t book;
+
+  ASSERT_TRUE(book.create_user("12345678901234567890", "Ivan"));
+  ASSERT_TRUE(book.create_user("1234567890123456789", "Anna"));
+  ASSERT_TRUE(book.create_user("", "Empty"));
+  ASSERT_FALSE(book.create_user("12345678901234567890", "Anton"));
+  ASSERT_FALSE(book.create_user("123456789012345678901", "Too long"));
+
+  ASSERT_TRUE(book.add_call({"12345678901234567890", 5}));
+  ASSERT_TRUE(book.add_call({"", 1}));
+  ASSERT_FALSE(book.add_call({"123456789012345678901", 1}));
+  ASSERT_EQ(book.get_calls(0, 10), std::vector<call_t>({{"12345678901234567890", 5}, {"", 1}}));
+
+  ASSERT_EQ(book.search_users_by_number("1234567890123456789", 10),
+            std::vector<user_info_t>({{{"12345678901234567890", "Ivan"}, 5}, {{"1234567890123456789", "Anna"}, 0}}));
+  ASSERT_EQ(book.search_users_by_number("12345678901234567890", 10),
+            std::vector<user_info_t>({{{"12345678901234567890", "Ivan"}, 5}}));
+  ASSERT_EQ(book.search_users_by_number("", 10),
+            std::vector<user_info_t>({{{"12345678901234567890", "Ivan"}, 5},
+                                      {{"", "Empty"}, 1},
+                                      {{"1234567890123456789", "Anna"}, 0}}));
+}
+
+TEST(Easy, CopyIsIndependent) {
+  phone_book_t book;
+  ASSERT_TRUE(book.create_user("1", "Ivan"));
+  for (size_t i = 0; i < 3000; ++i) {
+    ASSERT_TRUE(book.add_call({"1", static_cast<double>(i)}));
+  }
+
+  phone_book_t copy = book;
+  ASSERT_TRUE(copy.create_user("2", "Anna"));
+  ASSERT_TRUE(copy.add_call({"2", 1}));
+  ASSERT_TRUE(book.add_call({"1", 7}));
+
+  ASSERT_EQ(book.size(), 1);
+  ASSERT_EQ(copy.size(), 2);
+  ASSERT_EQ(book.get_calls(2999, 10), std::vector<call_t>({{"1", 2999}, {"1", 7}}));
+  ASSERT_EQ(copy.get_calls(2999, 10), std::vector<call_t>({{"1", 2999}, {"2", 1}}));
+  ASSERT_EQ(copy.get_calls(1024, 2), std::vector<call_t>({{"1", 1024}, {"1", 1025}}));
+
+  book = copy;
+  ASSERT_EQ(book.size(), 2);
+  ASSERT_EQ(book.get_calls(3000, 10), std::vector<call_t>({{"2", 1}}));
+}
+
+TEST(Easy, ViewCalls) {
+  phone_book_t book;
+
+  ASSERT_TRUE(book.view_calls(0, 10).empty());
+  ASSERT_TRUE(book.create_user("123", "Ivan"));
+  ASSERT_TRUE(book.create_user("321", "Anton"));
+  ASSERT_TRUE(book.add_call({"123", 10}));
+  ASSERT_TRUE(book.add_call({"321", 7}));
+  ASSERT_TRUE(book.add_call({"123", 2}));
+
+  for (size_t start_pos = 0; start_pos < 5; ++start_pos) {
+    for (size_t count = 0; count < 5; ++count) {
+      std::vector<call_t> expected = book.get_calls(start_pos, count);
+      phone_book_t::call_range_t range = book.view_calls(start_pos, count);
+      ASSERT_EQ(range.size(), expected.size());
+      size_t i = 0;
+      for (call_view_t call : range) {
+        ASSERT_EQ(call, expected[i]);
+        ASSERT_EQ(range[i], expected[i]);
+        ++i;
+      }
+      ASSERT_EQ(i, expected.size());
+    }
+  }
+}
+
+TEST(Easy, SharedAndLongNames) {
+  phone_book_t book;
+  const std::string long_name(10'000, 'x');
+
+  ASSERT_TRUE(book.create_user("1", long_name));
+  ASSERT_TRUE(book.create_user("2", "Ivan"));
+  ASSERT_TRUE(book.create_user("3", long_name));
+  ASSERT_TRUE(book.add_call({"3", 2}));
+
+  phone_book_t copy = book;
+  ASSERT_TRUE(book.create_user("4", "Anna"));
+  ASSERT_TRUE(copy.create_user("4", "Boris"));
+  ASSERT_TRUE(copy.create_user("5", long_name + "y"));
+
+  ASSERT_EQ(book.search_users_by_name("", 10), std::vector<user_info_t>({{{"4", "Anna"}, 0},
+                                                                          {{"2", "Ivan"}, 0},
+                                                                          {{"3", long_name}, 2},
+                                                                          {{"1", long_name}, 0}}));
+  ASSERT_EQ(copy.search_users_by_name("Bo", 10), std::vector<user_info_t>({{{"4", "Boris"}, 0}}));
+  ASSERT_EQ(copy.search_users_by_name("xxx", 10), std::vector<user_info_t>({{{"3", long_name}, 2},
+                                                                              {{"1", long_name}, 0},
+                                                                              {{"5", long_name + "y"}, 0}}));
+  ASSERT_EQ(copy.search_users_by_number("", 1), std::vector<user_info_t>({{{"3", long_name}, 2}}));
+}
+
+TEST(Easy, BulkIngestion) {
+  phone_book_t bulk;
+  phone_book_t single;
+
+  const std::vector<user_t> first_users = {{"123", "Ivan"}, {"321", "Anton"}, {"123", "Anna"}, {"4", "Ivan"}};
+  // "678" splits the edge of "6712" created earlier in the same batch
+  const std::vector<user_t> second_users = {{"5", "Boris"}, {"4", "Boris"},  {"1234", "Anna"},
+                                            {"", "Ivan"},   {"678", "Petr"}, {"6712", "Oleg"}};
+  const std::vector<call_t> new_calls = {{"123", 1}, {"9", 5}, {"4", 2}, {"123", 0.1}, {"", 3}, {"321", 0.2}};
+
+  for (const auto &users : {first_users, second_users}) {
+    std::vector<bool> expected;
+    for (const user_t &user : users) {
+      expected.push_back(single.create_user(user.number, user.name));
+    }
+    ASSERT_EQ(bulk.create_users(users), expected);
+  }
+  std::vector<bool> expected;
+  for (const call_t &call : new_calls) {
+    expected.push_back(single.add_call(call));
+  }
+  // repositioned keys rebuild the indexes, a copy keeps the ones it shared
+  const phone_book_t before = bulk;
+  const std::vector<user_info_t> by_number_before = bulk.search_users_by_number("", 100);
+  const std::vector<user_info_t> by_name_before = bulk.search_users_by_name("", 100);
+  ASSERT_EQ(bulk.add_calls(new_calls), expected);
+  ASSERT_EQ(before.search_users_by_number("", 100), by_number_before);
+  ASSERT_EQ(before.search_users_by_name("", 100), by_name_before);
+
+  ASSERT_EQ(bulk.size(), single.size());
+  ASSERT_EQ(bulk.get_calls(0, 100), single.get_calls(0, 100));
+  for (const std::string prefix : {"", "1", "12", "4", "5", "6", "67", "671", "9"}) {
+    ASSERT_EQ(bulk.search_users_by_number(prefix, 100), single.search_users_by_number(prefix, 100));
+  }
+  for (const std::string prefix : {"", "A", "Iv", "Boris", "Z"}) {
+    ASSERT_EQ(bulk.search_users_by_name(prefix, 100), single.search_users_by_name(prefix, 100));
+  }
+}
+
+TEST(Easy, ConcurrentPublishedVersions) {
+  concurrent_phone_book_t book(2);
+
+  ASSERT_TRUE(book.create_user("123", "Ivan"));
+  ASSERT_EQ(book.size(), 0);
+  ASSERT_TRUE(book.create_user("321", "Anton"));
+  ASSERT_EQ(book.size(), 2);
+
+  ASSERT_TRUE(book.add_call({"123", 2}));
+  ASSERT_FALSE(book.add_call({"9", 1}));
+  ASSERT_EQ(book.get_calls(0, 10), std::vector<call_t>({{"123", 2}}));
+  ASSERT_TRUE(book.add_call({"321", 1}));
+  book.publish();
+  ASSERT_EQ(book.get_calls(0, 10), std::vector<call_t>({{"123", 2}, {"321", 1}}));
+
+  std::vector<user_info_t> expected = {{{"123", "Ivan"}, 2}, {{"321", "Anton"}, 1}};
+  ASSERT_EQ(book.search_users_by_number("", 10), expected);
+  ASSERT_EQ(book.search_users_by_name("Iv", 10), std::vector<user_info_t>({expected[0]}));
+  ASSERT_EQ(book.read([](const phone_book_t &version) { return version.view_calls(1, 1)[0]; }), call_t({"321", 1}));
+  ASSERT_EQ(book.search_users_by_name_substring("nto", 10), std::vector<user_info_t>({expected[1]}));
+  ASSERT_TRUE(book.create_user("5", "Antonina"));
+  book.publish();
+  ASSERT_EQ(book.search_users_by_name_substring("nto", 10).size(), 2);
+
+  book.clear();
+  ASSERT_EQ(book.size(), 0);
+  ASSERT_TRUE(book.get_calls(0, 10).empty());
+}
+
+TEST(Easy, ShardedMatchesSingle) {
+  sharded_phone_book_t sharded(3);
+  phone_book_t single;
+
+  const std::vector<user_t> users = {{"123", "Ivan"}, {"321", "Anton"}, {"123", "Anna"}, {"4", "Ivan"}, {"5", "Anna"}};
+  const std::vector<call_t> new_calls = {{"123", 1}, {"9", 5}, {"4", 2}, {"5", 2}, {"321", 0.2}, {"123", 0.1}};
+
+  ASSERT_EQ(sharded.create_users(users), single.create_users(users));
+  ASSERT_TRUE(sharded.create_user("45", "Boris"));
+  ASSERT_TRUE(single.create_user("45", "Boris"));
+  ASSERT_FALSE(sharded.create_user("45", "Boris"));
+  ASSERT_EQ(sharded.add_calls(new_calls), single.add_calls(new_calls));
+  ASSERT_TRUE(sharded.add_call({"45", 3}));
+  ASSERT_TRUE(single.add_call({"45", 3}));
+  ASSERT_FALSE(sharded.add_call({"6", 3}));
+
+  ASSERT_EQ(sharded.size(), single.size());
+  for (size_t start_pos : {0, 1, 3, 7, 10}) {
+    ASSERT_EQ(sharded.get_calls(start_pos, 3), single.get_calls(start_pos, 3));
+  }
+  for (const std::string prefix : {"", "1", "4", "5", "9"}) {
+    for (size_t count : {1, 3, 100}) {
+      ASSERT_EQ(sharded.search_users_by_number(prefix, count), single.search_users_by_number(prefix, count));
+    }
+  }
+  for (const std::string prefix : {"", "A", "Iv", "Boris", "Z"}) {
+    for (size_t count : {1, 3, 100}) {
+      ASSERT_EQ(sharded.search_users_by_name(prefix, count), single.search_users_by_name(prefix, count));
+    }
+  }
+
+  sharded.clear();
+  ASSERT_TRUE(sharded.empty());
+  ASSERT_TRUE(sharded.get_calls(0, 10).empty());
+
+  // async calls mixed with waiting ones take their places in the order of submission
+  single.clear();
+  std::vector<std::future<bool>> created;
+  for (const user_t &user : users) {
+    created.push_back(sharded.create_user_async(user.number, user.name));
+  }
+  std::vector<std::future<bool>> added;
+  for (const call_t &call : new_calls) {
+    added.push_back(sharded.add_call_async(call));
+  }
+  ASSERT_TRUE(sharded.add_call({"4", 1}));
+  added.push_back(sharded.add_call_async({"123", 2}));
+  for (size_t i = 0; i < users.size(); ++i) {
+    ASSERT_EQ(created[i].get(), single.create_user(users[i].number, users[i].name));
+  }
+  for (size_t i = 0; i < new_calls.size(); ++i) {
+    ASSERT_EQ(added[i].get(), single.add_call(new_calls[i]));
+  }
+  ASSERT_TRUE(single.add_call({"4", 1}));
+  ASSERT_TRUE(added.back().get());
+  ASSERT_TRUE(single.add_call({"123", 2}));
+  ASSERT_EQ(sharded.get_calls(0, 100), single.get_calls(0, 100));
+  ASSERT_EQ(sharded.get_calls_for_user("123", 0, 100), single.get_calls_for_user("123", 0, 100));
+  ASSERT_EQ(sharded.search_users_by_number("", 100), single.search_users_by_number("", 100));
+}
+
+TEST(Easy, SnapshotRoundTrip) {
+  phone_book_t book;
+  ASSERT_TRUE(book.create_user("123", "Ivan"));
+  ASSERT_TRUE(book.create_user("1245", "Anton"));
+  ASSERT_TRUE(book.create_user("321", "Ivan"));
+  ASSERT_TRUE(book.create_user("", "Anna"));
+  ASSERT_TRUE(book.add_call({"123", 1}));
+  ASSERT_TRUE(book.add_call({"321", 2}));
+  ASSERT_TRUE(book.add_call({"", 0.5}));
+
+  const std::string path = testing::TempDir() + "phone-book-snapshot.bin";
+  book.save(path);
+  phone_book_t mapped = phone_book_t::open_mapped(path);
+
+  ASSERT_EQ(mapped.size(), book.size());
+  ASSERT_EQ(mapped.get_calls(0, 10), book.get_calls(0, 10));
+  ASSERT_EQ(mapped.get_calls(1, 1), book.get_calls(1, 1));
+  for (const std::string prefix : {"", "1", "12", "124", "12456", "3", "9"}) {
+    ASSERT_EQ(mapped.search_users_by_number(prefix, 10), book.search_users_by_number(prefix, 10));
+  }
+  for (const std::string prefix : {"", "A", "An", "Iv", "Ivan", "Z"}) {
+    ASSERT_EQ(mapped.search_users_by_name(prefix, 2), book.search_users_by_name(prefix, 2));
+  }
+
+  phone_book_t still_mapped = mapped;
+  ASSERT_TRUE(mapped.add_call({"1245", 3}));
+  ASSERT_TRUE(book.add_call({"1245", 3}));
+  ASSERT_FALSE(mapped.create_user("321", "Boris"));
+  ASSERT_EQ(mapped.search_users_by_number("", 10), book.search_users_by_number("", 10));
+  ASSERT_EQ(mapped.search_users_by_name("", 10), book.search_users_by_name("", 10));
+  ASSERT_EQ(mapped.get_calls(0, 10), book.get_calls(0, 10));
+  ASSERT_EQ(still_mapped.get_calls(0, 10).size(), 3);
+
+  still_mapped.save(path + ".copy");
+  ASSERT_EQ(phone_book_t::open_mapped(path + ".copy").search_users_by_name("", 10),
+            still_mapped.search_users_by_name("", 10));
+  still_mapped.clear();
+  ASSERT_TRUE(still_mapped.empty());
+  ASSERT_THROW(phone_book_t::open_mapped(path + ".missing"), std::runtime_error);
+
+  // saving over a mapped file leaves the mapped books as they were
+  phone_book_t small;
+  ASSERT_TRUE(small.create_user("7", "Oleg"));
+  small.save(path);
+  const phone_book_t mapped_small = phone_book_t::open_mapped(path);
+  book.save(path);
+  ASSERT_EQ(mapped_small.size(), 1);
+  ASSERT_EQ(mapped_small.search_users_by_name("", 10), small.search_users_by_name("", 10));
+  ASSERT_EQ(phone_book_t::open_mapped(path).size(), book.size());
+  // books saving to the same path at once write separate temporary files, the last rename wins
+  std::thread other([&small, &path] {
+    for (size_t i = 0; i < 20; ++i) {
+      small.save(path);
+    }
+  });
+  for (size_t i = 0; i < 20; ++i) {
+    book.save(path);
+  }
+  other.join();
+  size_t saved_size = phone_book_t::open_mapped(path).size();
+  ASSERT_TRUE(saved_size == 1 || saved_size == book.size());
+  small.save(path);
+  ASSERT_EQ(mapped.search_users_by_number("", 10), book.search_users_by_number("", 10));
+}
+
+TEST(Easy, DurableRecovery) {
+  const std::string snapshot_path = testing::TempDir() + "durable-easy.snapshot";
+  const std::string log_path = testing::TempDir() + "durable-easy.log";
+  std::remove(snapshot_path.c_str());
+  std::remove(log_path.c_str());
+
+  phone_book_t expected;
+  {
+    durable_phone_book_t book(snapshot_path, log_path);
+    ASSERT_TRUE(book.create_user("123", "Ivan"));
+    ASSERT_FALSE(book.create_user("123", "Anna"));
+    ASSERT_EQ(book.create_users({{"321", "Anton"}, {"4", "Anna"}}), std::vector<bool>({true, true}));
+    ASSERT_TRUE(book.add_call({"123", 1}));
+    ASSERT_FALSE(book.add_call({"9", 1}));
+    ASSERT_EQ(book.add_calls({{"4", 2}, {"321", 0.5}}), std::vector<bool>({true, true}));
+    book.sync();
+    expected = book.book();
+  }
+  {
+    durable_phone_book_t book(snapshot_path, log_path);
+    ASSERT_EQ(book.book().get_calls(0, 10), expected.get_calls(0, 10));
+    ASSERT_EQ(book.book().search_users_by_name("", 10), expected.search_users_by_name("", 10));
+    book.checkpoint();
+    ASSERT_EQ(book.book().calls_count(), 3);
+#ifdef PHONE_BOOK_STATS
+    // opening and checkpointing read the state without counting as queries
+    ASSERT_EQ(book.book().stats().view_calls.calls, 0);
+#endif
+    ASSERT_TRUE(book.add_call({"4", 3}));
+  }
+  ASSERT_TRUE(expected.add_call({"4", 3}));
+  {
+    // a torn record at the end is dropped, records before it are kept
+    std::FILE *log = std::fopen(log_path.c_str(), "ab");
+    std::fputs("torn", log);
+    std::fclose(log);
+    durable_phone_book_t book(snapshot_path, log_path);
+    ASSERT_EQ(book.book().get_calls(0, 10), expected.get_calls(0, 10));
+    ASSERT_EQ(book.book().search_users_by_number("", 10), expected.search_users_by_number("", 10));
+    ASSERT_TRUE(book.create_user("5", "Boris"));
+  }
+  ASSERT_TRUE(expected.create_user("5", "Boris"));
+  {
+    durable_phone_book_t book(snapshot_path, log_path);
+    ASSERT_EQ(book.book().search_users_by_name("", 10), expected.search_users_by_name("", 10));
+  }
+}
+
+TEST(Easy, SearchPages) {
+  phone_book_t book;
+  for (const auto &[number, name] : std::vector<std::pair<std::string, std::string>>{
+           {"123", "Ivan"}, {"124", "Ivan"}, {"125", "Anna"}, {"13", "Anton"}, {"2", "Ivan"}, {"126", "Iva"}}) {
+    ASSERT_TRUE(book.create_user(number, name));
+  }
+  ASSERT_TRUE(book.add_call({"124", 2}));
+  ASSERT_TRUE(book.add_call({"2", 2}));
+  ASSERT_TRUE(book.add_call({"13", 1}));
+
+  const std::string path = testing::TempDir() + "phone-book-pages.bin";
+  book.save(path);
+  const phone_book_t mapped = phone_book_t::open_mapped(path);
+
+  for (const phone_book_t *source : std::vector<const phone_book_t *>{&book, &mapped}) {
+    for (size_t page_size : {1, 2, 4}) {
+      for (const std::string prefix : {"", "1", "12", "9"}) {
+        search_page_t page = source->search_users_by_number_page(prefix, page_size);
+        std::vector<user_info_t> paged = page.users;
+        while (!page.next_cursor.empty()) {
+          ASSERT_EQ(page.users.size(), page_size);
+          page = source->search_users_by_number_page(prefix, page_size, page.next_cursor);
+          paged.insert(paged.end(), page.users.begin(), page.users.end());
+        }
+        ASSERT_EQ(paged, book.search_users_by_number(prefix, 100));
+      }
+      for (const std::string prefix : {"", "I", "Iva", "Ivan", "Z"}) {
+        search_page_t page = source->search_users_by_name_page(prefix, page_size);
+        std::vector<user_info_t> paged = page.users;
+        while (!page.next_cursor.empty()) {
+          page = source->search_users_by_name_page(prefix, page_size, page.next_cursor);
+          paged.insert(paged.end(), page.users.begin(), page.users.end());
+        }
+        ASSERT_EQ(paged, book.search_users_by_name(prefix, 100));
+      }
+    }
+  }
+
+  search_page_t by_name = book.search_users_by_name_page("", 1);
+  ASSERT_THROW(book.search_users_by_number_page("", 1, by_name.next_cursor), std::invalid_argument);
+  ASSERT_THROW(book.search_users_by_name_page("", 1, "not a cursor"), std::invalid_argument);
+}
+
+TEST(Easy, StatsHistogram) {
+  for (uint64_t value : {0ULL, 1ULL, 7ULL, 8ULL, 9ULL, 100ULL, 1000ULL, 123456789ULL, ~0ULL}) {
+    size_t bucket = histogram_snapshot_t::bucket_of(value);
+    ASSERT_LT(bucket, histogram_snapshot_t::buckets_count);
+    ASSERT_LE(histogram_snapshot_t::lower_bound(bucket), value);
+    ASSERT_LE(value - histogram_snapshot_t::lower_bound(bucket), value / histogram_snapshot_t::sub_buckets);
+    if (bucket + 1 < histogram_snapshot_t::buckets_count) {
+      ASSERT_GT(histogram_snapshot_t::lower_bound(bucket + 1), value);
+    }
+  }
+
+  log_linear_histogram_t histogram;
+  ASSERT_EQ(histogram.snapshot().count, 0);
+  ASSERT_EQ(histogram.snapshot().percentile(0.5), 0);
+  for (uint64_t value = 1; value <= 100; ++value) {
+    histogram.record(value);
+  }
+  histogram_snapshot_t snapshot = histogram.snapshot();
+  ASSERT_EQ(snapshot.count, 100);
+  ASSERT_EQ(snapshot.sum, 5050);
+  ASSERT_EQ(snapshot.max, 100);
+  ASSERT_DOUBLE_EQ(snapshot.mean(), 50.5);
+  ASSERT_EQ(snapshot.percentile(0), 1);
+  ASSERT_EQ(snapshot.percentile(0.5), 48);
+  ASSERT_EQ(snapshot.percentile(1), 96);
+}
+
+TEST(Easy, Stats) {
+  phone_book_t book;
+  ASSERT_TRUE(book.create_user("1", "Ivan"));
+  ASSERT_FALSE(book.create_user("1", "Anna"));
+  ASSERT_EQ(book.create_users({{"2", "Anna"}, {"2", "Anton"}, {"3", "Iva"}}), std::vector<bool>({true, false, true}));
+  ASSERT_TRUE(book.add_call({"1", 10}));
+  ASSERT_FALSE(book.add_call({"4", 10}));
+  ASSERT_EQ(book.add_calls({{"2", 1}, {"5", 1}}), std::vector<bool>({true, false}));
+  ASSERT_EQ(book.get_calls(0, 10).size(), 2);
+  ASSERT_EQ(book.view_calls(1, 10).size(), 1);
+  ASSERT_EQ(book.count_calls_for_user("1"), 1);
+  ASSERT_EQ(book.count_calls_for_user("9"), 0);
+  ASSERT_EQ(book.search_users_by_number("", 2).size(), 2);
+  ASSERT_EQ(book.search_users_by_name("Iva", 10).size(), 2);
+  ASSERT_EQ(book.search_users_by_name_page("A", 10).users.size(), 1);
+
+  // copies report to the same statistics
+  const phone_book_t copy = book;
+  ASSERT_EQ(copy.search_users_by_number("12", 10).size(), 0);
+
+  phone_book_stats_t stats = book.stats();
+#ifdef PHONE_BOOK_STATS
+  ASSERT_TRUE(stats.enabled);
+  ASSERT_EQ(stats.create_user.calls, 2);
+  ASSERT_EQ(stats.create_user.accepted, 1);
+  ASSERT_EQ(stats.create_user.rejected, 1);
+  ASSERT_EQ(stats.create_users.calls, 1);
+  ASSERT_EQ(stats.create_users.accepted, 2);
+  ASSERT_EQ(stats.create_users.rejected, 1);
+  ASSERT_EQ(stats.add_call.accepted, 1);
+  ASSERT_EQ(stats.add_call.rejected, 1);
+  ASSERT_EQ(stats.add_calls.accepted, 1);
+  ASSERT_EQ(stats.add_calls.rejected, 1);
+  ASSERT_EQ(stats.get_calls.calls, 1);
+  ASSERT_EQ(stats.get_calls.result_size.sum, 2);
+  ASSERT_EQ(stats.get_calls.latency_ns.count, 1);
+  ASSERT_EQ(stats.view_calls.calls, 1);
+  ASSERT_EQ(stats.view_calls.result_size.sum, 1);
+  ASSERT_EQ(stats.count_calls_for_user.calls, 2);
+  ASSERT_EQ(stats.count_calls_for_user.result_size.sum, 1);
+
+  ASSERT_EQ(stats.search_users_by_number.calls, 2);
+  ASSERT_EQ(stats.search_users_by_number.result_size.sum, 2);
+  ASSERT_EQ(stats.search_users_by_number.prefix_length.sum, 2);
+  ASSERT_EQ(stats.search_users_by_number.prefix_length.max, 2);
+  ASSERT_EQ(stats.search_users_by_name.calls, 2);
+  ASSERT_EQ(stats.search_users_by_name.result_size.sum, 3);
+  ASSERT_EQ(stats.search_users_by_name.prefix_length.sum, 4);
+  ASSERT_EQ(stats.search_users_by_name.latency_ns.count, 2);
+  ASSERT_EQ(stats.create_user.prefix_length.count, 0);
+  ASSERT_EQ(copy.stats().search_users_by_number.calls, 2);
+  phone_book_t cleared = book;
+  cleared.clear();
+  ASSERT_EQ(book.stats().clear.calls, 1);
+  ASSERT_EQ(book.stats().clear.latency_ns.count, 1);
+#else
+  ASSERT_FALSE(stats.enabled);
+  ASSERT_EQ(stats.create_user.calls, 0);
+  ASSERT_EQ(stats.search_users_by_name.latency_ns.count, 0);
+#endif
+}
+
+TEST(Easy, MemoryResource) {
+  // counts bytes allocated through it and not deallocated yet
+  class counting_resource_t : public std::pmr::memory_resource {
+  public:
+    size_t allocated{0};
+    size_t outstanding{0};
+
+  private:
+    void *do_allocate(size_t bytes, size_t alignment) override {
+      allocated += bytes;
+      outstanding += bytes;
+      return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void *ptr, size_t bytes, size_t alignment) override {
+      outstanding -= bytes;
+      std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+      return this == &other;
+    }
+  };
+
+  counting_resource_t resource;
+  {
+    phone_book_t book(&resource);
+    ASSERT_TRUE(book.create_user("123", "Ivan"));
+    ASSERT_TRUE(book.create_users({{"124", "Anna"}, {"2", std::string(10'000, 'a')}})[1]);
+    size_t allocated = resource.allocated;
+    ASSERT_GT(allocated, 0);
+
+    phone_book_t copy = book;
+    ASSERT_TRUE(copy.add_call({"124", 5}));
+    ASSERT_GT(resource.allocated, allocated);
+    ASSERT_EQ(book.get_calls(0, 10).size(), 0);
+    ASSERT_EQ(copy.search_users_by_number("1", 1), std::vector<user_info_t>({{{"124", "Anna"}, 5}}));
+
+    book.clear();
+    ASSERT_TRUE(book.empty());
+    ASSERT_TRUE(book.create_user("1", "Iva"));
+    ASSERT_EQ(copy.size(), 3);
+  }
+  ASSERT_EQ(resource.outstanding, 0);
+}
+
+TEST(Easy, ArenaClear) {
+  phone_book_t book = phone_book_t::with_arena();
+  for (size_t round = 0; round < 3; ++round) {
+    for (size_t i = 0; i < 1000; ++i) {
+      ASSERT_TRUE(book.create_user(std::to_string(i), "user" + std::to_string(i % 10)));
+      ASSERT_TRUE(book.add_call({std::to_string(i / 2), 1}));
+    }
+    ASSERT_EQ(book.size(), 1000);
+    ASSERT_EQ(book.get_calls(999, 10), std::vector<call_t>({{"499", 1}}));
+    ASSERT_EQ(book.search_users_by_number("99", 2),
+              std::vector<user_info_t>({{{"99", "user9"}, 2}, {{"990", "user0"}, 0}}));
+    ASSERT_EQ(book.search_users_by_name("user1", 1), std::vector<user_info_t>({{{"1", "user1"}, 2}}));
+    ASSERT_EQ(book.search_users_by_name_substring("er7", 1000).size(), 100);
+    book.clear();
+    ASSERT_TRUE(book.empty());
+    ASSERT_EQ(book.get_calls(0, 10).size(), 0);
+  }
+
+  // a copy keeps the arena, so clearing the original moves it to a new one
+  ASSERT_TRUE(book.create_user("1", "Ivan"));
+  phone_book_t copy = book;
+  book.clear();
+  ASSERT_TRUE(book.create_user("2", "Anna"));
+  ASSERT_EQ(copy.search_users_by_name("", 10), std::vector<user_info_t>({{{"1", "Ivan"}, 0}}));
+  ASSERT_EQ(book.search_users_by_name("", 10), std::vector<user_info_t>({{{"2", "Anna"}, 0}}));
+  copy = book;
+  ASSERT_EQ(copy.size(), 1);
+
+  arena_resource_t arena(64);
+  void *first = arena.allocate(100, 8);
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(arena.allocate(1, 64)) % 64, 0);
+  size_t capacity = arena.capacity();
+  arena.reset();
+  ASSERT_EQ(arena.allocate(100, 8), first);
+  ASSERT_EQ(arena.capacity(), capacity);
+}
+
+TEST(Easy, GetCallsForUser) {
+  phone_book_t book;
+  ASSERT_TRUE(book.create_user("1", "Ivan"));
+  ASSERT_TRUE(book.create_user("12", "Anna"));
+  ASSERT_TRUE(book.create_user("2", "Anton"));
+  std::vector<call_t> ivan_calls;
+  for (size_t i = 0; i < 100; ++i) {
+    call_t call{i % 3 == 0 ? "1" : "12", static_cast<double>(i)};
+    ASSERT_TRUE(book.add_call(call));
+    if (call.number == "1") {
+      ivan_calls.push_back(call);
+    }
+  }
+  ASSERT_EQ(book.count_calls_for_user("1"), 34);
+  ASSERT_EQ(book.count_calls_for_user("12"), 66);
+  ASSERT_EQ(book.count_calls_for_user("2"), 0);
+  ASSERT_EQ(book.count_calls_for_user("3"), 0);
+  ASSERT_EQ(book.get_calls_for_user("1", 0, 100), ivan_calls);
+  ASSERT_EQ(book.get_calls_for_user("1", 30, 2), std::vector<call_t>({{"1", 90}, {"1", 93}}));
+  ASSERT_EQ(book.get_calls_for_user("1", 33, 10), std::vector<call_t>({{"1", 99}}));
+  ASSERT_EQ(book.get_calls_for_user("1", 34, 10).size(), 0);
+  ASSERT_EQ(book.get_calls_for_user("2", 0, 10).size(), 0);
+  ASSERT_EQ(book.get_calls_for_user("3", 0, 10).size(), 0);
+  ASSERT_EQ(book.get_calls_for_user(std::string(30, '1'), 0, 10).size(), 0);
+
+  // a copy shares the history and both continue it separately
+  phone_book_t copy = book;
+  ASSERT_TRUE(copy.add_call({"1", 1000}));
+  ASSERT_EQ(book.add_calls({{"1", 2000}, {"2", 1}}), std::vector<bool>({true, true}));
+  ASSERT_EQ(copy.get_calls_for_user("1", 33, 10), std::vector<call_t>({{"1", 99}, {"1", 1000}}));
+  ASSERT_EQ(book.get_calls_for_user("1", 33, 10), std::vector<call_t>({{"1", 99}, {"1", 2000}}));
+  ASSERT_EQ(book.get_calls_for_user("2", 0, 10), std::vector<call_t>({{"2", 1}}));
+
+  const std::string path = testing::TempDir() + "phone-book-user-calls.bin";
+  book.save(path);
+  phone_book_t mapped = phone_book_t::open_mapped(path);
+  for (const std::string number : {"1", "12", "2", "3", ""}) {
+    ASSERT_EQ(mapped.count_calls_for_user(number), book.count_calls_for_user(number));
+    for (size_t start_pos : {0, 5, 34, 35, 100}) {
+      ASSERT_EQ(mapped.get_calls_for_user(number, start_pos, 7), book.get_calls_for_user(number, start_pos, 7));
+    }
+  }
+  ASSERT_TRUE(mapped.add_call({"2", 2}));
+  ASSERT_EQ(mapped.get_calls_for_user("2", 0, 10), std::vector<call_t>({{"2", 1}, {"2", 2}}));
+  ASSERT_EQ(mapped.get_calls_for_user("1", 0, 100), book.get_calls_for_user("1", 0, 100));
+
+  sharded_phone_book_t sharded(3);
+  concurrent_phone_book_t concurrent;
+  ASSERT_TRUE(sharded.create_user("1", "Ivan"));
+  ASSERT_TRUE(concurrent.create_user("1", "Ivan"));
+  for (double duration : {1, 2, 3}) {
+    ASSERT_TRUE(sharded.add_call({"1", duration}));
+    ASSERT_TRUE(concurrent.add_call({"1", duration}));
+  }
+  ASSERT_EQ(sharded.get_calls_for_user("1", 1, 5), std::vector<call_t>({{"1", 2}, {"1", 3}}));
+  ASSERT_EQ(concurrent.get_calls_for_user("1", 1, 5), std::vector<call_t>({{"1", 2}, {"1", 3}}));
+}
+
+TEST(Easy, SearchUsersByNameSubstring) {
+  phone_book_t book;
+  ASSERT_TRUE(book.create_user("1", "Ivan"));
+  ASSERT_TRUE(book.create_user("2", "Anna"));
+  ASSERT_TRUE(book.create_user("3", "Anton"));
+  ASSERT_TRUE(book.create_user("4", "Ivanna"));
+  ASSERT_TRUE(book.create_user("5", "Ivan"));
+  ASSERT_TRUE(book.add_call({"5", 10}));
+  ASSERT_EQ(book.search_users_by_name_substring("van", 10),
+            std::vector<user_info_t>({{{"5", "Ivan"}, 10}, {{"1", "Ivan"}, 0}, {{"4", "Ivanna"}, 0}}));
+  ASSERT_EQ(book.search_users_by_name_substring("nn", 10),
+            std::vector<user_info_t>({{{"2", "Anna"}, 0}, {{"4", "Ivanna"}, 0}}));
+  ASSERT_EQ(book.search_users_by_name_substring("Ivanna", 10), std::vector<user_info_t>({{{"4", "Ivanna"}, 0}}));
+  ASSERT_EQ(book.search_users_by_name_substring("n", 2),
+            std::vector<user_info_t>({{{"2", "Anna"}, 0}, {{"3", "Anton"}, 0}}));
+  ASSERT_EQ(book.search_users_by_name_substring("", 10), book.search_users_by_name("", 10));
+  ASSERT_EQ(book.search_users_by_name_substring("vana", 10).size(), 0);
+  ASSERT_EQ(book.search_users_by_name_substring("Ivana", 10).size(), 0);
+  ASSERT_EQ(book.search_users_by_name_substring("x", 10).size(), 0);
+  ASSERT_EQ(book.search_users_by_name_substring("van", 0).size(), 0);
+
+  // names are indexed by the first query after creation, copies index their own names
+  phone_book_t copy = book;
+  ASSERT_TRUE(copy.create_user("6", "Savannah"));
+  ASSERT_TRUE(book.create_user("6", "Vanya"));
+  ASSERT_EQ(copy.search_users_by_name_substring("van", 10).size(), 4);
+  ASSERT_EQ(book.search_users_by_name_substring("van", 10).size(), 3);
+  ASSERT_EQ(book.search_users_by_name_substring("Van", 10), std::vector<user_info_t>({{{"6", "Vanya"}, 0}}));
+  ASSERT_EQ(copy.search_users_by_name_substring("Van", 10).size(), 0);
+
+  const std::string path = testing::TempDir() + "phone-book-substring.bin";
+  book.save(path);
+  phone_book_t mapped = phone_book_t::open_mapped(path);
+  for (const std::string fragment : {"", "a", "an", "nn", "van", "vann", "Ivan", "Ivana", "x"}) {
+    for (size_t count : {1, 2, 10}) {
+      ASSERT_EQ(mapped.search_users_by_name_substring(fragment, count),
+                book.search_users_by_name_substring(fragment, count));
+    }
+  }
+  ASSERT_TRUE(mapped.create_user("7", "Evangelina"));
+  ASSERT_EQ(mapped.search_users_by_name_substring("van", 10).size(), 4);
+
+  // a frequent fragment found only late in name order stops the walk and uses the posting lists
+  phone_book_t clustered;
+  for (size_t i = 0; i < 100; ++i) {
+    ASSERT_TRUE(clustered.create_user("a" + std::to_string(i), "A" + std::to_string(i)));
+    ASSERT_TRUE(clustered.create_user("z" + std::to_string(i), "Z" + std::to_string(i) + "x"));
+  }
+  ASSERT_EQ(clustered.search_users_by_name_substring("x", 10), clustered.search_users_by_name("Z", 10));
+
+  sharded_phone_book_t sharded(3);
+  concurrent_phone_book_t concurrent;
+  for (const auto &[number, name] : std::vector<std::pair<std::string, std::string>>(
+           {{"1", "Ivan"}, {"2", "Anna"}, {"3", "Anton"}, {"4", "Ivanna"}, {"5", "Ivan"}})) {
+    ASSERT_TRUE(sharded.create_user(number, name));
+    ASSERT_TRUE(concurrent.create_user(number, name));
+  }
+  std::vector<user_info_t> expected({{{"1", "Ivan"}, 0}, {{"5", "Ivan"}, 0}, {{"4", "Ivanna"}, 0}});
+  ASSERT_EQ(sharded.search_users_by_name_substring("van", 10), expected);
+  ASSERT_EQ(concurrent.search_users_by_name_substring("van", 10), expected);
+}
+
+TEST(Easy, SearchUsersByNameFuzzy) {
+  phone_book_t book;
+  ASSERT_TRUE(book.create_user("1", "Ivan"));
+  ASSERT_TRUE(book.create_user("2", "Ivanov"));
+  ASSERT_TRUE(book.create_user("3", "Iwan"));
+  ASSERT_TRUE(book.create_user("4", "Ivan"));
+  ASSERT_TRUE(book.create_user("5", "Anna"));
+  ASSERT_TRUE(book.create_user("6", "van"));
+  ASSERT_TRUE(book.add_call({"4", 10}));
+  ASSERT_EQ(book.search_users_by_name_fuzzy("Ivan", 0, 10), book.search_users_by_name("Ivan", 10));
+  ASSERT_EQ(book.search_users_by_name_fuzzy("Iavn", 1, 10).size(), 0);
+  ASSERT_EQ(book.search_users_by_name_fuzzy("Ivan", 1, 10),
+            std::vector<user_info_t>({{{"4", "Ivan"}, 10},
+                                      {{"1", "Ivan"}, 0},
+                                      {{"2", "Ivanov"}, 0},
+                                      {{"3", "Iwan"}, 0},
+                                      {{"6", "van"}, 0}}));
+  ASSERT_EQ(book.search_users_by_name_fuzzy("Iwanov", 2, 10),
+            std::vector<user_info_t>({{{"2", "Ivanov"}, 0}, {{"3", "Iwan"}, 0}}));
+  ASSERT_EQ(book.search_users_by_name_fuzzy("", 3, 10), book.search_users_by_name("", 10));
+  ASSERT_EQ(book.search_users_by_name_fuzzy("xy", 2, 10), book.search_users_by_name("", 10));
+  ASSERT_EQ(book.search_users_by_name_fuzzy("Ivan", 1, 0).size(), 0);
+
+  const std::string path = testing::TempDir() + "phone-book-fuzzy.bin";
+  book.save(path);
+  phone_book_t mapped = phone_book_t::open_mapped(path);
+  sharded_phone_book_t sharded(3);
+  for (const user_info_t &info : book.search_users_by_name("", -1)) {
+    ASSERT_TRUE(sharded.create_user(info.user.number, info.user.name));
+    if (info.total_call_duration_s > 0) {
+      ASSERT_TRUE(sharded.add_call({info.user.number, info.total_call_duration_s}));
+    }
+  }
+  for (const std::string pattern : {"", "I", "Ivan", "Iwanov", "vn", "Anya"}) {
+    for (size_t max_distance : {0, 1, 2}) {
+      for (size_t count : {1, 3, 10}) {
+        std::vector<user_info_t> expected = book.search_users_by_name_fuzzy(pattern, max_distance, count);
+        ASSERT_EQ(mapped.search_users_by_name_fuzzy(pattern, max_distance, count), expected);
+        ASSERT_EQ(sharded.search_users_by_name_fuzzy(pattern, max_distance, count), expected);
+      }
+    }
+  }
+
+  concurrent_phone_book_t concurrent;
+  ASSERT_TRUE(concurrent.create_user("1", "Ivan"));
+  ASSERT_EQ(concurrent.search_users_by_name_fuzzy("Iwan", 1), std::vector<user_info_t>({{{"1", "Ivan"}, 0}}));
+}
+
+TEST(Easy, RemoveAndRenameUser) {
+  phone_book_t book;
+  ASSERT_TRUE(book.create_user("1", "Ivan"));
+  ASSERT_TRUE(book.create_user("2", "Anna"));
+  ASSERT_TRUE(book.create_user("3", "Ivanov"));
+  ASSERT_TRUE(book.add_call({"1", 10}));
+  ASSERT_TRUE(book.add_call({"2", 5}));
+  ASSERT_TRUE(book.add_call({"1", 3}));
+  const phone_book_t before = book;
+
+  ASSERT_TRUE(book.remove_user("1"));
+  ASSERT_FALSE(book.remove_user("1"));
+  ASSERT_FALSE(book.remove_user("4"));
+  ASSERT_FALSE(book.remove_user(std::string(30, '1')));
+  ASSERT_EQ(book.size(), 2);
+  ASSERT_EQ(book.search_users_by_name("Iv", 10), std::vector<user_info_t>({{{"3", "Ivanov"}, 0}}));
+  ASSERT_EQ(book.search_users_by_number("", 10), std::vector<user_info_t>({{{"2", "Anna"}, 5}, {{"3", "Ivanov"}, 0}}));
+  ASSERT_EQ(book.search_users_by_number("1", 10).size(), 0);
+  ASSERT_EQ(book.search_users_by_name_substring("van", 10), std::vector<user_info_t>({{{"3", "Ivanov"}, 0}}));
+  // the history stays, calls of the removed user are only out of reach by its number
+  ASSERT_EQ(book.get_calls(0, 10), std::vector<call_t>({{"1", 10}, {"2", 5}, {"1", 3}}));
+  ASSERT_EQ(book.get_calls_for_user("1", 0, 10).size(), 0);
+  ASSERT_EQ(book.count_calls_for_user("1"), 0);
+  ASSERT_FALSE(book.add_call({"1", 1}));
+  ASSERT_FALSE(book.rename_user("1", "Petr"));
+
+  // the number may be taken again by a new user without the old calls
+  ASSERT_TRUE(book.create_user("1", "Petr"));
+  ASSERT_TRUE(book.add_call({"1", 2}));
+  ASSERT_EQ(book.get_calls_for_user("1", 0, 10), std::vector<call_t>({{"1", 2}}));
+  ASSERT_EQ(book.search_users_by_number("1", 10), std::vector<user_info_t>({{{"1", "Petr"}, 2}}));
+  ASSERT_EQ(book.get_calls(0, 10), std::vector<call_t>({{"1", 10}, {"2", 5}, {"1", 3}, {"1", 2}}));
+
+  ASSERT_TRUE(book.rename_user("2", "Boris"));
+  ASSERT_TRUE(book.rename_user("2", "Boris"));
+  ASSERT_FALSE(book.rename_user("4", "Boris"));
+  ASSERT_EQ(book.search_users_by_name("A", 10).size(), 0);
+  ASSERT_EQ(book.search_users_by_name("B", 10), std::vector<user_info_t>({{{"2", "Boris"}, 5}}));
+  ASSERT_EQ(book.search_users_by_number("2", 10), std::vector<user_info_t>({{{"2", "Boris"}, 5}}));
+  ASSERT_EQ(book.search_users_by_name_substring("nn", 10).size(), 0);
+  ASSERT_EQ(book.search_users_by_name_substring("ori", 10), std::vector<user_info_t>({{{"2", "Boris"}, 5}}));
+  ASSERT_EQ(book.get_calls_for_user("2", 0, 10), std::vector<call_t>({{"2", 5}}));
+  ASSERT_EQ(book.size(), 3);
+
+  // copies taken before keep their users
+  ASSERT_EQ(before.size(), 3);
+  ASSERT_EQ(before.search_users_by_number("", 10), std::vector<user_info_t>({{{"1", "Ivan"}, 13},
+                                                                             {{"2", "Anna"}, 5},
+                                                                             {{"3", "Ivanov"}, 0}}));
+
+  // tombstones are saved with the snapshot
+  const std::string path = testing::TempDir() + "phone-book-remove.bin";
+  book.save(path);
+  phone_book_t mapped = phone_book_t::open_mapped(path);
+  ASSERT_EQ(mapped.size(), book.size());
+  ASSERT_EQ(mapped.search_users_by_name("", 10), book.search_users_by_name("", 10));
+  ASSERT_EQ(mapped.search_users_by_number("", 10), book.search_users_by_number("", 10));
+  ASSERT_EQ(mapped.get_calls(0, 10), book.get_calls(0, 10));
+  ASSERT_EQ(mapped.get_calls_for_user("1", 0, 10), book.get_calls_for_user("1", 0, 10));
+  ASSERT_TRUE(mapped.remove_user("3"));
+  ASSERT_FALSE(mapped.create_user("1", "Ivan"));
+  ASSERT_EQ(mapped.size(), 2);
+  ASSERT_EQ(mapped.search_users_by_name("", 10),
+            std::vector<user_info_t>({{{"2", "Boris"}, 5}, {{"1", "Petr"}, 2}}));
+  ASSERT_EQ(mapped.get_calls(0, 10), book.get_calls(0, 10));
+
+  sharded_phone_book_t sharded(3);
+  concurrent_phone_book_t concurrent;
+  for (const std::string number : {"1", "2"}) {
+    ASSERT_TRUE(sharded.create_user(number, "Ivan"));
+    ASSERT_TRUE(concurrent.create_user(number, "Ivan"));
+    ASSERT_TRUE(sharded.add_call({number, 1}));
+    ASSERT_TRUE(concurrent.add_call({number, 1}));
+  }
+  ASSERT_TRUE(sharded.remove_user("1"));
+  ASSERT_TRUE(concurrent.remove_user("1"));
+  ASSERT_TRUE(sharded.rename_user("2", "Anna"));
+  ASSERT_TRUE(concurrent.rename_user("2", "Anna"));
+  ASSERT_EQ(sharded.search_users_by_name("", 10), std::vector<user_info_t>({{{"2", "Anna"}, 1}}));
+  ASSERT_EQ(concurrent.search_users_by_name("", 10), std::vector<user_info_t>({{{"2", "Anna"}, 1}}));
+  ASSERT_EQ(sharded.get_calls(0, 10), std::vector<call_t>({{"1", 1}, {"2", 1}}));
+  ASSERT_EQ(concurrent.get_calls(0, 10), std::vector<call_t>({{"1", 1}, {"2", 1}}));
+  ASSERT_EQ(sharded.size(), 1);
+}
+
+TEST(Easy, SearchUsersByNameInlinePrefix) {
+  // names around the 16 bytes kept inline in index keys, with zero bytes that look like padding
+  const std::vector<std::string> names = {"",
+                                          "a",
+                                          std::string("a\0", 2),
+                                          std::string("a\0\0", 3),
+                                          "abcdefghijklmno",
+                                          "abcdefghijklmnop",
+                                          std::string("abcdefghijklmnop\0", 17),
+                                          "abcdefghijklmnopa",
+                                          "abcdefghijklmnopq",
+                                          "abcdefghijklmnopqrstuvwxyz",
+                                          "abcdefghijklmnoq",
+                                          "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff",
+                                          "\xff"};
+  phone_book_t book;
+  for (size_t i = 0; i < names.size(); ++i) {
+    ASSERT_TRUE(book.create_user(std::to_string(i), names[i]));
+  }
+  std::vector<std::string> sorted = names;
+  std::sort(sorted.begin(), sorted.end());
+  std::vector<std::string> found;
+  for (const user_info_t &info : book.search_users_by_name("", -1)) {
+    found.push_back(info.user.name);
+  }
+  ASSERT_EQ(found, sorted);
+  for (const std::string &prefix : names) {
+    size_t expected = std::count_if(names.begin(), names.end(), [&prefix](const std::string &name) {
+      return name.compare(0, prefix.size(), prefix) == 0;
+    });
+    ASSERT_EQ(book.search_users_by_name(prefix, -1).size(), expected);
+  }
+}
+
+TEST(Easy, QueryCache) {
+  phone_book_t book;
+  ASSERT_EQ(book.query_cache_stats().misses, 0);
+  book.enable_query_cache({8, 2, 10});
+  ASSERT_TRUE(book.create_user("11", "Anna"));
+  ASSERT_TRUE(book.create_user("12", "Boris"));
+  ASSERT_TRUE(book.create_user("21", "Ivan"));
+  ASSERT_TRUE(book.add_call({"12", 5}));
+
+  const std::vector<user_info_t> by_name = {{{"11", "Anna"}, 0}, {{"12", "Boris"}, 5}, {{"21", "Ivan"}, 0}};
+  ASSERT_EQ(book.search_users_by_name("", 2), std::vector<user_info_t>(by_name.begin(), by_name.begin() + 2));
+  ASSERT_EQ(book.search_users_by_name("", 1), std::vector<user_info_t>(by_name.begin(), by_name.begin() + 1));
+  ASSERT_EQ(book.search_users_by_name("", 2), std::vector<user_info_t>(by_name.begin(), by_name.begin() + 2));
+  ASSERT_EQ(book.query_cache_stats().hits, 2);
+  ASSERT_EQ(book.query_cache_stats().misses, 1);
+  // fewer users than asked for are all the users, so any count is served
+  ASSERT_EQ(book.search_users_by_name("", 10), by_name);
+  ASSERT_EQ(book.search_users_by_name("", 5), by_name);
+  ASSERT_EQ(book.query_cache_stats().hits, 3);
+  ASSERT_EQ(book.query_cache_stats().misses, 2);
+  // long prefixes, large and zero counts are not cached
+  ASSERT_EQ(book.search_users_by_name("Bor", 1), std::vector<user_info_t>({{{"12", "Boris"}, 5}}));
+  ASSERT_EQ(book.search_users_by_name("", 11), by_name);
+  ASSERT_EQ(book.search_users_by_name("", 0).size(), 0);
+  ASSERT_EQ(book.query_cache_stats().hits + book.query_cache_stats().misses, 5);
+
+  ASSERT_EQ(book.search_users_by_number("1", 1), std::vector<user_info_t>({{{"12", "Boris"}, 5}}));
+  ASSERT_EQ(book.search_users_by_number("2", 1), std::vector<user_info_t>({{{"21", "Ivan"}, 0}}));
+  ASSERT_EQ(book.search_users_by_name("B", 1), std::vector<user_info_t>({{{"12", "Boris"}, 5}}));
+  ASSERT_EQ(book.query_cache_stats().entries, 4);
+  // a user ranked after the first count results does not change them, but all results of "" do change
+  ASSERT_TRUE(book.create_user("13", "Petr"));
+  ASSERT_EQ(book.query_cache_stats().invalidations, 1);
+  ASSERT_EQ(book.query_cache_stats().entries, 3);
+  // only entries of prefixes of the number and the name of the user are looked at
+  ASSERT_TRUE(book.add_call({"21", 10}));
+  ASSERT_EQ(book.query_cache_stats().invalidations, 2);
+  ASSERT_EQ(book.query_cache_stats().entries, 2);
+  uint64_t hits = book.query_cache_stats().hits;
+  ASSERT_EQ(book.search_users_by_number("1", 1), std::vector<user_info_t>({{{"12", "Boris"}, 5}}));
+  ASSERT_EQ(book.search_users_by_name("B", 1), std::vector<user_info_t>({{{"12", "Boris"}, 5}}));
+  ASSERT_EQ(book.query_cache_stats().hits, hits + 2);
+  ASSERT_EQ(book.search_users_by_number("2", 1), std::vector<user_info_t>({{{"21", "Ivan"}, 10}}));
+  ASSERT_EQ(book.search_users_by_number("", 2), std::vector<user_info_t>({{{"21", "Ivan"}, 10}, {{"12", "Boris"}, 5}}));
+
+  ASSERT_TRUE(book.rename_user("12", "Anton"));
+  ASSERT_EQ(book.search_users_by_name("B", 1).size(), 0);
+  ASSERT_EQ(book.search_users_by_name("A", 5), std::vector<user_info_t>({{{"11", "Anna"}, 0}, {{"12", "Anton"}, 5}}));
+  ASSERT_TRUE(book.remove_user("11"));
+  ASSERT_EQ(book.search_users_by_name("A", 5), std::vector<user_info_t>({{{"12", "Anton"}, 5}}));
+  ASSERT_EQ(book.search_users_by_number("1", 5), std::vector<user_info_t>({{{"12", "Anton"}, 5}, {{"13", "Petr"}, 0}}));
+
+  // the least recently used entries are evicted
+  for (const std::string prefix : {"a", "b", "c", "d", "e", "f", "g", "h", "i", "j"}) {
+    ASSERT_EQ(book.search_users_by_name(prefix, 1).size(), 0);
+  }
+  ASSERT_EQ(book.query_cache_stats().entries, 8);
+  ASSERT_GT(book.query_cache_stats().evictions, 0);
+
+  // a copy starts empty and counts into the same counters
+  const phone_book_t copy = book;
+  uint64_t misses = book.query_cache_stats().misses;
+  ASSERT_EQ(copy.search_users_by_name("j", 1).size(), 0);
+  ASSERT_EQ(book.query_cache_stats().misses, misses + 1);
+  book.clear();
+  ASSERT_EQ(book.query_cache_stats().entries, 0);
+  ASSERT_EQ(book.search_users_by_name("", 10).size(), 0);
+
+  // operation statistics count cache hits too
+  phone_book_t counted;
+  counted.enable_query_cache();
+  ASSERT_TRUE(counted.create_user("1", "Ivan"));
+  for (size_t i = 0; i < 10; ++i) {
+    ASSERT_EQ(counted.search_users_by_number("", 5).size(), 1);
+    ASSERT_EQ(counted.search_users_by_name("I", 5).size(), 1);
+  }
+  ASSERT_EQ(counted.query_cache_stats().hits, 18);
+#ifdef PHONE_BOOK_STATS
+  ASSERT_EQ(counted.stats().search_users_by_number.calls, 10);
+  ASSERT_EQ(counted.stats().search_users_by_number.result_size.sum, 10);
+  ASSERT_EQ(counted.stats().search_users_by_name.calls, 10);
+  ASSERT_EQ(counted.stats().search_users_by_name.prefix_length.sum, 10);
+#endif
+}
+
+TEST(Easy, QueryExecutor) {
+  phone_book_t book;
+  ASSERT_TRUE(book.create_user("11", "Anna"));
+  ASSERT_TRUE(book.create_user("12", "Anton"));
+  ASSERT_TRUE(book.create_user("123", "Boris"));
+  ASSERT_TRUE(book.create_user("21", "Ivan"));
+  ASSERT_TRUE(book.add_call({"12", 5}));
+  ASSERT_TRUE(book.add_call({"21", 3}));
+  ASSERT_TRUE(book.add_call({"11", 1}));
+  const phone_book_t before = book;
+
+  query_executor_t executor(2);
+  ASSERT_EQ(executor.threads_count(), 2);
+  using kind_t = query_t::kind_t;
+  // equal prefixes, prefixes extending earlier ones and equal get_calls share their runs
+  const std::vector<query_t> queries = {
+      {kind_t::search_by_name, "A", 0, 1},     {kind_t::get_calls, "", 1, 2},
+      {kind_t::search_by_number, "1", 0, 2},   {kind_t::search_by_name, "An", 0, 5},
+      {kind_t::search_by_number, "12", 0, 5},  {kind_t::search_by_name, "A", 0, 5},
+      {kind_t::get_calls, "", 1, 1},           {kind_t::search_by_name, "Ann", 0, 5},
+      {kind_t::search_by_number, "1", 0, 10},  {kind_t::search_by_name, "", 0, 0},
+      {kind_t::search_by_name, "Bo", 0, 5},    {kind_t::search_by_number, "3", 0, 5}};
+  std::vector<std::future<query_result_t>> results = executor.submit(book, queries);
+  ASSERT_EQ(results.size(), queries.size());
+
+  // the batch sees the book as it was submitted
+  ASSERT_TRUE(book.create_user("111", "Annabel"));
+  ASSERT_TRUE(book.add_call({"111", 100}));
+  ASSERT_TRUE(book.remove_user("123"));
+  for (size_t i = 0; i < queries.size(); ++i) {
+    const query_t &query = queries[i];
+    query_result_t result = results[i].get();
+    switch (query.kind) {
+    case kind_t::get_calls:
+      ASSERT_EQ(result.calls, before.get_calls(query.start_pos, query.count));
+      ASSERT_TRUE(result.users.empty());
+      break;
+    case kind_t::search_by_number:
+      ASSERT_EQ(result.users, before.search_users_by_number(query.prefix, query.count));
+      break;
+    case kind_t::search_by_name:
+      ASSERT_EQ(result.users, before.search_users_by_name(query.prefix, query.count));
+      break;
+    }
+  }
+  ASSERT_EQ(executor.submit(book, {{kind_t::search_by_name, "Ann", 0, 5}})[0].get().users,
+            std::vector<user_info_t>({{{"11", "Anna"}, 1}, {{"111", "Annabel"}, 100}}));
+  ASSERT_TRUE(executor.submit(book, {}).empty());
+}
+
+TEST(Easy, SearchUsersByNumberMulti) {
+  phone_book_t book;
+  ASSERT_TRUE(book.create_user("123", "Ivan"));
+  ASSERT_TRUE(book.create_user("1245", "Anton"));
+  ASSERT_TRUE(book.create_user("12456", "Boris"));
+  ASSERT_TRUE(book.create_user("321", "Ivan"));
+  ASSERT_TRUE(book.create_user("", "Anna"));
+  ASSERT_TRUE(book.add_call({"1245", 3}));
+  ASSERT_TRUE(book.add_call({"321", 2}));
+
+  // every prefix of a typed number, repeats, prefixes ending inside an edge and missing ones
+  const std::vector<std::string> prefixes = {"124", "", "1", "12", "124", "1245", "12456", "124567", "13", "3", "32",
+                                             "9", "12"};
+  for (size_t count : {0, 1, 2, 10}) {
+    std::vector<std::vector<user_info_t>> found = book.search_users_by_number_multi(prefixes, count);
+    ASSERT_EQ(found.size(), prefixes.size());
+    for (size_t i = 0; i < prefixes.size(); ++i) {
+      ASSERT_EQ(found[i], book.search_users_by_number(prefixes[i], count));
+    }
+  }
+  ASSERT_EQ(book.search_users_by_number_multi({"12", "3"}, 2),
+            std::vector<std::vector<user_info_t>>(
+                {{{{"1245", "Anton"}, 3}, {{"12456", "Boris"}, 0}}, {{{"321", "Ivan"}, 2}}}));
+  ASSERT_TRUE(book.search_users_by_number_multi({}, 10).empty());
+
+  const std::string path = testing::TempDir() + "phone-book-multi.bin";
+  book.save(path);
+  phone_book_t mapped = phone_book_t::open_mapped(path);
+  ASSERT_EQ(mapped.search_users_by_number_multi(prefixes, 2), book.search_users_by_number_multi(prefixes, 2));
+
+  sharded_phone_book_t sharded(3);
+  concurrent_phone_book_t concurrent;
+  for (const user_info_t &info : book.search_users_by_number("", 10)) {
+    ASSERT_TRUE(sharded.create_user(info.user.number, info.user.name));
+    ASSERT_TRUE(concurrent.create_user(info.user.number, info.user.name));
+  }
+  for (const call_t &call : book.get_calls(0, 10)) {
+    ASSERT_TRUE(sharded.add_call(call));
+    ASSERT_TRUE(concurrent.add_call(call));
+  }
+  ASSERT_EQ(sharded.search_users_by_number_multi(prefixes, 2), book.search_users_by_number_multi(prefixes, 2));
+  ASSERT_EQ(concurrent.search_users_by_number_multi(prefixes, 2), book.search_users_by_number_multi(prefixes, 2));
+}
+
+TEST(Easy, Trace) {
+  const std::string path = testing::TempDir() + "phone-book-easy.trace";
+  phone_book_t book;
+  book.start_trace(path);
+  ASSERT_TRUE(book.create_user("123", "Ivan"));
+  ASSERT_FALSE(book.create_user("123", "Anna"));
+  ASSERT_EQ(book.create_users({{"124", "Anton"}, {"2", "Anna"}, {"124", "Boris"}}),
+            std::vector<bool>({true, true, false}));
+  ASSERT_TRUE(book.add_call({"123", 1.5}));
+  ASSERT_EQ(book.add_calls({{"2", 2}, {"9", 1}}), std::vector<bool>({true, false}));
+  ASSERT_TRUE(book.rename_user("2", "Alla"));
+  ASSERT_EQ(book.get_calls(0, 10).size(), 2);
+  ASSERT_EQ(book.view_calls(1, 10).size(), 1);
+  ASSERT_EQ(book.get_calls_for_user("123", 0, 10).size(), 1);
+  ASSERT_EQ(book.count_calls_for_user("2"), 1);
+  ASSERT_EQ(book.search_users_by_number("12", 10).size(), 2);
+  ASSERT_EQ(book.search_users_by_number_multi({"1", "2", "3"}, 1).size(), 3);
+  search_page_t page = book.search_users_by_name_page("A", 1);
+  ASSERT_EQ(book.search_users_by_name_page("A", 1, page.next_cursor).users.size(), 1);
+  ASSERT_EQ(book.search_users_by_name("", 10).size(), 3);
+  ASSERT_EQ(book.search_users_by_name_substring("an", 10).size(), 1);
+  ASSERT_EQ(book.search_users_by_name_fuzzy("Ivon", 1, 10).size(), 1);
+  // calls that throw are not traced
+  ASSERT_THROW(book.search_users_by_number_page("1", 1, "bad"), std::invalid_argument);
+  ASSERT_TRUE(book.remove_user("124"));
+  // copies share the trace
+  phone_book_t copy = book;
+  copy.clear();
+  book.stop_trace();
+  ASSERT_TRUE(book.create_user("5", "Oleg"));
+
+  std::vector<trace_record_t> records = read_trace(path);
+  std::vector<trace_operation_t> operations;
+  for (const trace_record_t &record : records) {
+    operations.push_back(record.operation);
+  }
+  using op = trace_operation_t;
+  ASSERT_EQ(operations,
+            std::vector<op>({op::create_user, op::create_user, op::create_users, op::add_call, op::add_calls,
+                             op::rename_user, op::get_calls, op::view_calls, op::get_calls_for_user,
+                             op::count_calls_for_user, op::search_by_number, op::search_by_number_multi,
+                             op::search_by_name_page, op::search_by_name_page, op::search_by_name,
+                             op::search_by_name_substring, op::search_by_name_fuzzy, op::remove_user, op::clear}));
+  ASSERT_EQ(records[1].users, std::vector<user_t>({{"123", "Anna"}}));
+  ASSERT_EQ(records[1].result_size, 0);
+  ASSERT_EQ(records[2].result_size, 2);
+  ASSERT_EQ(records[4].calls, std::vector<call_t>({{"2", 2}, {"9", 1}}));
+  ASSERT_EQ(records[5].keys, std::vector<std::string>({"2", "Alla"}));
+  ASSERT_EQ(records[8].start_pos, 0);
+  ASSERT_EQ(records[8].count, 10);
+  ASSERT_EQ(records[11].keys, std::vector<std::string>({"1", "2", "3"}));
+  ASSERT_EQ(records[11].result_size, 2);
+  ASSERT_EQ(records[13].cursor, page.next_cursor);
+  ASSERT_EQ(records[16].max_distance, 1);
+  ASSERT_EQ(records[16].result_size, 1);
+
+  phone_book_t replayed;
+  replay_report_t report = replay_trace(records, replayed, {true});
+  ASSERT_EQ(report.calls(), records.size());
+  ASSERT_EQ(report.mismatches(), 0);
+  ASSERT_EQ(report.operations[static_cast<size_t>(op::create_user)].calls, 2);
+  ASSERT_EQ(report.operations[static_cast<size_t>(op::create_user)].latency_ns.count, 2);
+  ASSERT_GE(report.elapsed.count(), records.back().start_ns - records.front().start_ns);
+  ASSERT_TRUE(replayed.empty());
+
+  // a replay into a book in another state reports the differing results
+  phone_book_t other;
+  ASSERT_TRUE(other.create_user("123", "Oleg"));
+  ASSERT_NE(replay_trace(records, other).mismatches(), 0);
+
+  std::string bytes;
+  {
+    std::ifstream file(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+  std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size() - 1);
+  ASSERT_THROW(read_trace(path), std::runtime_error);
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << "not a trace";
+  ASSERT_THROW(read_trace(path), std::runtime_error);
+  ASSERT_THROW(read_trace(path + ".missing"), std::runtime_error);
+  std::remove(path.c_str());
+}
@@ -1,8 +1,23 @@
 #include "gtest/gtest.h"
 
+#include "concurrent-phone-book.h"
+#include "durable-phone-book.h"
+#include "generator.h"
 #include "phone-book.h"
+#include "query-executor.h"
+#include "sharded-phone-book.h"
+#include "snapshot.h"
+#include "trace-replay.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wstrict-aliasing"
@@ -62,36 +77,19 @@ private:
 
 #pragma GCC diagnostic pop
 
-class generator_t {
-public:
-  explicit generator_t(uint32_t seed = 0xcdf8a2dd) : seed(seed % MOD) {}
-
-  uint32_t operator()() {
-    seed = (A * seed + B) % MOD;
-    return static_cast<uint32_t>(seed);
+/**
+ * Export the scenario of the running test: if PHONE_BOOK_TRACE_DIR is set, calls of book are traced
+ * to <test name>.trace there, to be replayed by the replay tool
+ */
+void export_trace(phone_book_t &book) {
+  if (const char *dir = std::getenv("PHONE_BOOK_TRACE_DIR")) {
+    book.start_trace(std::string(dir) + "/" + testing::UnitTest::GetInstance()->current_test_info()->name() + ".trace");
   }
-
-private:
-  static constexpr uint64_t MOD = 1e9;
-  static constexpr uint64_t A = 0x6b253d97 % MOD;
-  static constexpr uint64_t B = 0x468e9f20 % MOD;
-
-  uint64_t seed{};
-};
-
-std::string gen_str(size_t min_len, size_t max_len, generator_t &gen) {
-  assert(min_len <= max_len);
-  size_t len = min_len + gen() % (max_len - min_len + 1);
-  std::string res;
-  res.reserve(len);
-  for (size_t i = 0; i < len; ++i) {
-    res += 'a' + gen() % ('z' - 'a' + 1);
-  }
-  return res;
 }
 
 TEST(Hard, CreateVeryShortUsers) {
   phone_book_t book;
+  export_trace(book);
   generator_t gen(7850);
   static constexpr size_t users_count = 30'000;
 
@@ -106,6 +104,7 @@ TEST(Hard, CreateVeryShortUsers) {
 
 TEST(Hard, CreateShortUsers) {
   phone_book_t book;
+  export_trace(book);
   generator_t gen(123452);
   static constexpr size_t users_count = 20'000;
 
@@ -120,6 +119,7 @@ TEST(Hard, CreateShortUsers) {
 
 TEST(Hard, CreateLongUsers) {
   phone_book_t book;
+  export_trace(book);
   generator_t gen(3569834);
   static constexpr size_t users_count = 7'000;
 
@@ -134,6 +134,7 @@ TEST(Hard, CreateLongUsers) {
 
 TEST(Hard, Size) {
   phone_book_t book;
+  export_trace(book);
   generator_t gen(703952);
   static constexpr size_t users_count = 30'000;
   hasher_t h;
@@ -146,6 +147,7 @@ TEST(Hard, Size) {
 
 TEST(Hard, Clear) {
   phone_book_t book;
+  export_trace(book);
   generator_t gen(16734);
   static constexpr size_t users_count = 300;
   static constexpr size_t iterations_count = 300;
@@ -163,8 +165,30 @@ TEST(Hard, Clear) {
   ASSERT_EQ(h.get(), 6667970813884221767ULL);
 }
 
+TEST(Hard, ArenaClear) {
+  phone_book_t book = phone_book_t::with_arena();
+  generator_t gen(16734);
+  static constexpr size_t users_count = 300;
+  static constexpr size_t iterations_count = 300;
+  hasher_t h;
+
+  for (size_t i = 0; i < iterations_count; ++i) {
+    for (size_t j = 0; j < users_count; ++j) {
+      h.add(book.size());
+      std::string name = gen_str(4, 4, gen);
+      std::string number = gen_str(5, 5, gen);
+      book.create_user(number, name);
+      h.add(book.size());
+    }
+    book.clear();
+  }
+
+  ASSERT_EQ(h.get(), 6667970813884221767ULL);
+}
+
 TEST(Hard, AddCallsToOneUser) {
   phone_book_t book;
+  export_trace(book);
   generator_t gen(64723);
 
   book.create_user("1", "Ivan");
@@ -180,6 +204,7 @@ TEST(Hard, AddCallsToOneUser) {
 
 TEST(Hard, AddCallsToManyUsers) {
   phone_book_t book;
+  export_trace(book);
   generator_t gen(43524);
 
   static constexpr size_t users_count = 5000;
@@ -202,6 +227,7 @@ TEST(Hard, AddCallsToManyUsers) {
 
 TEST(Hard, GetCallsOneUser) {
   phone_book_t book;
+  export_trace(book);
   generator_t gen(674902);
 
   book.create_user("1", "Ivan");
@@ -221,8 +247,71 @@ TEST(Hard, GetCallsOneUser) {
   ASSERT_EQ(h.get(), 4521848841932652155ULL);
 }
 
+TEST(Hard, GetCallsForUserOneUser) {
+  phone_book_t book;
+  export_trace(book);
+  generator_t gen(674902);
+
+  book.create_user("1", "Ivan");
+  static constexpr size_t calls_count = 300'000;
+
+  for (size_t i = 0; i < calls_count; ++i) {
+    book.add_call({"1", 1});
+  }
+  hasher_t h;
+
+  // all calls are calls of the user, so the pages are those of get_calls
+  static constexpr size_t iterations_count = 200'000;
+  for (size_t i = 0; i < iterations_count; ++i) {
+    h.add(book.get_calls_for_user("1", gen() % calls_count, 0))
+        .add(book.get_calls_for_user("1", gen() % calls_count, 1))
+        .add(book.get_calls_for_user("1", gen() % calls_count, 10));
+  }
+  ASSERT_EQ(h.get(), 4521848841932652155ULL);
+}
+
+TEST(Hard, GetCallsForUserManyUsers) {
+  phone_book_t book;
+  generator_t gen(5150);
+
+  static constexpr size_t users_count = 1000;
+  static constexpr size_t calls_count = 100'000;
+  std::vector<std::string> numbers(users_count);
+  for (std::string &number : numbers) {
+    number = gen_str(5, 10, gen);
+    book.create_user(number, "");
+  }
+  std::unordered_map<std::string, std::vector<call_t>> expected;
+  for (size_t i = 0; i < calls_count; ++i) {
+    // skewed towards the first users, so histories range from a few calls to thousands
+    call_t call{numbers[gen() % (gen() % users_count + 1)], static_cast<double>(gen() % 100)};
+    if (book.add_call(call)) {
+      expected[call.number].push_back(call);
+    }
+  }
+  // copies share the index and continue it independently
+  phone_book_t copy = book;
+  ASSERT_TRUE(copy.add_call({numbers[0], 1}));
+  ASSERT_EQ(book.count_calls_for_user(numbers[0]), expected[numbers[0]].size());
+  ASSERT_EQ(copy.count_calls_for_user(numbers[0]), expected[numbers[0]].size() + 1);
+
+  static constexpr size_t queries_count = 50'000;
+  for (size_t i = 0; i < queries_count; ++i) {
+    const std::string &number = numbers[gen() % users_count];
+    const std::vector<call_t> &calls = expected[number];
+    ASSERT_EQ(book.count_calls_for_user(number), calls.size());
+    size_t start_pos = gen() % (calls.size() + 2);
+    size_t count = gen() % 50;
+    std::vector<call_t> page = book.get_calls_for_user(number, start_pos, count);
+    size_t begin = std::min(start_pos, calls.size());
+    ASSERT_TRUE(std::equal(page.begin(), page.end(), calls.begin() + begin,
+                           calls.begin() + std::min(calls.size(), begin + count)));
+  }
+}
+
 TEST(Hard, GetCallsManyUsers) {
   phone_book_t book;
+  export_trace(book);
   generator_t gen(69002953);
 
   static constexpr size_t users_count = 5000;
@@ -251,6 +340,7 @@ TEST(Hard, GetCallsManyUsers) {
 
 TEST(Hard, SearchUsersByNameEqualNames) {
   phone_book_t book;
+  export_trace(book);
   generator_t gen(9783003);
 
   static constexpr size_t users_count = 10'000;
@@ -291,6 +381,7 @@ TEST(Hard, SearchUsersByNameEqualNames) {
 
 TEST(Hard, SearchUsersByNameShortNames) {
   phone_book_t book;
+  export_trace(book);
   generator_t gen(475620945);
 
   static constexpr size_t users_count = 10'000;
@@ -333,6 +424,7 @@ TEST(Hard, SearchUsersByNameShortNames) {
 
 TEST(Hard, SearchUsersByNameLongNames) {
   phone_book_t book;
+  export_trace(book);
   generator_t gen(135354204);
 
   static constexpr size_t users_count = 3'000;
@@ -370,8 +462,342 @@ TEST(Hard, SearchUsersByNameLongNames) {
   ASSERT_EQ(h.get(), 16507912738829834392ULL);
 }
 
+TEST(Hard, SearchUsersByNameSubstring) {
+  phone_book_t book;
+  export_trace(book);
+  generator_t gen(5318008);
+
+  // values of the generator keep the parity of the seed, so gen_str picks from every other letter only
+  // and every long name has almost every trigram; higher bits give the whole alphabet
+  const auto long_name = [&gen] {
+    std::string name(10'000, 'a');
+    for (char &c : name) {
+      c = static_cast<char>('a' + (gen() >> 8) % 26);
+    }
+    return name;
+  };
+
+  static constexpr size_t users_count = 300;
+  std::vector<std::string> numbers(users_count);
+  std::vector<std::string> names(users_count);
+  for (size_t i = 0; i < users_count; ++i) {
+    numbers[i] = std::to_string(i);
+    // some users share a name
+    names[i] = i % 10 == 9 ? names[gen() % i] : long_name();
+    ASSERT_TRUE(book.create_user(numbers[i], names[i]));
+  }
+  for (size_t i = 0; i < 10 * users_count; ++i) {
+    book.add_call({numbers[gen() % users_count], static_cast<double>(gen() % 100)});
+  }
+
+  hasher_t h;
+  static constexpr size_t queries_count = 2'000;
+  for (size_t i = 0; i < queries_count; ++i) {
+    const std::string &name = names[gen() % users_count];
+    size_t length = 3 + gen() % 6;
+    std::string fragment = i % 2 == 0 ? name.substr(gen() % (name.size() - length), length) : gen_str(3, 5, gen);
+    size_t count = gen() % 20 + 1;
+    std::vector<user_info_t> found = book.search_users_by_name_substring(fragment, count);
+    if (i % 200 == 0) {
+      std::vector<user_info_t> expected;
+      for (const user_info_t &info : book.search_users_by_name("", users_count)) {
+        if (info.user.name.find(fragment) != std::string::npos && expected.size() < count) {
+          expected.push_back(info);
+        }
+      }
+      ASSERT_EQ(found, expected);
+    }
+    h.add(found);
+  }
+  ASSERT_EQ(h.get(), 1063347774050760741ULL);
+}
+
+TEST(Hard, SearchUsersByNameFuzzy) {
+  phone_book_t book;
+  export_trace(book);
+  sharded_phone_book_t sharded(3);
+  generator_t gen(77123451);
+
+  static constexpr size_t users_count = 300;
+  std::vector<std::string> names(users_count);
+  for (size_t i = 0; i < users_count; ++i) {
+    names[i] = gen_str(0, 6, gen);
+    ASSERT_TRUE(book.create_user(std::to_string(i), names[i]));
+    ASSERT_TRUE(sharded.create_user(std::to_string(i), names[i]));
+  }
+  for (size_t i = 0; i < 10 * users_count; ++i) {
+    call_t call{std::to_string(gen() % users_count), static_cast<double>(gen() % 100)};
+    book.add_call(call);
+    sharded.add_call(call);
+  }
+  const std::string path = testing::TempDir() + "phone-book-fuzzy-hard.bin";
+  book.save(path);
+  const phone_book_t mapped = phone_book_t::open_mapped(path);
+
+  // the least edit distance between pattern and a prefix of name, by the whole table
+  const auto prefix_distance = [](const std::string &pattern, const std::string &name) {
+    std::vector<size_t> row(pattern.size() + 1);
+    for (size_t j = 0; j < row.size(); ++j) {
+      row[j] = j;
+    }
+    size_t best = row.back();
+    for (char c : name) {
+      std::vector<size_t> next(row.size(), row[0] + 1);
+      for (size_t j = 1; j < row.size(); ++j) {
+        next[j] = std::min({row[j - 1] + (pattern[j - 1] == c ? 0 : 1), row[j] + 1, next[j - 1] + 1});
+      }
+      row.swap(next);
+      best = std::min(best, row.back());
+    }
+    return best;
+  };
+
+  const std::vector<user_info_t> all = book.search_users_by_name("", users_count);
+  hasher_t h;
+  static constexpr size_t queries_count = 100;
+  for (size_t i = 0; i < queries_count; ++i) {
+    std::string pattern = i % 2 == 0 ? names[gen() % users_count].substr(0, 4) : gen_str(1, 5, gen);
+    // typos in a prefix of some name
+    if (!pattern.empty() && i % 4 == 0) {
+      pattern[gen() % pattern.size()] = 'a' + gen() % 26;
+    }
+    size_t max_distance = gen() % 3;
+    size_t count = gen() % 30 + 1;
+    std::vector<user_info_t> found = book.search_users_by_name_fuzzy(pattern, max_distance, count);
+
+    std::vector<user_info_t> expected;
+    for (size_t distance = 0; distance <= max_distance; ++distance) {
+      for (const user_info_t &info : all) {
+        if (prefix_distance(pattern, info.user.name) == distance && expected.size() < count) {
+          expected.push_back(info);
+        }
+      }
+    }
+    ASSERT_EQ(found, expected);
+    ASSERT_EQ(mapped.search_users_by_name_fuzzy(pattern, max_distance, count), expected);
+    ASSERT_EQ(sharded.search_users_by_name_fuzzy(pattern, max_distance, count), expected);
+    h.add(found);
+  }
+  std::remove(path.c_str());
+  ASSERT_EQ(h.get(), 14653137947908455758ULL);
+}
+
+TEST(Hard, RemoveAndRenameUser) {
+  phone_book_t book;
+  export_trace(book);
+  generator_t gen(46347001);
+
+  // a small pool of numbers, so users are removed and created again under the same number
+  std::vector<std::string> numbers(3'000);
+  for (std::string &number : numbers) {
+    number = gen_str(1, 5, gen);
+  }
+  std::map<std::string, user_info_t> expected_users;
+  std::vector<call_t> expected_calls;
+
+  const auto expected_search = [&](const std::string &prefix, bool by_number, size_t count) {
+    std::vector<user_info_t> found;
+    for (const auto &[number, info] : expected_users) {
+      const std::string &key = by_number ? number : info.user.name;
+      if (key.compare(0, prefix.size(), prefix) == 0) {
+        found.push_back(info);
+      }
+    }
+    std::sort(found.begin(), found.end(), [by_number](const user_info_t &a, const user_info_t &b) {
+      if (by_number) {
+        return std::tie(b.total_call_duration_s, a.user.name, a.user.number) <
+               std::tie(a.total_call_duration_s, b.user.name, b.user.number);
+      }
+      return std::tie(a.user.name, b.total_call_duration_s, a.user.number) <
+             std::tie(b.user.name, a.total_call_duration_s, b.user.number);
+    });
+    found.resize(std::min(found.size(), count));
+    return found;
+  };
+
+  hasher_t h;
+  static constexpr size_t operations_count = 200'000;
+  for (size_t i = 0; i < operations_count; ++i) {
+    const std::string &number = numbers[gen() % numbers.size()];
+    auto it = expected_users.find(number);
+    switch (gen() % 8) {
+    case 0:
+    case 1: {
+      std::string name = gen_str(1, 3, gen);
+      ASSERT_EQ(book.create_user(number, name), it == expected_users.end());
+      expected_users.emplace(number, user_info_t{{number, name}, 0});
+      break;
+    }
+    case 2:
+    case 3:
+    case 4: {
+      auto duration = static_cast<double>(gen() % 100);
+      ASSERT_EQ(book.add_call({number, duration}), it != expected_users.end());
+      if (it != expected_users.end()) {
+        it->second.total_call_duration_s += duration;
+        expected_calls.push_back({number, duration});
+      }
+      break;
+    }
+    case 5: {
+      ASSERT_EQ(book.remove_user(number), it != expected_users.end());
+      if (it != expected_users.end()) {
+        expected_users.erase(it);
+      }
+      break;
+    }
+    default: {
+      std::string name = gen_str(1, 3, gen);
+      ASSERT_EQ(book.rename_user(number, name), it != expected_users.end());
+      if (it != expected_users.end()) {
+        it->second.user.name = name;
+      }
+    }
+    }
+    if (i % 1'000 == 0) {
+      std::string prefix = gen_str(0, 2, gen);
+      std::vector<user_info_t> by_number = book.search_users_by_number(prefix, 30);
+      std::vector<user_info_t> by_name = book.search_users_by_name(prefix, 30);
+      ASSERT_EQ(by_number, expected_search(prefix, true, 30));
+      ASSERT_EQ(by_name, expected_search(prefix, false, 30));
+      ASSERT_EQ(book.size(), expected_users.size());
+      h.add(by_number).add(by_name);
+    }
+  }
+  ASSERT_EQ(book.get_calls(0, expected_calls.size()), expected_calls);
+
+  const std::string path = testing::TempDir() + "phone-book-remove-hard.bin";
+  book.save(path);
+  phone_book_t mapped = phone_book_t::open_mapped(path);
+  ASSERT_EQ(mapped.size(), expected_users.size());
+  ASSERT_EQ(mapped.search_users_by_number("", -1), expected_search("", true, -1));
+  ASSERT_EQ(mapped.search_users_by_name("", -1), expected_search("", false, -1));
+  for (size_t i = 0; i < 100; ++i) {
+    const std::string &number = numbers[gen() % numbers.size()];
+    ASSERT_EQ(mapped.get_calls_for_user(number, 0, -1), book.get_calls_for_user(number, 0, -1));
+  }
+  const std::string &number = numbers[gen() % numbers.size()];
+  ASSERT_EQ(mapped.remove_user(number), expected_users.count(number) != 0);
+  ASSERT_EQ(mapped.get_calls(0, expected_calls.size()), expected_calls);
+  std::remove(path.c_str());
+  ASSERT_EQ(h.get(), 4156752855604479607ULL);
+}
+
+TEST(Hard, QueryCache) {
+  phone_book_t book;
+  export_trace(book);
+  phone_book_t cached;
+  cached.enable_query_cache({256, 2, 50});
+  generator_t gen(8824113);
+
+  std::vector<std::string> numbers(5'000);
+  for (std::string &number : numbers) {
+    number = gen_str(1, 6, gen);
+  }
+  hasher_t h;
+  static constexpr size_t operations_count = 300'000;
+  for (size_t i = 0; i < operations_count; ++i) {
+    const std::string &number = numbers[gen() % numbers.size()];
+    switch (gen() % 16) {
+    case 0: {
+      std::string name = gen_str(1, 4, gen);
+      ASSERT_EQ(cached.create_user(number, name), book.create_user(number, name));
+      break;
+    }
+    case 1:
+    case 2: {
+      call_t call{number, static_cast<double>(gen() % 100)};
+      ASSERT_EQ(cached.add_call(call), book.add_call(call));
+      break;
+    }
+    case 3: {
+      if (gen() % 8 == 0) {
+        ASSERT_EQ(cached.remove_user(number), book.remove_user(number));
+      } else {
+        std::string name = gen_str(1, 4, gen);
+        ASSERT_EQ(cached.rename_user(number, name), book.rename_user(number, name));
+      }
+      break;
+    }
+    default: {
+      // autocomplete traffic: short prefixes of skewed lengths
+      std::string prefix = gen_str(0, gen() % 4 == 0 ? 3 : 1, gen);
+      size_t count = gen() % 50 + 1;
+      bool by_number = gen() % 2 == 0;
+      std::vector<user_info_t> found = by_number ? cached.search_users_by_number(prefix, count)
+                                                 : cached.search_users_by_name(prefix, count);
+      std::vector<user_info_t> expected = by_number ? book.search_users_by_number(prefix, count)
+                                                    : book.search_users_by_name(prefix, count);
+      ASSERT_EQ(found, expected);
+      h.add(found);
+    }
+    }
+  }
+  query_cache_stats_t stats = cached.query_cache_stats();
+  ASSERT_GT(stats.hits, stats.misses);
+  ASSERT_EQ(h.get(), 14760058421860180187ULL);
+}
+
+TEST(Hard, QueryExecutor) {
+  phone_book_t book;
+  generator_t gen(5501927);
+  static constexpr size_t users_count = 20'000;
+  for (size_t i = 0; i < users_count; ++i) {
+    std::string name = gen_str(2, 6, gen);
+    std::string number = gen_str(2, 6, gen);
+    book.create_user(number, name);
+  }
+
+  query_executor_t executor(4);
+  hasher_t h;
+  for (size_t batch = 0; batch < 20; ++batch) {
+    std::vector<call_t> new_calls(5'000);
+    for (call_t &call : new_calls) {
+      call = {gen_str(2, 3, gen), static_cast<double>(gen() % 100)};
+    }
+    book.add_calls(new_calls);
+
+    size_t calls_count = book.view_calls(0, -1).size();
+    std::vector<query_t> queries(2'000);
+    for (query_t &query : queries) {
+      query.kind = static_cast<query_t::kind_t>(gen() % 3);
+      // skewed prefix lengths, so that short prefixes often cover the longer ones
+      query.prefix = gen_str(0, gen() % 4 == 0 ? 3 : 1, gen);
+      query.start_pos = gen() % (calls_count + 10);
+      query.count = gen() % 30;
+    }
+    const phone_book_t view = book;
+    std::vector<std::future<query_result_t>> results = executor.submit(book, queries);
+    // modifications after submit are not seen by the batch
+    for (size_t i = 0; i < 100; ++i) {
+      std::string name = gen_str(1, 2, gen);
+      std::string number = gen_str(2, 3, gen);
+      book.create_user(number, name);
+    }
+    for (size_t i = 0; i < queries.size(); ++i) {
+      const query_t &query = queries[i];
+      query_result_t result = results[i].get();
+      switch (query.kind) {
+      case query_t::kind_t::get_calls:
+        ASSERT_EQ(result.calls, view.get_calls(query.start_pos, query.count));
+        break;
+      case query_t::kind_t::search_by_number:
+        ASSERT_EQ(result.users, view.search_users_by_number(query.prefix, query.count));
+        break;
+      case query_t::kind_t::search_by_name:
+        ASSERT_EQ(result.users, view.search_users_by_name(query.prefix, query.count));
+        break;
+      }
+      h.add(result.calls);
+      h.add(result.users);
+    }
+  }
+  ASSERT_EQ(h.get(), 4917664802801765284ULL);
+}
+
 TEST(Hard, SearchUsersByNumber) {
   phone_book_t book;
+  export_trace(book);
   generator_t gen(234704763);
 
   static constexpr size_t users_count = 10'000;
@@ -409,3 +835,466 @@ TEST(Hard, SearchUsersByNumber) {
   }
   ASSERT_EQ(h.get(), 5927401743041175964ULL);
 }
+
+TEST(Hard, SearchUsersByNumberMulti) {
+  phone_book_t book;
+  export_trace(book);
+  generator_t gen(61720433);
+
+  static constexpr size_t users_count = 20'000;
+  std::vector<user_t> users(users_count);
+  for (user_t &user : users) {
+    user.number = gen_str(3, 10, gen);
+    user.name = gen_str(3, 8, gen);
+  }
+  book.create_users(users);
+  hasher_t h;
+  for (size_t round = 0; round < 2'000; ++round) {
+    for (size_t i = 0; i < 10; ++i) {
+      book.add_call({users[gen() % users_count].number, static_cast<double>(gen() % 100)});
+    }
+    if (round % 10 == 0) {
+      book.remove_user(users[gen() % users_count].number);
+    }
+    // what the caller typed so far and alternatives differing in the last digit
+    const std::string &typed = users[gen() % users_count].number;
+    std::vector<std::string> prefixes;
+    for (size_t size = 0; size <= typed.size(); ++size) {
+      prefixes.push_back(typed.substr(0, size));
+    }
+    for (size_t i = 0; i < 3; ++i) {
+      std::string alternative = typed.substr(0, gen() % typed.size());
+      alternative += static_cast<char>('a' + gen() % 26);
+      prefixes.push_back(alternative);
+    }
+    size_t count = gen() % 20;
+    std::vector<std::vector<user_info_t>> found = book.search_users_by_number_multi(prefixes, count);
+    ASSERT_EQ(found.size(), prefixes.size());
+    for (size_t i = 0; i < prefixes.size(); ++i) {
+      ASSERT_EQ(found[i], book.search_users_by_number(prefixes[i], count));
+      h.add(found[i]);
+    }
+  }
+  ASSERT_EQ(h.get(), 5024522325797204147ULL);
+}
+
+TEST(Hard, CreateShortUsersBulk) {
+  phone_book_t book;
+  export_trace(book);
+  generator_t gen(123452);
+  static constexpr size_t users_count = 20'000;
+
+  std::vector<user_t> users;
+  users.reserve(users_count);
+  for (size_t i = 0; i < users_count; ++i) {
+    // same sequence as in CreateShortUsers, where GCC evaluates create_user arguments right to left
+    std::string name = gen_str(5, 20, gen);
+    std::string number = gen_str(5, 20, gen);
+    users.push_back({std::move(number), std::move(name)});
+  }
+  book.create_users(users);
+
+  hasher_t h;
+  h.add(book.search_users_by_name("", users_count));
+  ASSERT_EQ(h.get(), 7265948714765389348ULL);
+}
+
+TEST(Hard, AddCallsToManyUsersBulk) {
+  phone_book_t book;
+  export_trace(book);
+  generator_t gen(43524);
+
+  static constexpr size_t users_count = 5000;
+  std::vector<user_t> users(users_count);
+  for (size_t i = 0; i < users_count; ++i) {
+    users[i].number = gen_str(5, 5, gen);
+    users[i].name = gen_str(5, 5, gen);
+  }
+  book.create_users(users);
+
+  static constexpr size_t calls_count = 40'000;
+  std::vector<call_t> calls;
+  calls.reserve(calls_count);
+  for (size_t i = 0; i < calls_count; ++i) {
+    const std::string &number = users[gen() % users.size()].number;
+    calls.push_back({number, gen() % 1000 / 100.0});
+  }
+  book.add_calls(calls);
+
+  hasher_t h;
+  h.add(book.get_calls(0, calls_count));
+  ASSERT_EQ(h.get(), 319228645396335748ULL);
+}
+
+TEST(Hard, CopyPerQuery) {
+  phone_book_t book;
+  generator_t gen(5930221);
+
+  static constexpr size_t users_count = 20'000;
+  std::vector<user_t> users(users_count);
+  for (size_t i = 0; i < users_count; ++i) {
+    users[i].number = gen_str(6, 6, gen);
+    users[i].name = gen_str(5, 20, gen);
+  }
+  book.create_users(users);
+
+  static constexpr size_t iterations = 20'000;
+  for (size_t i = 0; i < iterations; ++i) {
+    const phone_book_t snapshot = book;
+    std::string prefix = gen_str(0, 2, gen);
+    ASSERT_TRUE(book.add_call({users[gen() % users_count].number, static_cast<double>(gen() % 10) + 1}));
+    if (i % 1000 == 0) {
+      ASSERT_EQ(snapshot.get_calls(0, i + 1).size(), i);
+      ASSERT_EQ(snapshot.search_users_by_number(prefix, 20), phone_book_t(snapshot).search_users_by_number(prefix, 20));
+    }
+  }
+  ASSERT_EQ(book.get_calls(0, iterations).size(), iterations);
+}
+
+TEST(Hard, ConcurrentReadersWithWriter) {
+  concurrent_phone_book_t book;
+  generator_t gen(729354);
+
+  static constexpr size_t users_count = 20'000;
+  std::vector<user_t> users(users_count);
+  for (size_t i = 0; i < users_count; ++i) {
+    users[i].number = gen_str(6, 6, gen);
+    users[i].name = gen_str(5, 20, gen);
+  }
+  book.create_users(users);
+
+  static constexpr size_t readers_count = 4;
+  static constexpr size_t queries_count = 5'000;
+  static constexpr size_t calls_count = 20'000;
+  std::vector<std::thread> readers;
+  std::vector<size_t> failures(readers_count);
+  for (size_t r = 0; r < readers_count; ++r) {
+    readers.emplace_back([&, r] {
+      generator_t reader_gen(r + 1);
+      size_t seen_calls = 0;
+      for (size_t q = 0; q < queries_count; ++q) {
+        std::string prefix = gen_str(0, 2, reader_gen);
+        std::vector<user_info_t> found = book.search_users_by_number(prefix, 20);
+        for (size_t i = 1; i < found.size(); ++i) {
+          failures[r] += found[i - 1].total_call_duration_s < found[i].total_call_duration_s;
+        }
+        found = book.search_users_by_name(prefix, 20);
+        for (size_t i = 1; i < found.size(); ++i) {
+          failures[r] += found[i].user.name < found[i - 1].user.name;
+        }
+        // versions are published in order, so the history seen by one reader only grows
+        size_t calls = book.read([](const phone_book_t &version) { return version.view_calls(0, calls_count).size(); });
+        failures[r] += calls < seen_calls;
+        seen_calls = calls;
+      }
+    });
+  }
+
+  for (size_t i = 0; i < calls_count; ++i) {
+    ASSERT_TRUE(book.add_call({users[gen() % users_count].number, static_cast<double>(gen() % 10) + 1}));
+  }
+  for (auto &reader : readers) {
+    reader.join();
+  }
+  ASSERT_EQ(failures, std::vector<size_t>(readers_count));
+  ASSERT_EQ(book.get_calls(0, calls_count).size(), calls_count);
+}
+
+TEST(Hard, ShardedIngestion) {
+  sharded_phone_book_t sharded(4);
+  phone_book_t single;
+  generator_t gen(4410391);
+
+  static constexpr size_t users_count = 50'000;
+  std::vector<user_t> users(users_count);
+  for (size_t i = 0; i < users_count; ++i) {
+    users[i].number = gen_str(4, 7, gen);
+    users[i].name = gen_str(3, 12, gen);
+  }
+  ASSERT_EQ(sharded.create_users(users), single.create_users(users));
+
+  static constexpr size_t calls_count = 100'000;
+  std::vector<call_t> new_calls(calls_count);
+  for (size_t i = 0; i < calls_count; ++i) {
+    new_calls[i] = {users[gen() % users_count].number, static_cast<double>(gen() % 100) / 10};
+  }
+  ASSERT_EQ(sharded.add_calls(new_calls), single.add_calls(new_calls));
+
+  ASSERT_EQ(sharded.size(), single.size());
+  for (size_t i = 0; i < 100; ++i) {
+    size_t start_pos = gen() % calls_count;
+    ASSERT_EQ(sharded.get_calls(start_pos, 50), single.get_calls(start_pos, 50));
+    std::string prefix = gen_str(0, 2, gen);
+    ASSERT_EQ(sharded.search_users_by_number(prefix, 20), single.search_users_by_number(prefix, 20));
+    ASSERT_EQ(sharded.search_users_by_name(prefix, 20), single.search_users_by_name(prefix, 20));
+  }
+}
+
+TEST(Hard, SnapshotMappedQueries) {
+  phone_book_t book;
+  export_trace(book);
+  generator_t gen(9301547);
+
+  static constexpr size_t users_count = 50'000;
+  std::vector<user_t> users(users_count);
+  for (size_t i = 0; i < users_count; ++i) {
+    users[i].number = gen_str(4, 9, gen);
+    users[i].name = gen_str(3, 15, gen);
+  }
+  book.create_users(users);
+  std::vector<call_t> new_calls(users_count);
+  for (size_t i = 0; i < users_count; ++i) {
+    new_calls[i] = {users[gen() % users_count].number, static_cast<double>(gen() % 100) / 10};
+  }
+  book.add_calls(new_calls);
+
+  const std::string path = testing::TempDir() + "phone-book-hard-snapshot.bin";
+  book.save(path);
+  const phone_book_t mapped = phone_book_t::open_mapped(path);
+  ASSERT_EQ(mapped.size(), book.size());
+
+  hasher_t mapped_hash;
+  hasher_t book_hash;
+  for (size_t i = 0; i < 1000; ++i) {
+    std::string prefix = gen_str(0, 3, gen);
+    mapped_hash.add(mapped.search_users_by_number(prefix, 10)).add(mapped.search_users_by_name(prefix, 10));
+    book_hash.add(book.search_users_by_number(prefix, 10)).add(book.search_users_by_name(prefix, 10));
+    size_t start_pos = gen() % users_count;
+    mapped_hash.add(mapped.get_calls(start_pos, 10));
+    book_hash.add(book.get_calls(start_pos, 10));
+  }
+  ASSERT_EQ(mapped_hash.get(), book_hash.get());
+}
+
+TEST(Hard, SnapshotCorruption) {
+  phone_book_t book;
+  generator_t gen(5520317);
+
+  static constexpr size_t users_count = 300;
+  for (size_t i = 0; i < users_count; ++i) {
+    std::string name = gen_str(1, 10, gen);
+    std::string number = gen_str(1, 9, gen);
+    book.create_user(number, name);
+  }
+  const std::vector<user_info_t> created = book.search_users_by_name("", users_count);
+  for (size_t i = 0; i < users_count; ++i) {
+    book.add_call({created[gen() % created.size()].user.number, static_cast<double>(gen() % 100)});
+  }
+  const std::string path = testing::TempDir() + "phone-book-hard-corrupted.bin";
+  book.save(path);
+  std::string bytes;
+  {
+    std::ifstream file(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+
+  // opening without verification does not read the sections, so a wrong checksum goes unnoticed
+  {
+    std::string corrupted = bytes;
+    reinterpret_cast<snapshot_header_t *>(corrupted.data())->checksum ^= 1;
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(corrupted.data(), corrupted.size());
+    ASSERT_EQ(phone_book_t::open_mapped(path).search_users_by_name("", users_count),
+              book.search_users_by_name("", users_count));
+    ASSERT_THROW(phone_book_t::open_mapped(path, true), std::runtime_error);
+  }
+
+  static constexpr size_t trials_count = 200;
+  size_t rejected = 0;
+  for (size_t trial = 0; trial < trials_count; ++trial) {
+    std::string corrupted = bytes;
+    for (size_t i = 0; i < 4; ++i) {
+      size_t pos = gen() % corrupted.size();
+      corrupted[pos] = static_cast<char>(corrupted[pos] ^ (1 + gen() % 255));
+    }
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(corrupted.data(), corrupted.size());
+    try {
+      phone_book_t mapped = phone_book_t::open_mapped(path, true);
+      // only bytes no reader looks at were changed
+      ASSERT_EQ(mapped.search_users_by_number("", users_count), book.search_users_by_number("", users_count));
+      ASSERT_EQ(mapped.search_users_by_name("", users_count), book.search_users_by_name("", users_count));
+      ASSERT_EQ(mapped.get_calls(0, users_count), book.get_calls(0, users_count));
+    } catch (const std::runtime_error &) {
+      ++rejected;
+    }
+  }
+  ASSERT_GE(rejected, trials_count - 5);
+
+  // corruption with a matching checksum is caught by the checks of the references
+  auto &header = *reinterpret_cast<snapshot_header_t *>(bytes.data());
+  size_t sections_offset = (sizeof(snapshot_header_t) + 7) / 8 * 8;
+  for (size_t trial = 0; trial < trials_count; ++trial) {
+    std::string corrupted = bytes;
+    for (size_t i = 0; i < 4; ++i) {
+      size_t pos = sections_offset + gen() % (corrupted.size() - sections_offset);
+      corrupted[pos] = static_cast<char>(corrupted[pos] ^ (1 + gen() % 255));
+    }
+    uint32_t checksum = 2166136261u;
+    for (size_t pos = sections_offset; pos < corrupted.size(); ++pos) {
+      checksum = (checksum ^ static_cast<unsigned char>(corrupted[pos])) * 16777619u;
+    }
+    header.checksum = checksum;
+    std::copy(bytes.begin(), bytes.begin() + sizeof(snapshot_header_t), corrupted.begin());
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(corrupted.data(), corrupted.size());
+    try {
+      // answers may be wrong, but reading them stays inside the file
+      phone_book_t mapped = phone_book_t::open_mapped(path, true);
+      mapped.search_users_by_number(gen_str(0, 2, gen), users_count);
+      mapped.search_users_by_name(gen_str(0, 2, gen), users_count);
+      mapped.get_calls(0, users_count);
+      mapped.get_calls_for_user(created[gen() % created.size()].user.number, 0, users_count);
+      mapped.create_user("0", "Anna");
+    } catch (const std::runtime_error &) {
+    }
+  }
+  std::remove(path.c_str());
+}
+
+TEST(Hard, DurableGroupCommit) {
+  const std::string snapshot_path = testing::TempDir() + "durable-hard.snapshot";
+  const std::string log_path = testing::TempDir() + "durable-hard.log";
+  std::remove(snapshot_path.c_str());
+  std::remove(log_path.c_str());
+  generator_t gen(1137);
+
+  static constexpr size_t users_count = 10'000;
+  static constexpr size_t calls_count = 50'000;
+  std::vector<user_t> users(users_count);
+  for (size_t i = 0; i < users_count; ++i) {
+    users[i].number = gen_str(5, 8, gen);
+    users[i].name = gen_str(3, 12, gen);
+  }
+
+  hasher_t written;
+  {
+    durable_phone_book_t book(snapshot_path, log_path);
+    for (const user_t &user : users) {
+      book.create_user(user.number, user.name);
+    }
+    book.checkpoint();
+    for (size_t i = 0; i < calls_count; ++i) {
+      ASSERT_TRUE(book.add_call({users[gen() % users_count].number, static_cast<double>(gen() % 100)}));
+    }
+    written.add(book.book().get_calls(0, calls_count)).add(book.book().search_users_by_number("", 100));
+  }
+
+  durable_phone_book_t book(snapshot_path, log_path);
+  hasher_t recovered;
+  recovered.add(book.book().get_calls(0, calls_count)).add(book.book().search_users_by_number("", 100));
+  ASSERT_EQ(recovered.get(), written.get());
+}
+
+TEST(Hard, SearchPagesThroughAllUsers) {
+  phone_book_t book;
+  export_trace(book);
+  generator_t gen(61102);
+
+  static constexpr size_t users_count = 50'000;
+  std::vector<user_t> users(users_count);
+  for (size_t i = 0; i < users_count; ++i) {
+    users[i].number = gen_str(5, 8, gen);
+    users[i].name = gen_str(1, 6, gen);
+  }
+  book.create_users(users);
+  std::vector<call_t> new_calls(users_count);
+  for (size_t i = 0; i < users_count; ++i) {
+    new_calls[i] = {users[gen() % users_count].number, static_cast<double>(gen() % 10)};
+  }
+  book.add_calls(new_calls);
+
+  static constexpr size_t page_size = 20;
+  hasher_t paged_hash;
+  size_t paged_count = 0;
+  for (search_page_t page = book.search_users_by_number_page("", page_size);;
+       page = book.search_users_by_number_page("", page_size, page.next_cursor)) {
+    paged_hash.add(page.users);
+    paged_count += page.users.size();
+    if (page.next_cursor.empty()) {
+      break;
+    }
+  }
+  for (search_page_t page = book.search_users_by_name_page("a", page_size);;
+       page = book.search_users_by_name_page("a", page_size, page.next_cursor)) {
+    paged_hash.add(page.users);
+    paged_count += page.users.size();
+    if (page.next_cursor.empty()) {
+      break;
+    }
+  }
+
+  hasher_t full_hash;
+  std::vector<user_info_t> by_number = book.search_users_by_number("", users_count);
+  std::vector<user_info_t> by_name = book.search_users_by_name("a", users_count);
+  for (const auto *found : {&by_number, &by_name}) {
+    for (size_t i = 0; i < found->size(); i += page_size) {
+      auto page_end = found->begin() + std::min(i + page_size, found->size());
+      full_hash.add(std::vector<user_info_t>(found->begin() + i, page_end));
+    }
+  }
+  ASSERT_EQ(paged_count, by_number.size() + by_name.size());
+  ASSERT_EQ(paged_hash.get(), full_hash.get());
+}
+
+TEST(Hard, TraceReplay) {
+  const std::string path = testing::TempDir() + "phone-book-hard.trace";
+  phone_book_t book;
+  book.start_trace(path);
+  generator_t gen(90210);
+
+  static constexpr size_t users_count = 10'000;
+  static constexpr size_t operations_count = 100'000;
+  std::vector<std::string> numbers(users_count);
+  for (std::string &number : numbers) {
+    number = gen_str(3, 8, gen);
+    book.create_user(number, gen_str(1, 8, gen));
+  }
+  for (size_t i = 0; i < operations_count; ++i) {
+    const std::string &number = numbers[gen() % users_count];
+    size_t start_pos = gen() % (i + 1);
+    size_t count = gen() % 20;
+    switch (gen() % 8) {
+    case 0:
+    case 1:
+      book.add_call({number, static_cast<double>(gen() % 100)});
+      break;
+    case 2:
+      book.search_users_by_number(number.substr(0, start_pos % 4), count);
+      break;
+    case 3:
+      book.search_users_by_name(gen_str(0, 2, gen), count);
+      break;
+    case 4:
+      book.get_calls_for_user(number, start_pos % 3, count);
+      break;
+    case 5:
+      book.get_calls(start_pos, count);
+      break;
+    case 6:
+      if (count % 2 == 0) {
+        book.rename_user(number, gen_str(1, 8, gen));
+      } else {
+        book.remove_user(number);
+      }
+      break;
+    default:
+      book.create_user(number, gen_str(1, 8, gen));
+      break;
+    }
+  }
+  book.stop_trace();
+
+  std::vector<trace_record_t> records = read_trace(path);
+  ASSERT_EQ(records.size(), users_count + operations_count);
+  hasher_t h;
+  for (const trace_record_t &record : records) {
+    h.add(static_cast<uint64_t>(record.operation)).add(record.result_size);
+  }
+
+  phone_book_t replayed;
+  replay_report_t report = replay_trace(records, replayed);
+  ASSERT_EQ(report.calls(), records.size());
+  ASSERT_EQ(report.mismatches(), 0);
+  ASSERT_EQ(replayed.search_users_by_number("", users_count), book.search_users_by_number("", users_count));
+  ASSERT_EQ(replayed.get_calls(0, operations_count), book.get_calls(0, operations_count));
+  std::remove(path.c_str());
+  ASSERT_EQ(h.get(), 1727018056153655512ULL);
+}
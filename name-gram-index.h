@@ -0,0 +1,293 @@
+#pragma once
+
+#include "append-list.h"
+#include "cow-ptr.h"
+#include "name-pool.h"
+#include "sharded-map.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * Index of names by their n-grams of 1 to 3 bytes: every n-gram maps to the ids of names containing it.
+ * Names are indexed lazily in order of their ids by the first query or update after they were interned, so adding
+ * users costs nothing until substrings are searched and posting lists stay sorted by appending.
+ * A fragment of at most 3 bytes is answered by its own list exactly, a longer one by intersecting the lists
+ * of its trigrams, which gives candidates to check. Lists are shared between copies as append_list_t are,
+ * concurrent queries on one index are safe. Names come from a name_pool_t or any names_t with size() and
+ * view(id) whose names only get appended
+ */
+class name_gram_index_t {
+public:
+  static constexpr size_t max_gram_size = 3;
+
+  explicit name_gram_index_t(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : state(resource), resource(resource) {}
+
+  name_gram_index_t(const name_gram_index_t &other) : state(other.locked_state()), resource(other.resource) {}
+
+  name_gram_index_t &operator=(const name_gram_index_t &other) {
+    if (this != &other) {
+      cow_ptr_t<state_t> copy = other.locked_state();
+      std::lock_guard lock(mutex);
+      state = std::move(copy);
+      resource = other.resource;
+    }
+    return *this;
+  }
+
+  /**
+   * @return upper bound of the number of names containing non-empty fragment, exact for at most 3 bytes
+   */
+  template <typename names_t>
+  size_t count_upper_bound(std::string_view fragment, const names_t &names) const {
+    update(names);
+    size_t bound = static_cast<size_t>(-1);
+    for_each_list(fragment, [&bound](const append_list_t *list) {
+      bound = std::min(bound, list == nullptr ? 0 : list->size());
+    });
+    return bound;
+  }
+
+  /**
+   * @return ids of names containing all n-grams of non-empty fragment in increasing order:
+   * exactly the names containing fragment if it is at most 3 bytes, their superset otherwise
+   */
+  template <typename names_t>
+  std::vector<uint32_t> candidates(std::string_view fragment, const names_t &names) const {
+    update(names);
+    std::vector<const append_list_t *> lists;
+    bool missing = false;
+    for_each_list(fragment, [&](const append_list_t *list) {
+      missing = missing || list == nullptr;
+      lists.push_back(list);
+    });
+    std::vector<uint32_t> found;
+    if (missing) {
+      return found;
+    }
+    std::sort(lists.begin(), lists.end(),
+              [](const append_list_t *a, const append_list_t *b) { return a->size() < b->size(); });
+    lists.erase(std::unique(lists.begin(), lists.end()), lists.end());
+    // candidates of the shortest list are increasing, so every other list is searched from where it stopped
+    std::vector<size_t> cursors(lists.size());
+    const append_list_t &shortest = *lists.front();
+    for (size_t i = 0; i < shortest.size(); ++i) {
+      uint32_t name_id = shortest[i];
+      bool in_all = true;
+      for (size_t l = 1; l < lists.size() && in_all; ++l) {
+        cursors[l] = lower_bound(*lists[l], cursors[l], name_id);
+        in_all = cursors[l] < lists[l]->size() && (*lists[l])[cursors[l]] == name_id;
+      }
+      if (in_all) {
+        found.push_back(name_id);
+      }
+    }
+    return found;
+  }
+
+  /**
+   * Index names added since the last update, which every query runs first. Grams of a batch of names
+   * are grouped by a stable sort, so every list is appended all ids of the batch at once instead of being
+   * visited per name
+   */
+  template <typename names_t>
+  void update(const names_t &names) const {
+    std::lock_guard lock(mutex);
+    if (state->indexed == names.size()) {
+      return;
+    }
+    state_t &owned = state.write();
+    std::vector<uint64_t> short_seen(short_grams / 64);
+    std::vector<uint32_t> trigrams_seen;
+    // (gram, name id) pairs of the batch, ids increasing
+    std::vector<uint64_t> batch;
+    for (; owned.indexed < names.size(); ++owned.indexed) {
+      auto name_id = static_cast<uint32_t>(owned.indexed);
+      collect(name_id, names.view(name_id), short_seen, trigrams_seen, batch);
+      if (batch.size() >= batch_size || owned.indexed + 1 == names.size()) {
+        flush(batch, owned.postings);
+      }
+    }
+  }
+
+  /**
+   * Start over empty in resource without destroying the current state, for an owner that releases
+   * the memory the state lives in all at once. The mutex stays the same object
+   */
+  void abandon(std::pmr::memory_resource *new_resource) {
+    std::lock_guard lock(mutex);
+    new (&state) cow_ptr_t<state_t>(new_resource);
+    resource = new_resource;
+  }
+
+private:
+  struct state_t {
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+    explicit state_t(const allocator_type &allocator = {}) : postings(allocator.resource()) {}
+
+    // shards stay shared with other, so they keep its resource
+    state_t(const state_t &other, const allocator_type & = {}) : postings(other.postings), indexed(other.indexed) {}
+
+    sharded_map_t<uint32_t, append_list_t> postings;
+    // names [0, indexed) of the pool are in postings
+    size_t indexed{0};
+  };
+
+  // 1-grams come after all 2-grams
+  static constexpr size_t short_grams = (size_t{1} << 16) + 256;
+  // pairs of (gram, name id) collected before they are appended to lists
+  static constexpr size_t batch_size = size_t{1} << 20;
+
+  cow_ptr_t<state_t> locked_state() const {
+    std::lock_guard lock(mutex);
+    return state;
+  }
+
+  /**
+   * Append pairs of every distinct gram of name with its id to batch.
+   * Grams seen so far are a bitmap of all grams up to 2 bytes, zeroed again at the end,
+   * and an open addressing set of trigrams sized to stay at most half full; trigram keys are never 0
+   */
+  static void collect(uint32_t name_id, std::string_view name, std::vector<uint64_t> &short_seen,
+                      std::vector<uint32_t> &trigrams_seen, std::vector<uint64_t> &batch) {
+    size_t capacity = 64;
+    while (capacity < 2 * name.size()) {
+      capacity *= 2;
+    }
+    trigrams_seen.assign(capacity, 0);
+    size_t batch_begin = batch.size();
+    auto add = [&](uint32_t gram) { batch.push_back(uint64_t{gram} << 32 | name_id); };
+    auto add_short = [&](uint32_t gram) {
+      size_t bit = short_index(gram);
+      if ((short_seen[bit / 64] >> bit % 64 & 1) == 0) {
+        short_seen[bit / 64] |= uint64_t{1} << bit % 64;
+        add(gram);
+      }
+    };
+    // bytes of the grams ending at the current one
+    uint32_t last = 0;
+    for (size_t i = 0; i < name.size(); ++i) {
+      last = (last << 8 | static_cast<unsigned char>(name[i])) & 0xffffff;
+      add_short(1 << 24 | (last & 0xff) << 16);
+      if (i >= 1) {
+        add_short(2 << 24 | (last & 0xffff) << 8);
+      }
+      if (i >= 2) {
+        uint32_t gram = 3 << 24 | last;
+        size_t slot = (gram * uint64_t{0x9E3779B97F4A7C15}) >> 32 & (capacity - 1);
+        while (trigrams_seen[slot] != 0 && trigrams_seen[slot] != gram) {
+          slot = (slot + 1) & (capacity - 1);
+        }
+        if (trigrams_seen[slot] == 0) {
+          trigrams_seen[slot] = gram;
+          add(gram);
+        }
+      }
+    }
+    for (size_t i = batch_begin; i < batch.size(); ++i) {
+      if (auto gram = static_cast<uint32_t>(batch[i] >> 32); gram >> 24 < max_gram_size) {
+        short_seen[short_index(gram) / 64] = 0;
+      }
+    }
+  }
+
+  /**
+   * Sort batch by gram keeping the order of ids, by counting passes over the 26-bit key,
+   * and append ids to the lists of their grams
+   */
+  void flush(std::vector<uint64_t> &batch, sharded_map_t<uint32_t, append_list_t> &postings) const {
+    static constexpr size_t digit_bits = 9;
+    std::vector<uint64_t> sorted(batch.size());
+    std::vector<size_t> offsets(size_t{1} << digit_bits);
+    for (size_t shift = 32; shift < 32 + 26; shift += digit_bits) {
+      std::fill(offsets.begin(), offsets.end(), 0);
+      for (uint64_t pair : batch) {
+        ++offsets[pair >> shift & (offsets.size() - 1)];
+      }
+      size_t offset = 0;
+      for (size_t &digit_offset : offsets) {
+        offset += std::exchange(digit_offset, offset);
+      }
+      for (uint64_t pair : batch) {
+        sorted[offsets[pair >> shift & (offsets.size() - 1)]++] = pair;
+      }
+      batch.swap(sorted);
+    }
+    std::vector<uint32_t> ids;
+    for (size_t i = 0; i < batch.size();) {
+      auto gram = static_cast<uint32_t>(batch[i] >> 32);
+      for (ids.clear(); i < batch.size() && static_cast<uint32_t>(batch[i] >> 32) == gram; ++i) {
+        ids.push_back(static_cast<uint32_t>(batch[i]));
+      }
+      postings.write(gram).append(ids.data(), ids.data() + ids.size(), resource);
+    }
+    batch.clear();
+  }
+
+  static uint32_t gram_of(std::string_view gram) {
+    auto key = static_cast<uint32_t>(gram.size()) << 24;
+    for (size_t i = 0; i < gram.size(); ++i) {
+      key |= static_cast<uint32_t>(static_cast<unsigned char>(gram[i])) << (8 * (max_gram_size - 1 - i));
+    }
+    return key;
+  }
+
+  /**
+   * @return bit of gram up to 2 bytes in the bitmap of short grams
+   */
+  static size_t short_index(uint32_t gram) {
+    return gram >> 24 == 1 ? (size_t{1} << 16) + (gram >> 16 & 0xff) : gram >> 8 & 0xffff;
+  }
+
+  /**
+   * Call f with the posting list (nullptr if there is none) of fragment itself if it is short
+   * or of every trigram of it otherwise
+   */
+  template <typename F>
+  void for_each_list(std::string_view fragment, F &&f) const {
+    if (fragment.size() <= max_gram_size) {
+      f(state->postings.find(gram_of(fragment)));
+      return;
+    }
+    for (size_t i = 0; i + max_gram_size <= fragment.size(); ++i) {
+      f(state->postings.find(gram_of(fragment.substr(i, max_gram_size))));
+    }
+  }
+
+  /**
+   * @return first index not before from with value not less than name_id, found by galloping
+   */
+  static size_t lower_bound(const append_list_t &list, size_t from, uint32_t name_id) {
+    size_t step = 1;
+    size_t high = from;
+    while (high < list.size() && list[high] < name_id) {
+      from = high + 1;
+      high += step;
+      step *= 2;
+    }
+    high = std::min(high, list.size());
+    while (from < high) {
+      size_t middle = from + (high - from) / 2;
+      if (list[middle] < name_id) {
+        from = middle + 1;
+      } else {
+        high = middle;
+      }
+    }
+    return from;
+  }
+
+  // brought up to date by const queries under mutex, shared by copies until then
+  mutable cow_ptr_t<state_t> state;
+  mutable std::mutex mutex;
+  std::pmr::memory_resource *resource;
+};
@@ -0,0 +1,245 @@
+#pragma once
+
+#include "name-pool.h"
+#include "number-key.h"
+#include "persistent-set.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory_resource>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * First 16 bytes of a name packed big-endian into two words and zero padded, with the length of the name.
+ * Fingerprints order names as the names do unless both share the first 16 bytes and are longer,
+ * so most comparisons of keys do not read the names they refer to
+ */
+class name_fingerprint_t {
+public:
+  static constexpr size_t inline_size = 16;
+
+  name_fingerprint_t() = default;
+
+  explicit name_fingerprint_t(std::string_view name) : size(static_cast<uint32_t>(name.size())) {
+    char bytes[inline_size] = {};
+    std::memcpy(bytes, name.data(), std::min(name.size(), inline_size));
+    high = load(bytes);
+    low = load(bytes + sizeof(uint64_t));
+  }
+
+  /**
+   * @return negative, zero or positive as name of a compares to name of b,
+   * calls compare_names() for the result only if fingerprints do not decide it
+   */
+  template <typename F>
+  static int compare(const name_fingerprint_t &a, const name_fingerprint_t &b, const F &compare_names) {
+    if (a.high != b.high) {
+      return a.high < b.high ? -1 : 1;
+    }
+    if (a.low != b.low) {
+      return a.low < b.low ? -1 : 1;
+    }
+    // a name of at most 16 bytes is a prefix of the other one, padding included
+    if (a.size <= inline_size || b.size <= inline_size) {
+      return a.size == b.size ? 0 : a.size < b.size ? -1 : 1;
+    }
+    return compare_names();
+  }
+
+private:
+  static uint64_t load(const char *bytes) {
+    uint64_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap64(word);
+#else
+    return word;
+#endif
+  }
+
+  uint64_t high{0};
+  uint64_t low{0};
+  uint32_t size{0};
+};
+
+/**
+ * Key of name index, ordered by: name asc, total call duration desc, number asc.
+ * Keeps the fingerprint of its name inline, so a walk down the index reads the names only on ties
+ */
+struct name_key_t {
+  name_key_t() = default;
+
+  name_key_t(name_ref_t name, double total_call_duration_s, const number_key_t &number)
+      : fingerprint(name.view()), name(name), total_call_duration_s(total_call_duration_s), number(number) {}
+
+  name_fingerprint_t fingerprint;
+  name_ref_t name;
+  double total_call_duration_s{0};
+  number_key_t number;
+
+  friend bool operator<(const name_key_t &a, const name_key_t &b) {
+    // interned names are equal iff they are the same record, which compare checks first
+    if (int cmp = name_fingerprint_t::compare(a.fingerprint, b.fingerprint, [&] { return a.name.compare(b.name); });
+        cmp != 0) {
+      return cmp < 0;
+    }
+    if (a.total_call_duration_s != b.total_call_duration_s) {
+      return a.total_call_duration_s > b.total_call_duration_s;
+    }
+    return a.number < b.number;
+  }
+
+  /**
+   * Name prefix probe for heterogeneous lookup: placed before all keys with name not less than prefix
+   */
+  struct prefix_t {
+    explicit prefix_t(std::string_view prefix) : prefix(prefix), fingerprint(prefix) {}
+
+    std::string_view prefix;
+    name_fingerprint_t fingerprint;
+  };
+
+  friend bool operator<(const name_key_t &a, const prefix_t &b) {
+    return compare_name(a, b.prefix, b.fingerprint) < 0;
+  }
+  friend bool operator<(const prefix_t &a, const name_key_t &b) {
+    return compare_name(b, a.prefix, a.fingerprint) >= 0;
+  }
+
+  /**
+   * Probe for heterogeneous lookup ordered as a key with the same fields
+   */
+  struct position_t {
+    position_t(std::string_view name, double total_call_duration_s, const number_key_t &number)
+        : name(name), fingerprint(name), total_call_duration_s(total_call_duration_s), number(number) {}
+
+    std::string_view name;
+    name_fingerprint_t fingerprint;
+    double total_call_duration_s{0};
+    number_key_t number;
+  };
+
+  friend bool operator<(const name_key_t &a, const position_t &b) {
+    if (int cmp = compare_name(a, b.name, b.fingerprint); cmp != 0) {
+      return cmp < 0;
+    }
+    return less_after_name(a.total_call_duration_s, a.number, b.total_call_duration_s, b.number);
+  }
+  friend bool operator<(const position_t &a, const name_key_t &b) {
+    if (int cmp = compare_name(b, a.name, a.fingerprint); cmp != 0) {
+      return cmp > 0;
+    }
+    return less_after_name(a.total_call_duration_s, a.number, b.total_call_duration_s, b.number);
+  }
+
+private:
+  static int compare_name(const name_key_t &key, std::string_view name, const name_fingerprint_t &fingerprint) {
+    return name_fingerprint_t::compare(key.fingerprint, fingerprint, [&] { return key.name.view().compare(name); });
+  }
+
+  static bool less_after_name(double a_total, const number_key_t &a_number, double b_total,
+                              const number_key_t &b_number) {
+    if (a_total != b_total) {
+      return a_total > b_total;
+    }
+    return a_number < b_number;
+  }
+};
+
+/**
+ * Balanced ordered index of users by name_key_t, copied in O(1) with structural sharing.
+ * Prefix query seeks to the first key with name not less than prefix and walks forward
+ */
+class name_index_t {
+public:
+  using const_iterator = persistent_set_t<name_key_t>::const_iterator;
+
+  explicit name_index_t(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : keys(resource), resource(resource) {}
+
+  void insert(const name_key_t &key) {
+    keys.insert(key);
+  }
+
+  /**
+   * Insert keys sorted in index order: a batch comparable with the index is merged with it
+   * and the index is rebuilt in linear time, a small batch is inserted key by key
+   */
+  void insert_sorted(const std::vector<name_key_t> &sorted_keys) {
+    if (sorted_keys.size() < keys.size() / 4) {
+      for (const name_key_t &key : sorted_keys) {
+        keys.insert(key);
+      }
+      return;
+    }
+    std::vector<name_key_t> merged;
+    merged.reserve(keys.size() + sorted_keys.size());
+    std::merge(keys.begin(), keys.end(), sorted_keys.begin(), sorted_keys.end(), std::back_inserter(merged));
+    keys = persistent_set_t<name_key_t>(merged.begin(), merged.end(), resource);
+  }
+
+  void erase(const name_key_t &key) {
+    keys.erase(key);
+  }
+
+  /**
+   * Reposition key after changing total call duration
+   */
+  void update(const name_key_t &old_key, double total_call_duration_s) {
+    name_key_t key = old_key;
+    key.total_call_duration_s = total_call_duration_s;
+    replace(old_key, key);
+  }
+
+  void replace(const name_key_t &old_key, const name_key_t &key) {
+    keys.erase(old_key);
+    keys.insert(key);
+  }
+
+  /**
+   * Replace old_keys with new_keys, both sorted in index order: a batch comparable with the index
+   * is merged with it and the index is rebuilt in linear time, a small batch is replaced key by key
+   */
+  void replace_sorted(const std::vector<name_key_t> &old_keys, const std::vector<name_key_t> &new_keys) {
+    keys.replace_sorted(old_keys, new_keys);
+  }
+
+  /**
+   * @return first key with name starting with prefix or end() if there is no such key
+   */
+  const_iterator lower_bound(std::string_view prefix) const {
+    return keys.lower_bound(name_key_t::prefix_t(prefix));
+  }
+
+  /**
+   * @return first key after position
+   */
+  const_iterator upper_bound(const name_key_t::position_t &position) const {
+    return keys.upper_bound(position);
+  }
+
+  static bool starts_with(const_iterator it, std::string_view prefix) {
+    return it->name.view().substr(0, prefix.size()) == prefix;
+  }
+
+  const_iterator end() const {
+    return keys.end();
+  }
+
+  size_t size() const {
+    return keys.size();
+  }
+
+  void clear() {
+    keys.clear();
+  }
+
+private:
+  persistent_set_t<name_key_t> keys;
+  std::pmr::memory_resource *resource;
+};
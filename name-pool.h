@@ -0,0 +1,161 @@
+#pragma once
+
+#include "cow-ptr.h"
+#include "persistent-vector.h"
+#include "sharded-map.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Reference to a name interned in name_pool_t: pointer to a length-prefixed record in the pool's arena.
+ * Names are interned, so two references are equal iff they point to the same record
+ */
+class name_ref_t {
+public:
+  name_ref_t() = default;
+
+  std::string_view view() const {
+    uint32_t size;
+    std::memcpy(&size, record, sizeof(size));
+    return {record + sizeof(size), size};
+  }
+
+  std::string str() const {
+    return std::string(view());
+  }
+
+  int compare(const name_ref_t &other) const {
+    return record == other.record ? 0 : view().compare(other.view());
+  }
+
+  friend bool operator==(const name_ref_t &a, const name_ref_t &b) {
+    return a.record == b.record;
+  }
+  friend bool operator!=(const name_ref_t &a, const name_ref_t &b) {
+    return a.record != b.record;
+  }
+
+private:
+  friend class name_pool_t;
+
+  explicit name_ref_t(const char *record) : record(record) {}
+
+  const char *record{nullptr};
+};
+
+/**
+ * Arena-backed pool of interned names addressed by compact ids.
+ * Arena chunks are shared between copies of the pool and written bytes are never changed,
+ * so copying the pool never copies names, and id tables are persistent, so copying takes O(1).
+ * A copy appends to the shared tail chunk only if no other copy has appended after its end.
+ * Chunks and tables are allocated from the memory resource
+ */
+class name_pool_t {
+public:
+  static constexpr size_t chunk_size = 64 * 1024;
+
+  explicit name_pool_t(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : chunks(resource), refs(resource), ids(resource) {}
+
+  /**
+   * @return id of name, adding it to the pool if it is not interned yet
+   */
+  uint32_t intern(std::string_view name) {
+    if (const uint32_t *id = ids.find(name); id != nullptr) {
+      return *id;
+    }
+    name_ref_t ref = allocate(name);
+    auto id = static_cast<uint32_t>(refs.size());
+    refs.push_back(ref);
+    ids.emplace(ref.view(), id);
+    return id;
+  }
+
+  name_ref_t ref(uint32_t id) const {
+    return refs[id];
+  }
+
+  std::string_view view(uint32_t id) const {
+    return refs[id].view();
+  }
+
+  /**
+   * @return count of distinct names
+   */
+  size_t size() const {
+    return refs.size();
+  }
+
+  void clear() {
+    chunks.reset();
+    refs.clear();
+    ids.clear();
+    tail_used = chunk_size;
+  }
+
+private:
+  static constexpr size_t alignment = alignof(uint32_t);
+
+  name_ref_t allocate(std::string_view name) {
+    auto size = static_cast<uint32_t>(name.size());
+    size_t record_size = sizeof(size) + name.size();
+    char *record;
+    auto &list = chunks.write();
+    if (record_size > chunk_size / 8) {
+      // dedicated chunk for a long name, placed before the tail so the tail keeps filling up
+      auto chunk = allocate_shared_in<chunk_t>(resource(), record_size, resource());
+      record = chunk->bytes;
+      list.insert(list.empty() ? list.end() : std::prev(list.end()), std::move(chunk));
+    } else {
+      size_t offset = (tail_used + alignment - 1) / alignment * alignment;
+      size_t expected = tail_used;
+      // tail chunk is shared with copies of the pool: whoever claims the bytes after the end first appends in place
+      if (offset + record_size > chunk_size ||
+          !list.back()->claimed.compare_exchange_strong(expected, offset + record_size)) {
+        list.push_back(allocate_shared_in<chunk_t>(resource(), chunk_size, resource()));
+        list.back()->claimed.store(record_size, std::memory_order_relaxed);
+        offset = 0;
+      }
+      record = list.back()->bytes + offset;
+      tail_used = offset + record_size;
+    }
+    std::memcpy(record, &size, sizeof(size));
+    std::memcpy(record + sizeof(size), name.data(), name.size());
+    return name_ref_t(record);
+  }
+
+  struct chunk_t {
+    chunk_t(size_t size, std::pmr::memory_resource *resource)
+        : bytes(static_cast<char *>(resource->allocate(size))), size(size), resource(resource) {}
+
+    chunk_t(const chunk_t &) = delete;
+    chunk_t &operator=(const chunk_t &) = delete;
+
+    ~chunk_t() {
+      resource->deallocate(bytes, size);
+    }
+
+    char *bytes;
+    size_t size;
+    std::pmr::memory_resource *resource;
+    // bytes handed out to some copy of the pool
+    std::atomic<size_t> claimed{0};
+  };
+
+  std::pmr::memory_resource *resource() const {
+    return chunks->get_allocator().resource();
+  }
+
+  cow_ptr_t<std::pmr::vector<std::shared_ptr<chunk_t>>> chunks;
+  size_t tail_used{chunk_size};
+  persistent_vector_t<name_ref_t> refs;
+  sharded_map_t<std::string_view, uint32_t> ids;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/**
+ * Packed inline key for phone numbers (at most 20 characters).
+ * Layout is three 64-bit words: bytes [0, 20) hold the number padded with zeros
+ * and the last byte holds its length, so equality, ordering and hashing are done word-wise
+ * without touching the heap. Comparing words as big-endian integers gives exactly
+ * the lexicographic order of std::string (padding is the smallest byte, length breaks ties).
+ */
+class number_key_t {
+public:
+  static constexpr size_t max_length = 20;
+
+  number_key_t() = default;
+
+  explicit number_key_t(std::string_view number) {
+    std::memcpy(bytes(), number.data(), number.size());
+    bytes()[sizeof(words) - 1] = static_cast<char>(number.size());
+  }
+
+  /**
+   * @return can number be represented by the key
+   */
+  static bool fits(std::string_view number) {
+    return number.size() <= max_length;
+  }
+
+  size_t size() const {
+    return static_cast<unsigned char>(bytes()[sizeof(words) - 1]);
+  }
+
+  std::string_view view() const {
+    return {bytes(), size()};
+  }
+
+  std::string str() const {
+    return std::string(view());
+  }
+
+  /**
+   * @return is key's number starts with prefix (prefix must fit into the key)
+   */
+  bool starts_with(const number_key_t &prefix) const {
+    size_t len = prefix.size();
+    if (len > size()) {
+      return false;
+    }
+    for (size_t i = 0; i < word_count; ++i, len = len > 8 ? len - 8 : 0) {
+      uint64_t mask = len >= 8 ? ~uint64_t{0} : low_bytes_mask(len);
+      if ((words[i] ^ prefix.words[i]) & mask) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  size_t hash() const {
+    const uint64_t m = 0x9e3779b97f4a7c15ULL;
+    uint64_t h = words[0] * m;
+    h = (h ^ (h >> 29) ^ words[1]) * m;
+    h = (h ^ (h >> 29) ^ words[2]) * m;
+    return static_cast<size_t>(h ^ (h >> 32));
+  }
+
+  friend bool operator==(const number_key_t &a, const number_key_t &b) {
+    return ((a.words[0] ^ b.words[0]) | (a.words[1] ^ b.words[1]) | (a.words[2] ^ b.words[2])) == 0;
+  }
+  friend bool operator!=(const number_key_t &a, const number_key_t &b) {
+    return !(a == b);
+  }
+  friend bool operator<(const number_key_t &a, const number_key_t &b) {
+    for (size_t i = 0; i < word_count; ++i) {
+      if (a.words[i] != b.words[i]) {
+        return big_endian(a.words[i]) < big_endian(b.words[i]);
+      }
+    }
+    return false;
+  }
+  friend bool operator>(const number_key_t &a, const number_key_t &b) {
+    return b < a;
+  }
+  friend bool operator<=(const number_key_t &a, const number_key_t &b) {
+    return !(b < a);
+  }
+  friend bool operator>=(const number_key_t &a, const number_key_t &b) {
+    return !(a < b);
+  }
+
+private:
+  static constexpr size_t word_count = 3;
+
+  char *bytes() {
+    return reinterpret_cast<char *>(words);
+  }
+  const char *bytes() const {
+    return reinterpret_cast<const char *>(words);
+  }
+
+  static uint64_t big_endian(uint64_t word) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return __builtin_bswap64(word);
+#else
+    return word;
+#endif
+  }
+
+  /**
+   * @return mask of the first len bytes of a word in memory order
+   */
+  static uint64_t low_bytes_mask(size_t len) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    return (uint64_t{1} << (len * 8)) - 1;
+#else
+    return ~((~uint64_t{0}) >> (len * 8));
+#endif
+  }
+
+  uint64_t words[word_count]{};
+};
+
+static_assert(sizeof(number_key_t) == 24, "number key must stay packed into three words");
+static_assert(std::is_trivially_copyable_v<number_key_t>, "number key must be trivially copyable");
+static_assert(number_key_t::max_length < sizeof(number_key_t), "length byte must not overlap the number");
+
+/**
+ * Hasher for unordered containers keyed by number_key_t
+ */
+struct number_key_hash_t {
+  size_t operator()(const number_key_t &key) const {
+    return key.hash();
+  }
+};
@@ -0,0 +1,394 @@
+#pragma once
+
+#include "name-pool.h"
+#include "number-key.h"
+#include "persistent-set.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <numeric>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Key of number prefix index, ordered by: total call duration desc, name asc, number asc
+ */
+struct number_rank_key_t {
+  double total_call_duration_s{0};
+  name_ref_t name;
+  number_key_t number;
+
+  friend bool operator<(const number_rank_key_t &a, const number_rank_key_t &b) {
+    if (a.total_call_duration_s != b.total_call_duration_s) {
+      return a.total_call_duration_s > b.total_call_duration_s;
+    }
+    if (int cmp = a.name.compare(b.name); cmp != 0) {
+      return cmp < 0;
+    }
+    return a.number < b.number;
+  }
+
+  /**
+   * Probe for heterogeneous lookup ordered as a key with the same fields
+   */
+  struct position_t {
+    double total_call_duration_s{0};
+    std::string_view name;
+    number_key_t number;
+  };
+
+  friend bool operator<(const number_rank_key_t &a, const position_t &b) {
+    return less(a.total_call_duration_s, a.name.view(), a.number, b.total_call_duration_s, b.name, b.number);
+  }
+  friend bool operator<(const position_t &a, const number_rank_key_t &b) {
+    return less(a.total_call_duration_s, a.name, a.number, b.total_call_duration_s, b.name.view(), b.number);
+  }
+
+private:
+  static bool less(double a_total, std::string_view a_name, const number_key_t &a_number, double b_total,
+                   std::string_view b_name, const number_key_t &b_number) {
+    if (a_total != b_total) {
+      return a_total > b_total;
+    }
+    if (int cmp = a_name.compare(b_name); cmp != 0) {
+      return cmp < 0;
+    }
+    return a_number < b_number;
+  }
+};
+
+/**
+ * Radix trie over numbers where every node keeps all users of its subtree ordered by number_rank_key_t,
+ * so top-count users for a number prefix are the first count keys of a single node.
+ * Chains without branching are compressed into one edge, so a key is stored only in the branching
+ * and terminal nodes on its path (at most 21, usually a handful).
+ * Nodes and their user sets are persistent: copying the trie takes O(1) and a modification
+ * clones only the shared nodes on its path. Nodes and their sets are allocated from the memory resource
+ */
+class number_trie_t {
+public:
+  using users_t = persistent_set_t<number_rank_key_t>;
+
+  explicit number_trie_t(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : root(allocate_shared_in<node_t>(resource)), resource(resource) {}
+
+  void insert(const number_rank_key_t &key) {
+    walk_or_create(
+        key.number, [&key](node_t &node) { node.users.insert(key); }, [](const node_t &, node_t &) {});
+  }
+
+  /**
+   * Insert keys sorted in index order: keys are distributed to the nodes of their paths first,
+   * then every touched node is built in linear time if it was empty or gets keys inserted otherwise
+   */
+  void insert_sorted(const std::vector<number_rank_key_t> &sorted_keys) {
+    std::unordered_map<const node_t *, std::vector<number_rank_key_t>> pending;
+    std::vector<node_t *> touched;
+    for (const number_rank_key_t &key : sorted_keys) {
+      walk_or_create(
+          key.number,
+          [&pending, &touched, &key](node_t &node) {
+            auto &keys = pending[&node];
+            if (keys.empty()) {
+              touched.push_back(&node);
+            }
+            keys.push_back(key);
+          },
+          [&pending, &touched](const node_t &old_node, node_t &new_node) {
+            // every key processed later is greater, so the copy stays sorted after appending
+            if (auto it = pending.find(&old_node); it != pending.end()) {
+              pending[&new_node] = it->second;
+              touched.push_back(&new_node);
+            }
+          });
+    }
+    for (node_t *node : touched) {
+      const std::vector<number_rank_key_t> &keys = pending[node];
+      if (node->users.empty()) {
+        node->users = users_t(keys.begin(), keys.end(), resource);
+        continue;
+      }
+      for (const number_rank_key_t &key : keys) {
+        node->users.insert(key);
+      }
+    }
+  }
+
+  /**
+   * Erase key of a stored user from the nodes on its path. A node that would be left without users
+   * is cut off with its subtree; a chain left without branching stays uncompressed
+   */
+  void erase(const number_rank_key_t &key) {
+    std::string_view number = key.number.view();
+    node_t *node = &own(root);
+    node->users.erase(key);
+    while (node->depth < number.size()) {
+      auto it = std::find_if(node->children.begin(), node->children.end(),
+                             [c = number[node->depth]](const auto &next) { return next.first == c; });
+      if (it == node->children.end()) {
+        return;
+      }
+      // key is the last user of the subtree
+      if (it->second->users.size() == 1) {
+        node->children.erase(it);
+        return;
+      }
+      node = &own(it->second);
+      node->users.erase(key);
+    }
+  }
+
+  /**
+   * Reposition key after changing total call duration
+   */
+  void update(const number_rank_key_t &old_key, double total_call_duration_s) {
+    number_rank_key_t key = old_key;
+    key.total_call_duration_s = total_call_duration_s;
+    replace(old_key, key);
+  }
+
+  /**
+   * Replace old_key with key of the same number in the nodes on its path
+   */
+  void replace(const number_rank_key_t &old_key, const number_rank_key_t &key) {
+    walk_owned(old_key.number, [&](node_t &node) {
+      node.users.erase(old_key);
+      node.users.insert(key);
+    });
+  }
+
+  /**
+   * Replace old_keys with new_keys of the same numbers, both sorted in index order. Every node on their paths
+   * replaces its keys as one batch, so a node on the paths of many of them is rebuilt once in linear time
+   */
+  void replace_sorted(const std::vector<number_rank_key_t> &old_keys,
+                      const std::vector<number_rank_key_t> &new_keys) {
+    if (!old_keys.empty()) {
+      replace_sorted(root, old_keys, new_keys);
+    }
+  }
+
+
+  /**
+   * @return users with number starting with prefix or nullptr if there are no such users
+   */
+  const users_t *find(std::string_view prefix) const {
+    const node_t *node = descend(root.get(), prefix, [](const node_t *) {});
+    return node == nullptr ? nullptr : &node->users;
+  }
+
+  /**
+   * Same as find for every prefix. Prefixes are walked in sorted order, each one starting from the deepest node
+   * on the path of the previous one that is shared with it, so a common prefix is walked once
+   * @return users of every prefix in the order of prefixes, nullptr where there are no such users
+   */
+  template <typename prefixes_t>
+  std::vector<const users_t *> find_many(const prefixes_t &prefixes) const {
+    std::vector<size_t> order(prefixes.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&prefixes](size_t a, size_t b) {
+      return std::string_view(prefixes[a]) < std::string_view(prefixes[b]);
+    });
+    std::vector<const users_t *> result(prefixes.size(), nullptr);
+    // nodes on the path of the previous prefix, root first; the last one may end past the prefix
+    std::vector<const node_t *> path = {root.get()};
+    std::string_view previous;
+    for (size_t i : order) {
+      std::string_view prefix(prefixes[i]);
+      size_t common = 0;
+      while (common < std::min(previous.size(), prefix.size()) && previous[common] == prefix[common]) {
+        ++common;
+      }
+      // the root has depth 0, so it always stays
+      while (path.back()->depth > common) {
+        path.pop_back();
+      }
+      const node_t *node = descend(path.back(), prefix, [&path](const node_t *next) { path.push_back(next); });
+      if (node != nullptr) {
+        result[i] = &node->users;
+      }
+      previous = prefix;
+    }
+    return result;
+  }
+
+  /**
+   * Visit nodes in breadth-first order, so children of every node are visited consecutively.
+   * Calls f(path, depth, users, children_count), path of the root is empty
+   */
+  template <typename F>
+  void visit_breadth_first(F &&f) const {
+    std::vector<const node_t *> queue = {root.get()};
+    for (size_t i = 0; i < queue.size(); ++i) {
+      const node_t &node = *queue[i];
+      f(node.path, node.depth, node.users, node.children.size());
+      for (const auto &[c, next] : node.children) {
+        queue.push_back(next.get());
+      }
+    }
+  }
+
+  void clear() {
+    root = allocate_shared_in<node_t>(resource);
+  }
+
+private:
+  /**
+   * Node represents prefix path[0 .. depth) shared by all numbers of its subtree
+   */
+  struct node_t {
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+    explicit node_t(const allocator_type &allocator) : children(allocator), users(allocator.resource()) {}
+
+    node_t(const node_t &other, const allocator_type &allocator)
+        : path(other.path), depth(other.depth), children(other.children, allocator), users(other.users) {}
+
+    number_key_t path;
+    size_t depth{0};
+    std::pmr::vector<std::pair<char, std::shared_ptr<node_t>>> children;
+    users_t users;
+  };
+
+  template <typename node_ref_t>
+  static auto child(node_ref_t &node, char c) -> decltype(&node.children.front().second) {
+    for (auto &[key, next] : node.children) {
+      if (key == c) {
+        return &next;
+      }
+    }
+    return nullptr;
+  }
+
+  /**
+   * Walk from node, whose path is a prefix of prefix, down to the node of prefix, calling on_node(next)
+   * for every node matched on the way
+   * @return node of the shortest path starting with prefix or nullptr if there is none
+   */
+  template <typename on_node_t>
+  static const node_t *descend(const node_t *node, std::string_view prefix, on_node_t &&on_node) {
+    while (node->depth < prefix.size()) {
+      size_t depth = node->depth;
+      const std::shared_ptr<node_t> *next = child(*node, prefix[depth]);
+      if (next == nullptr) {
+        return nullptr;
+      }
+      node = next->get();
+      size_t end = std::min(node->depth, prefix.size());
+      if (node->path.view().substr(depth, end - depth) != prefix.substr(depth, end - depth)) {
+        return nullptr;
+      }
+      on_node(node);
+    }
+    return node;
+  }
+
+  /**
+   * @return node of slot for modification, cloned first if it is shared with another trie
+   */
+  node_t &own(std::shared_ptr<node_t> &slot) const {
+    if (slot.use_count() > 1) {
+      slot = allocate_shared_in<node_t>(resource, *slot);
+    }
+    return *slot;
+  }
+
+  /**
+   * Replace keys in the node of slot and below it: keys are split between children in order, so stay sorted
+   */
+  void replace_sorted(std::shared_ptr<node_t> &slot, const std::vector<number_rank_key_t> &old_keys,
+                      const std::vector<number_rank_key_t> &new_keys) {
+    node_t &node = own(slot);
+    node.users.replace_sorted(old_keys, new_keys);
+    if (node.children.empty()) {
+      return;
+    }
+    std::vector<std::vector<number_rank_key_t>> old_parts(node.children.size());
+    std::vector<std::vector<number_rank_key_t>> new_parts(node.children.size());
+    auto split = [&node](const std::vector<number_rank_key_t> &keys, auto &parts) {
+      for (const number_rank_key_t &key : keys) {
+        std::string_view digits = key.number.view();
+        if (digits.size() == node.depth) {
+          continue;
+        }
+        for (size_t i = 0; i < node.children.size(); ++i) {
+          if (node.children[i].first == digits[node.depth]) {
+            parts[i].push_back(key);
+            break;
+          }
+        }
+      }
+    };
+    split(old_keys, old_parts);
+    split(new_keys, new_parts);
+    for (size_t i = 0; i < node.children.size(); ++i) {
+      if (!old_parts[i].empty()) {
+        replace_sorted(node.children[i].second, old_parts[i], new_parts[i]);
+      }
+    }
+  }
+
+  /**
+   * Walk nodes on the path of stored number from root to its terminal node, cloning the shared ones
+   */
+  template <typename on_node_t>
+  void walk_owned(const number_key_t &number, on_node_t &&on_node) {
+    std::string_view digits = number.view();
+    for (std::shared_ptr<node_t> *slot = &root;;) {
+      node_t &node = own(*slot);
+      on_node(node);
+      if (node.depth == digits.size()) {
+        break;
+      }
+      slot = child(node, digits[node.depth]);
+    }
+  }
+
+  /**
+   * Walk nodes on the path of number from root to its terminal node, creating missing nodes.
+   * When an edge has to be split, the new node inherits users of the old one and on_split(old, new) is called
+   */
+  template <typename on_node_t, typename on_split_t>
+  void walk_or_create(const number_key_t &number, on_node_t &&on_node, on_split_t &&on_split) {
+    std::string_view digits = number.view();
+    node_t *node = &own(root);
+    on_node(*node);
+    while (node->depth < digits.size()) {
+      size_t depth = node->depth;
+      char c = digits[depth];
+      std::shared_ptr<node_t> *slot = child(*node, c);
+      if (slot == nullptr) {
+        auto leaf = allocate_shared_in<node_t>(resource);
+        leaf->path = number;
+        leaf->depth = digits.size();
+        node->children.emplace_back(c, std::move(leaf));
+        slot = &node->children.back().second;
+      } else {
+        const node_t &next = **slot;
+        std::string_view next_digits = next.path.view();
+        size_t common = depth + 1;
+        while (common < std::min(next.depth, digits.size()) && next_digits[common] == digits[common]) {
+          ++common;
+        }
+        if (common < next.depth) {
+          auto middle = allocate_shared_in<node_t>(resource);
+          middle->path = next.path;
+          middle->depth = common;
+          middle->users = next.users;
+          on_split(next, *middle);
+          middle->children.emplace_back(next_digits[common], std::move(*slot));
+          *slot = std::move(middle);
+        }
+      }
+      node = &own(*slot);
+      on_node(*node);
+    }
+  }
+
+  std::shared_ptr<node_t> root;
+  std::pmr::memory_resource *resource;
+};
@@ -0,0 +1,433 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+/**
+ * Ordered set on an AVL tree with reference-counted nodes and path copying.
+ * Copying the set takes O(1): both copies share the tree and a modification clones only the nodes
+ * on its path that are still shared, while nodes owned by a single tree are modified in place.
+ * Readers walk nodes by raw pointers and never touch reference counters.
+ * Nodes are allocated from the memory resource, copies of the set share it with the nodes
+ */
+template <typename T, typename Compare = std::less<>>
+class persistent_set_t {
+  struct node_t;
+
+public:
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+
+    // user-provided on purpose: value-initialization must not zero the stack
+    const_iterator() {}
+
+    // only the used part of the stack is copied
+    const_iterator(const const_iterator &other) : depth(other.depth) {
+      std::copy(other.stack, other.stack + depth, stack);
+    }
+
+    const_iterator &operator=(const const_iterator &other) {
+      depth = other.depth;
+      std::copy(other.stack, other.stack + depth, stack);
+      return *this;
+    }
+
+    const T &operator*() const {
+      return stack[depth - 1]->value;
+    }
+    const T *operator->() const {
+      return &stack[depth - 1]->value;
+    }
+
+    const_iterator &operator++() {
+      const node_t *node = stack[--depth];
+      push_left(node->right);
+      return *this;
+    }
+    const_iterator operator++(int) {
+      const_iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    friend bool operator==(const const_iterator &a, const const_iterator &b) {
+      return a.top() == b.top();
+    }
+    friend bool operator!=(const const_iterator &a, const const_iterator &b) {
+      return a.top() != b.top();
+    }
+
+  private:
+    friend class persistent_set_t;
+
+    // height of an AVL tree is below 1.45 * log2(size + 2), enough for any size addressable by memory
+    static constexpr size_t max_height = 64;
+
+    const node_t *top() const {
+      return depth == 0 ? nullptr : stack[depth - 1];
+    }
+
+    void push(const node_t *node) {
+      stack[depth++] = node;
+    }
+
+    void push_left(const node_t *node) {
+      for (; node != nullptr; node = node->left) {
+        push(node);
+      }
+    }
+
+    // nodes whose values are not visited yet, the top one is the current value
+    const node_t *stack[max_height];
+    size_t depth{0};
+  };
+
+  explicit persistent_set_t(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : resource(resource) {}
+
+  /**
+   * Build from a random access range sorted by Compare without duplicates in linear time
+   */
+  template <typename iterator_t>
+  persistent_set_t(iterator_t first, iterator_t last,
+                   std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : count(static_cast<size_t>(last - first)), resource(resource) {
+    root = build(first, 0, count);
+  }
+
+  persistent_set_t(const persistent_set_t &other)
+      : root(retain(other.root)), count(other.count), resource(other.resource) {}
+
+  persistent_set_t(persistent_set_t &&other) noexcept
+      : root(other.root), count(other.count), resource(other.resource) {
+    other.root = nullptr;
+    other.count = 0;
+  }
+
+  persistent_set_t &operator=(const persistent_set_t &other) {
+    persistent_set_t copy(other);
+    swap(copy);
+    return *this;
+  }
+
+  persistent_set_t &operator=(persistent_set_t &&other) noexcept {
+    persistent_set_t moved(std::move(other));
+    swap(moved);
+    return *this;
+  }
+
+  ~persistent_set_t() {
+    release(root);
+  }
+
+  void swap(persistent_set_t &other) noexcept {
+    std::swap(root, other.root);
+    std::swap(count, other.count);
+    std::swap(resource, other.resource);
+  }
+
+  /**
+   * @return was value actually inserted
+   */
+  bool insert(const T &value) {
+    bool inserted = false;
+    root = insert(root, value, inserted);
+    count += inserted;
+    return inserted;
+  }
+
+  /**
+   * @return was value equivalent to key actually erased
+   */
+  template <typename key_t>
+  bool erase(const key_t &key) {
+    bool erased = false;
+    root = erase(root, key, erased);
+    count -= erased;
+    return erased;
+  }
+
+  /**
+   * Erase values equivalent to erased and insert inserted, both sorted by Compare without duplicates.
+   * A batch comparable with the set is merged with it and the set is rebuilt in linear time,
+   * a small batch is applied value by value
+   */
+  void replace_sorted(const std::vector<T> &erased, const std::vector<T> &inserted) {
+    if (erased.size() + inserted.size() < count / 4) {
+      for (const T &value : erased) {
+        erase(value);
+      }
+      for (const T &value : inserted) {
+        insert(value);
+      }
+      return;
+    }
+    std::vector<T> kept;
+    kept.reserve(count);
+    auto next = erased.begin();
+    for (const_iterator it = begin(); it != end(); ++it) {
+      while (next != erased.end() && compare(*next, *it)) {
+        ++next;
+      }
+      if (next == erased.end() || compare(*it, *next)) {
+        kept.push_back(*it);
+      }
+    }
+    std::vector<T> merged;
+    merged.reserve(kept.size() + inserted.size());
+    std::merge(kept.begin(), kept.end(), inserted.begin(), inserted.end(), std::back_inserter(merged), compare);
+    *this = persistent_set_t(merged.begin(), merged.end(), resource);
+  }
+
+  /**
+   * @return iterator to the first value not less than key
+   */
+  template <typename key_t>
+  const_iterator lower_bound(const key_t &key) const {
+    const_iterator it;
+    for (const node_t *node = root; node != nullptr;) {
+      if (compare(node->value, key)) {
+        node = node->right;
+      } else {
+        it.push(node);
+        node = node->left;
+      }
+    }
+    return it;
+  }
+
+  /**
+   * @return iterator to the first value greater than key
+   */
+  template <typename key_t>
+  const_iterator upper_bound(const key_t &key) const {
+    const_iterator it;
+    for (const node_t *node = root; node != nullptr;) {
+      if (compare(key, node->value)) {
+        it.push(node);
+        node = node->left;
+      } else {
+        node = node->right;
+      }
+    }
+    return it;
+  }
+
+  template <typename key_t>
+  const_iterator find(const key_t &key) const {
+    const_iterator it = lower_bound(key);
+    return it != end() && !compare(key, *it) ? it : end();
+  }
+
+  const_iterator begin() const {
+    const_iterator it;
+    it.push_left(root);
+    return it;
+  }
+
+  const_iterator end() const {
+    return const_iterator();
+  }
+
+  size_t size() const {
+    return count;
+  }
+
+  bool empty() const {
+    return count == 0;
+  }
+
+  void clear() {
+    release(root);
+    root = nullptr;
+    count = 0;
+  }
+
+private:
+  struct node_t {
+    explicit node_t(const T &value) : value(value) {}
+
+    T value;
+    node_t *left{nullptr};
+    node_t *right{nullptr};
+    int height{1};
+    std::atomic<uint32_t> refs{1};
+  };
+
+  static node_t *retain(node_t *node) {
+    if (node != nullptr) {
+      node->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    return node;
+  }
+
+  node_t *create(const T &value) const {
+    return new (resource->allocate(sizeof(node_t), alignof(node_t))) node_t(value);
+  }
+
+  void release(node_t *node) const {
+    while (node != nullptr && node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      release(node->left);
+      node_t *right = node->right;
+      node->~node_t();
+      resource->deallocate(node, sizeof(node_t), alignof(node_t));
+      node = right;
+    }
+  }
+
+  /**
+   * Takes a reference to node and returns a node owned by the caller only, cloning the node if it is shared
+   */
+  node_t *own(node_t *node) const {
+    if (node->refs.load(std::memory_order_acquire) == 1) {
+      return node;
+    }
+    node_t *copy = create(node->value);
+    copy->left = retain(node->left);
+    copy->right = retain(node->right);
+    copy->height = node->height;
+    release(node);
+    return copy;
+  }
+
+  static int height(const node_t *node) {
+    return node == nullptr ? 0 : node->height;
+  }
+
+  static void update(node_t *node) {
+    node->height = std::max(height(node->left), height(node->right)) + 1;
+  }
+
+  node_t *rotate_right(node_t *node) const {
+    node_t *left = own(node->left);
+    node->left = left->right;
+    left->right = node;
+    update(node);
+    update(left);
+    return left;
+  }
+
+  node_t *rotate_left(node_t *node) const {
+    node_t *right = own(node->right);
+    node->right = right->left;
+    right->left = node;
+    update(node);
+    update(right);
+    return right;
+  }
+
+  /**
+   * Restore AVL balance of an owned node whose subtrees are balanced and differ in height by at most 2
+   */
+  node_t *balance(node_t *node) const {
+    update(node);
+    int factor = height(node->left) - height(node->right);
+    if (factor > 1) {
+      if (height(node->left->left) < height(node->left->right)) {
+        node->left = rotate_left(own(node->left));
+      }
+      return rotate_right(node);
+    }
+    if (factor < -1) {
+      if (height(node->right->right) < height(node->right->left)) {
+        node->right = rotate_right(own(node->right));
+      }
+      return rotate_left(node);
+    }
+    return node;
+  }
+
+  node_t *insert(node_t *node, const T &value, bool &inserted) const {
+    if (node == nullptr) {
+      inserted = true;
+      return create(value);
+    }
+    if (compare(value, node->value)) {
+      node = own(node);
+      node->left = insert(node->left, value, inserted);
+    } else if (compare(node->value, value)) {
+      node = own(node);
+      node->right = insert(node->right, value, inserted);
+    } else {
+      return node;
+    }
+    return balance(node);
+  }
+
+  template <typename key_t>
+  node_t *erase(node_t *node, const key_t &key, bool &erased) const {
+    if (node == nullptr) {
+      return nullptr;
+    }
+    if (compare(key, node->value)) {
+      node = own(node);
+      node->left = erase(node->left, key, erased);
+      return balance(node);
+    }
+    if (compare(node->value, key)) {
+      node = own(node);
+      node->right = erase(node->right, key, erased);
+      return balance(node);
+    }
+    erased = true;
+    if (node->left == nullptr || node->right == nullptr) {
+      node_t *child = retain(node->left != nullptr ? node->left : node->right);
+      release(node);
+      return child;
+    }
+    node = own(node);
+    node_t *min = nullptr;
+    node_t *right = take_min(node->right, min);
+    min->left = node->left;
+    min->right = right;
+    node->left = nullptr;
+    node->right = nullptr;
+    release(node);
+    return balance(min);
+  }
+
+  /**
+   * Detach the minimal node of a subtree: min becomes an owned node without children
+   */
+  node_t *take_min(node_t *node, node_t *&min) const {
+    node = own(node);
+    if (node->left == nullptr) {
+      node_t *right = node->right;
+      node->right = nullptr;
+      min = node;
+      return right;
+    }
+    node->left = take_min(node->left, min);
+    return balance(node);
+  }
+
+  template <typename iterator_t>
+  node_t *build(iterator_t values, size_t begin, size_t end) const {
+    if (begin == end) {
+      return nullptr;
+    }
+    size_t middle = begin + (end - begin) / 2;
+    node_t *node = create(values[middle]);
+    node->left = build(values, begin, middle);
+    node->right = build(values, middle + 1, end);
+    update(node);
+    return node;
+  }
+
+  node_t *root{nullptr};
+  size_t count{0};
+  std::pmr::memory_resource *resource;
+  Compare compare{};
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "cow-ptr.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+/**
+ * Vector stored as fixed-size chunks shared between copies.
+ * Copying takes O(1), the first modification after a copy clones the list of chunks
+ * and changing an element clones its chunk if that chunk is still shared.
+ * A copy appends to a shared tail chunk in place if no other copy has appended to it yet.
+ * Chunks are allocated from the memory resource
+ */
+template <typename T, size_t chunk_size = 256>
+class persistent_vector_t {
+public:
+  explicit persistent_vector_t(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : chunks(resource), resource(resource) {}
+
+  const T &operator[](size_t pos) const {
+    return (*chunks)[pos / chunk_size]->items[pos % chunk_size];
+  }
+
+  /**
+   * @return element for modification
+   */
+  T &write(size_t pos) {
+    auto &chunk = chunks.write()[pos / chunk_size];
+    if (chunk.use_count() > 1) {
+      chunk = clone(*chunk, std::min(chunk_size, count - pos / chunk_size * chunk_size));
+    }
+    return chunk->items[pos % chunk_size];
+  }
+
+  void push_back(const T &value) {
+    auto &list = chunks.write();
+    size_t offset = count % chunk_size;
+    if (offset == 0) {
+      list.push_back(allocate_shared_in<chunk_t>(resource));
+    }
+    if (size_t expected = offset; !list.back()->claimed.compare_exchange_strong(expected, offset + 1)) {
+      list.back() = clone(*list.back(), offset);
+      list.back()->claimed.store(offset + 1, std::memory_order_relaxed);
+    }
+    list.back()->items[offset] = value;
+    ++count;
+  }
+
+  void reserve(size_t capacity) {
+    chunks.write().reserve((capacity + chunk_size - 1) / chunk_size);
+  }
+
+  const T &back() const {
+    return (*this)[count - 1];
+  }
+
+  size_t size() const {
+    return count;
+  }
+
+  bool empty() const {
+    return count == 0;
+  }
+
+  void clear() {
+    chunks.reset();
+    count = 0;
+  }
+
+private:
+  struct chunk_t {
+    T items[chunk_size];
+    // count of items handed out to some copy of the vector
+    std::atomic<size_t> claimed{0};
+  };
+
+  std::shared_ptr<chunk_t> clone(const chunk_t &chunk, size_t items_count) const {
+    auto copy = allocate_shared_in<chunk_t>(resource);
+    std::copy(chunk.items, chunk.items + items_count, copy->items);
+    copy->claimed.store(items_count, std::memory_order_relaxed);
+    return copy;
+  }
+
+  cow_ptr_t<std::pmr::vector<std::shared_ptr<chunk_t>>> chunks;
+  size_t count{0};
+  std::pmr::memory_resource *resource;
+};
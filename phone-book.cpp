@@ -1 +1,983 @@
 #include "phone-book.h"
+#include "levenshtein-automaton.h"
+
+#include <algorithm>
+#include <limits>
+#include <new>
+#include <optional>
+#include <stdexcept>
+
+namespace {
+
+user_info_t mapped_user_info(const mapped_snapshot_t &snapshot, uint32_t user_id) {
+  const snapshot_user_t &user = snapshot.user(user_id);
+  return {{user.number.str(), std::string(snapshot.name(user))}, user.total_call_duration_s};
+}
+
+/**
+ * Fill page with users from [it, end) while they match, and set the cursor if matching users remain
+ */
+template <typename iterator_t, typename matches_t, typename info_of_t>
+void fill_page(search_page_t &page, iterator_t it, iterator_t end, size_t count, search_cursor_t::kind_t kind,
+               const matches_t &matches, const info_of_t &info_of) {
+  for (; page.users.size() < count && it != end && matches(*it); ++it) {
+    page.users.push_back(info_of(*it));
+  }
+  if (!page.users.empty() && it != end && matches(*it)) {
+    const user_info_t &last = page.users.back();
+    page.next_cursor = search_cursor_t{kind, last.total_call_duration_s, last.user.name, last.user.number}.encode();
+  }
+}
+
+/**
+ * @return the least string greater than every string starting with prefix, empty if there is none
+ */
+std::string prefix_end(std::string prefix) {
+  while (!prefix.empty() && static_cast<unsigned char>(prefix.back()) == 0xff) {
+    prefix.pop_back();
+  }
+  if (!prefix.empty()) {
+    ++prefix.back();
+  }
+  return prefix;
+}
+
+bool starts_with(std::string_view s, std::string_view prefix) {
+  return s.substr(0, prefix.size()) == prefix;
+}
+
+/**
+ * Fuzzy prefix search over users in name search order, seen as a trie of their names:
+ * children of a trie node are found by seeking past the previous child, so the walk costs a seek per node
+ * the automaton does not cut, independent of the count of users
+ */
+template <typename iterator_t, typename lower_bound_t, typename name_of_t>
+class fuzzy_search_t {
+public:
+  fuzzy_search_t(const levenshtein_automaton_t &automaton, iterator_t end, const lower_bound_t &lower_bound,
+                 const name_of_t &name_of)
+      : automaton(automaton), end(end), lower_bound(lower_bound), name_of(name_of) {
+    deferred.push_back({"", automaton.start(), automaton.max_distance() + 1});
+  }
+
+  /**
+   * Walk the trie once, going deeper than distance only when users at smaller distances are not enough
+   * @return at most count users sorted by distance of their names, then in name search order
+   */
+  template <typename info_of_t>
+  std::vector<user_info_t> users(size_t count, const info_of_t &info_of) {
+    std::vector<user_info_t> result;
+    for (size_t distance = 0; distance <= automaton.max_distance() && result.size() < count; ++distance) {
+      resume(distance);
+      for (size_t i = 0; i < found.size() && result.size() < count; ++i) {
+        if (found[i].distance == distance) {
+          add_users(i, count, info_of, result);
+        }
+      }
+    }
+    return result;
+  }
+
+private:
+  /**
+   * Prefix of names at distance from the pattern less than the distance of any shorter prefix of it
+   */
+  struct found_t {
+    std::string prefix;
+    size_t distance;
+  };
+
+  /**
+   * Trie node not visited yet, as no name continuing it is within the distance walked so far
+   */
+  struct node_t {
+    std::string prefix;
+    levenshtein_automaton_t::state_t state;
+    size_t best;
+  };
+
+  /**
+   * Visit the deferred nodes the automaton lets reach distance: found then has every prefix up to distance
+   */
+  void resume(size_t distance) {
+    std::vector<node_t> nodes;
+    nodes.swap(deferred);
+    for (node_t &node : nodes) {
+      if (levenshtein_automaton_t::min_distance(node.state) > distance) {
+        deferred.push_back(std::move(node));
+      } else {
+        walk(node.prefix, node.state, node.best, distance);
+      }
+    }
+    // resumed nodes add prefixes out of order
+    std::sort(found.begin(), found.end(), [](const found_t &a, const found_t &b) { return a.prefix < b.prefix; });
+  }
+
+  void walk(std::string &prefix, const levenshtein_automaton_t::state_t &state, size_t best, size_t distance) {
+    if (size_t d = levenshtein_automaton_t::distance(state); d < best) {
+      found.push_back({prefix, d});
+      best = d;
+    }
+    // a longer prefix is not closer than the minimum of the state
+    if (levenshtein_automaton_t::min_distance(state) >= best) {
+      return;
+    }
+    // names equal to prefix come before the names continuing it
+    prefix.push_back('\0');
+    iterator_t it = lower_bound(prefix);
+    prefix.pop_back();
+    while (it != end && starts_with(name_of(*it), prefix)) {
+      char c = name_of(*it)[prefix.size()];
+      prefix.push_back(c);
+      levenshtein_automaton_t::state_t next_state = automaton.step(state, c);
+      size_t min_distance = levenshtein_automaton_t::min_distance(next_state);
+      if (min_distance > distance && min_distance < best) {
+        deferred.push_back({prefix, std::move(next_state), best});
+      } else {
+        walk(prefix, next_state, best, distance);
+      }
+      std::string next = prefix_end(prefix);
+      prefix.pop_back();
+      if (next.size() <= prefix.size()) {
+        break;
+      }
+      it = lower_bound(next);
+    }
+  }
+
+  /**
+   * Add users with names starting with found[i].prefix, skipping the closer found prefixes,
+   * which follow it in found as the walk is in order
+   */
+  template <typename info_of_t>
+  void add_users(size_t i, size_t count, const info_of_t &info_of, std::vector<user_info_t> &result) const {
+    const std::string &prefix = found[i].prefix;
+    size_t closer = i + 1;
+    auto is_closer = [&](std::string_view name) {
+      return closer < found.size() && starts_with(found[closer].prefix, prefix) &&
+             starts_with(name, found[closer].prefix);
+    };
+    for (iterator_t it = lower_bound(prefix); it != end && result.size() < count;) {
+      std::string_view name = name_of(*it);
+      if (!starts_with(name, prefix)) {
+        break;
+      }
+      while (closer < found.size() && starts_with(found[closer].prefix, prefix) && found[closer].prefix < name &&
+             !starts_with(name, found[closer].prefix)) {
+        ++closer;
+      }
+      if (is_closer(name)) {
+        std::string next = prefix_end(found[closer].prefix);
+        it = next.empty() ? end : lower_bound(next);
+        continue;
+      }
+      result.push_back(info_of(*it));
+      ++it;
+    }
+  }
+
+  const levenshtein_automaton_t &automaton;
+  iterator_t end;
+  const lower_bound_t &lower_bound;
+  const name_of_t &name_of;
+  // in order of prefixes
+  std::vector<found_t> found;
+  std::vector<node_t> deferred;
+};
+
+/**
+ * Names of the users of a mapped snapshot by their positions in name search order, for name_gram_index_t
+ */
+class mapped_names_t {
+public:
+  explicit mapped_names_t(const mapped_snapshot_t &snapshot)
+      : snapshot(snapshot), order(snapshot.name_order().first) {}
+
+  size_t size() const {
+    return snapshot.users_count();
+  }
+
+  std::string_view view(uint32_t position) const {
+    return snapshot.name(snapshot.user(order[position]));
+  }
+
+private:
+  const mapped_snapshot_t &snapshot;
+  const uint32_t *order;
+};
+
+std::optional<search_cursor_t> parse_cursor(const std::string &cursor, search_cursor_t::kind_t kind) {
+  if (cursor.empty()) {
+    return std::nullopt;
+  }
+  std::optional<search_cursor_t> position = search_cursor_t::decode(cursor, kind);
+  if (!position) {
+    throw std::invalid_argument("not a search cursor: " + cursor);
+  }
+  return position;
+}
+
+} // namespace
+
+phone_book_t::phone_book_t(std::pmr::memory_resource *resource)
+    : resource(resource), names(resource), users(resource), users_by_number(resource), number_trie(resource),
+      name_index(resource), name_grams(resource), calls(resource), user_calls(resource) {}
+
+phone_book_t phone_book_t::with_arena() {
+  auto arena = std::make_shared<arena_resource_t>();
+  phone_book_t book(arena.get());
+  book.arena = std::move(arena);
+  return book;
+}
+
+phone_book_t &phone_book_t::operator=(const phone_book_t &other) {
+  // the parts being replaced may live in the arena of this book, so it is released only after them
+  std::shared_ptr<arena_resource_t> old_arena = arena;
+  arena = other.arena;
+  resource = other.resource;
+  names = other.names;
+  users = other.users;
+  users_by_number = other.users_by_number;
+  number_trie = other.number_trie;
+  name_index = other.name_index;
+  name_grams = other.name_grams;
+  calls = other.calls;
+  user_calls = other.user_calls;
+  mapped = other.mapped;
+  mapped_grams = other.mapped_grams;
+  query_cache = other.query_cache;
+  stats_recorder = other.stats_recorder;
+  trace = other.trace;
+  return *this;
+}
+
+bool phone_book_t::create_user(const std::string &number, const std::string &name) {
+  auto traced = trace.call(trace_operation_t::create_user, number, name);
+  auto measure = stats_recorder.measure(operation_t::create_user);
+  materialize();
+  if (!number_key_t::fits(number)) {
+    return traced.done(measure.done(false));
+  }
+  number_key_t key(number);
+  auto user_id = static_cast<uint32_t>(users.size());
+  if (!users_by_number.emplace(key, user_id)) {
+    return traced.done(measure.done(false));
+  }
+  uint32_t name_id = names.intern(name);
+  users.push_back({key, name_id, 0});
+  user_calls.push_back({});
+  name_ref_t stored_name = names.ref(name_id);
+  number_trie.insert({0, stored_name, key});
+  name_index.insert({stored_name, 0, key});
+  if (query_cache.enabled()) {
+    query_cache_t::user_view_t created{number, name, 0};
+    query_cache.update(nullptr, &created);
+  }
+  return traced.done(measure.done(true));
+}
+
+bool phone_book_t::add_call(const call_t &call) {
+  auto traced = trace.call(trace_operation_t::add_call, call);
+  auto measure = stats_recorder.measure(operation_t::add_call);
+  materialize();
+  if (!number_key_t::fits(call.number)) {
+    return traced.done(measure.done(false));
+  }
+  number_key_t key(call.number);
+  const uint32_t *user_id = users_by_number.find(key);
+  if (user_id == nullptr) {
+    return traced.done(measure.done(false));
+  }
+  user_calls.write(*user_id).push_back(next_call_position(), resource);
+  user_record_t &user = users.write(*user_id);
+  double total_call_duration_s = user.total_call_duration_s + call.duration_s;
+  name_ref_t name = names.ref(user.name_id);
+  number_trie.update({user.total_call_duration_s, name, key}, total_call_duration_s);
+  name_index.update({name, user.total_call_duration_s, key}, total_call_duration_s);
+  if (query_cache.enabled()) {
+    query_cache_t::user_view_t before{call.number, name.view(), user.total_call_duration_s};
+    query_cache_t::user_view_t after{call.number, name.view(), total_call_duration_s};
+    query_cache.update(&before, &after);
+  }
+  user.total_call_duration_s = total_call_duration_s;
+  calls.write().push_back(*user_id, call.duration_s);
+  return traced.done(measure.done(true));
+}
+
+std::vector<bool> phone_book_t::create_users(const std::vector<user_t> &new_users) {
+  auto traced = trace.call(trace_operation_t::create_users, new_users);
+  auto measure = stats_recorder.measure(operation_t::create_users);
+  materialize();
+  std::vector<bool> created(new_users.size());
+  users.reserve(users.size() + new_users.size());
+  user_calls.reserve(users.size() + new_users.size());
+  users_by_number.reserve(users_by_number.size() + new_users.size());
+  std::vector<name_key_t> name_keys;
+  std::vector<number_rank_key_t> rank_keys;
+  for (size_t i = 0; i < new_users.size(); ++i) {
+    const user_t &user = new_users[i];
+    if (!number_key_t::fits(user.number)) {
+      continue;
+    }
+    number_key_t key(user.number);
+    auto user_id = static_cast<uint32_t>(users.size());
+    if (!users_by_number.emplace(key, user_id)) {
+      continue;
+    }
+    uint32_t name_id = names.intern(user.name);
+    users.push_back({key, name_id, 0});
+    user_calls.push_back({});
+    name_keys.push_back({names.ref(name_id), 0, key});
+    rank_keys.push_back({0, names.ref(name_id), key});
+    created[i] = true;
+    if (query_cache.enabled()) {
+      query_cache_t::user_view_t created_user{user.number, user.name, 0};
+      query_cache.update(nullptr, &created_user);
+    }
+  }
+  if (name_keys.empty()) {
+    return traced.done(measure.done(std::move(created)));
+  }
+  std::sort(name_keys.begin(), name_keys.end());
+  std::sort(rank_keys.begin(), rank_keys.end());
+  name_index.insert_sorted(name_keys);
+  number_trie.insert_sorted(rank_keys);
+  return traced.done(measure.done(std::move(created)));
+}
+
+std::vector<bool> phone_book_t::add_calls(const std::vector<call_t> &new_calls) {
+  auto traced = trace.call(trace_operation_t::add_calls, new_calls);
+  auto measure = stats_recorder.measure(operation_t::add_calls);
+  materialize();
+  std::vector<bool> added(new_calls.size());
+  // indexes are repositioned once per touched user, so remember where each of them is now
+  std::unordered_map<uint32_t, double> old_totals;
+  for (size_t i = 0; i < new_calls.size(); ++i) {
+    const call_t &call = new_calls[i];
+    if (!number_key_t::fits(call.number)) {
+      continue;
+    }
+    const uint32_t *user_id = users_by_number.find(number_key_t(call.number));
+    if (user_id == nullptr) {
+      continue;
+    }
+    user_calls.write(*user_id).push_back(next_call_position(), resource);
+    user_record_t &user = users.write(*user_id);
+    old_totals.emplace(*user_id, user.total_call_duration_s);
+    user.total_call_duration_s += call.duration_s;
+    calls.write().push_back(*user_id, call.duration_s);
+    added[i] = true;
+  }
+  // repositioned keys are merged into every index as one sorted batch, as create_users inserts them
+  std::vector<number_rank_key_t> old_rank_keys;
+  std::vector<number_rank_key_t> new_rank_keys;
+  std::vector<name_key_t> old_name_keys;
+  std::vector<name_key_t> new_name_keys;
+  for (const auto &[user_id, old_total] : old_totals) {
+    const user_record_t &user = users[user_id];
+    name_ref_t name = names.ref(user.name_id);
+    old_rank_keys.push_back({old_total, name, user.number});
+    new_rank_keys.push_back({user.total_call_duration_s, name, user.number});
+    old_name_keys.push_back({name, old_total, user.number});
+    new_name_keys.push_back({name, user.total_call_duration_s, user.number});
+    if (query_cache.enabled()) {
+      query_cache_t::user_view_t before{user.number.view(), name.view(), old_total};
+      query_cache_t::user_view_t after{user.number.view(), name.view(), user.total_call_duration_s};
+      query_cache.update(&before, &after);
+    }
+  }
+  std::sort(old_rank_keys.begin(), old_rank_keys.end());
+  std::sort(new_rank_keys.begin(), new_rank_keys.end());
+  std::sort(old_name_keys.begin(), old_name_keys.end());
+  std::sort(new_name_keys.begin(), new_name_keys.end());
+  number_trie.replace_sorted(old_rank_keys, new_rank_keys);
+  name_index.replace_sorted(old_name_keys, new_name_keys);
+  return traced.done(measure.done(std::move(added)));
+}
+
+bool phone_book_t::remove_user(const std::string &number) {
+  auto traced = trace.call(trace_operation_t::remove_user, number);
+  auto measure = stats_recorder.measure(operation_t::remove_user);
+  materialize();
+  if (!number_key_t::fits(number)) {
+    return traced.done(measure.done(false));
+  }
+  number_key_t key(number);
+  const uint32_t *user_id = users_by_number.find(key);
+  if (user_id == nullptr) {
+    return traced.done(measure.done(false));
+  }
+  user_record_t &user = users.write(*user_id);
+  name_ref_t name = names.ref(user.name_id);
+  number_trie.erase({user.total_call_duration_s, name, key});
+  name_index.erase({name, user.total_call_duration_s, key});
+  if (query_cache.enabled()) {
+    query_cache_t::user_view_t removed{number, name.view(), user.total_call_duration_s};
+    query_cache.update(&removed, nullptr);
+  }
+  // the log refers to calls by user id, so the record keeps serving them
+  user.removed = true;
+  users_by_number.erase(key);
+  return traced.done(measure.done(true));
+}
+
+bool phone_book_t::rename_user(const std::string &number, const std::string &new_name) {
+  auto traced = trace.call(trace_operation_t::rename_user, number, new_name);
+  auto measure = stats_recorder.measure(operation_t::rename_user);
+  materialize();
+  if (!number_key_t::fits(number)) {
+    return traced.done(measure.done(false));
+  }
+  number_key_t key(number);
+  const uint32_t *user_id = users_by_number.find(key);
+  if (user_id == nullptr) {
+    return traced.done(measure.done(false));
+  }
+  user_record_t &user = users.write(*user_id);
+  uint32_t name_id = names.intern(new_name);
+  if (name_id == user.name_id) {
+    return traced.done(measure.done(true));
+  }
+  // the old name stays in the pool, it is not referenced by the indexes anymore
+  name_ref_t old_name = names.ref(user.name_id);
+  name_ref_t name = names.ref(name_id);
+  number_trie.replace({user.total_call_duration_s, old_name, key}, {user.total_call_duration_s, name, key});
+  name_index.replace({old_name, user.total_call_duration_s, key}, {name, user.total_call_duration_s, key});
+  if (query_cache.enabled()) {
+    query_cache_t::user_view_t before{number, old_name.view(), user.total_call_duration_s};
+    query_cache_t::user_view_t after{number, name.view(), user.total_call_duration_s};
+    query_cache.update(&before, &after);
+  }
+  user.name_id = name_id;
+  return traced.done(measure.done(true));
+}
+
+std::vector<call_t> phone_book_t::get_calls(size_t start_pos, size_t count) const {
+  auto traced = trace.call(trace_operation_t::get_calls, start_pos, count);
+  auto measure = stats_recorder.measure(operation_t::get_calls);
+  call_range_t range = calls_range(start_pos, count);
+  std::vector<call_t> result;
+  result.reserve(range.size());
+  for (call_view_t call : range) {
+    result.push_back({std::string(call.number), call.duration_s});
+  }
+  return traced.done(measure.done(std::move(result)));
+}
+
+std::vector<call_t> phone_book_t::get_calls_for_user(const std::string &number, size_t start_pos,
+                                                     size_t count) const {
+  auto traced = trace.call(trace_operation_t::get_calls_for_user, number, start_pos, count);
+  auto measure = stats_recorder.measure(operation_t::get_calls_for_user);
+  std::vector<call_t> result;
+  if (!number_key_t::fits(number)) {
+    return traced.done(measure.done(std::move(result)));
+  }
+  if (mapped) {
+    auto [begin, end] = mapped->find_user_calls(number_key_t(number));
+    start_pos = std::min<size_t>(start_pos, end - begin);
+    count = std::min<size_t>(count, end - begin - start_pos);
+    result.reserve(count);
+    for (const uint32_t *pos = begin + start_pos; pos != begin + start_pos + count; ++pos) {
+      result.push_back({number, mapped->call_duration_s(*pos)});
+    }
+    return traced.done(measure.done(std::move(result)));
+  }
+  const uint32_t *user_id = users_by_number.find(number_key_t(number));
+  if (user_id == nullptr) {
+    return traced.done(measure.done(std::move(result)));
+  }
+  const append_list_t &positions = user_calls[*user_id];
+  start_pos = std::min(start_pos, positions.size());
+  count = std::min(count, positions.size() - start_pos);
+  result.reserve(count);
+  for (size_t i = start_pos; i < start_pos + count; ++i) {
+    result.push_back({number, calls->duration_s(positions[i])});
+  }
+  return traced.done(measure.done(std::move(result)));
+}
+
+size_t phone_book_t::count_calls_for_user(const std::string &number) const {
+  auto traced = trace.call(trace_operation_t::count_calls_for_user, number);
+  auto measure = stats_recorder.measure(operation_t::count_calls_for_user);
+  if (!number_key_t::fits(number)) {
+    return traced.done(measure.done(size_t{0}));
+  }
+  if (mapped) {
+    auto [begin, end] = mapped->find_user_calls(number_key_t(number));
+    return traced.done(measure.done(static_cast<size_t>(end - begin)));
+  }
+  const uint32_t *user_id = users_by_number.find(number_key_t(number));
+  return traced.done(measure.done(user_id == nullptr ? size_t{0} : user_calls[*user_id].size()));
+}
+
+phone_book_t::call_range_t phone_book_t::view_calls(size_t start_pos, size_t count) const {
+  auto traced = trace.call(trace_operation_t::view_calls, start_pos, count);
+  auto measure = stats_recorder.measure(operation_t::view_calls);
+  return traced.done(measure.done(calls_range(start_pos, count)));
+}
+
+std::vector<user_info_t> phone_book_t::search_users_by_number(const std::string &number_prefix, size_t count) const {
+  auto traced = trace.call(trace_operation_t::search_by_number, number_prefix, count);
+  // cache hits are counted as well
+  auto measure = stats_recorder.measure(operation_t::search_by_number, number_prefix.size());
+  if (auto cached = query_cache.find(query_cache_t::kind_t::by_number, number_prefix, count)) {
+    return traced.done(measure.done(std::move(*cached)));
+  }
+  std::vector<user_info_t> found = number_page(number_prefix, count, {}).users;
+  query_cache.insert(query_cache_t::kind_t::by_number, number_prefix, count, found);
+  return traced.done(measure.done(std::move(found)));
+}
+
+std::vector<std::vector<user_info_t>>
+phone_book_t::search_users_by_number_multi(const std::vector<std::string> &number_prefixes, size_t count) const {
+  auto traced = trace.call(trace_operation_t::search_by_number_multi, number_prefixes, count);
+  auto measure = stats_recorder.measure(operation_t::search_by_number_multi);
+  std::vector<std::vector<user_info_t>> result(number_prefixes.size());
+  // users found for prefixes so far with the first prefix resolved to them, whose results are copied;
+  // prefixes of one request mostly end in a handful of nodes
+  std::vector<std::pair<const void *, size_t>> resolved;
+  auto fill = [&](size_t i, const void *users, size_t size, auto begin, auto end, const auto &info_of) {
+    auto it = std::find_if(resolved.begin(), resolved.end(), [users](const auto &seen) { return seen.first == users; });
+    if (it != resolved.end()) {
+      result[i] = result[it->second];
+      return;
+    }
+    resolved.emplace_back(users, i);
+    result[i].reserve(std::min(count, size));
+    for (; begin != end && result[i].size() < count; ++begin) {
+      result[i].push_back(info_of(*begin));
+    }
+  };
+  if (mapped) {
+    for (size_t i = 0; i < number_prefixes.size(); ++i) {
+      auto [begin, end] = mapped->find_number(number_prefixes[i]);
+      if (begin != end) {
+        fill(i, begin, end - begin, begin, end,
+             [this](uint32_t user_id) { return mapped_user_info(*mapped, user_id); });
+      }
+    }
+    return traced.done(measure.done(std::move(result)));
+  }
+  std::vector<const number_trie_t::users_t *> matches = number_trie.find_many(number_prefixes);
+  for (size_t i = 0; i < matches.size(); ++i) {
+    if (matches[i] != nullptr) {
+      fill(i, matches[i], matches[i]->size(), matches[i]->begin(), matches[i]->end(), [](const number_rank_key_t &key) {
+        return user_info_t{{key.number.str(), key.name.str()}, key.total_call_duration_s};
+      });
+    }
+  }
+  return traced.done(measure.done(std::move(result)));
+}
+
+std::vector<user_info_t> phone_book_t::search_users_by_name(const std::string &name_prefix, size_t count) const {
+  auto traced = trace.call(trace_operation_t::search_by_name, name_prefix, count);
+  // cache hits are counted as well
+  auto measure = stats_recorder.measure(operation_t::search_by_name, name_prefix.size());
+  if (auto cached = query_cache.find(query_cache_t::kind_t::by_name, name_prefix, count)) {
+    return traced.done(measure.done(std::move(*cached)));
+  }
+  std::vector<user_info_t> found = name_page(name_prefix, count, {}).users;
+  query_cache.insert(query_cache_t::kind_t::by_name, name_prefix, count, found);
+  return traced.done(measure.done(std::move(found)));
+}
+
+search_page_t phone_book_t::search_users_by_number_page(const std::string &number_prefix, size_t count,
+                                                        const std::string &cursor) const {
+  auto traced = trace.call(trace_operation_t::search_by_number_page, number_prefix, count, cursor);
+  auto measure = stats_recorder.measure(operation_t::search_by_number, number_prefix.size());
+  return traced.done(measure.done(number_page(number_prefix, count, cursor)));
+}
+
+search_page_t phone_book_t::search_users_by_name_page(const std::string &name_prefix, size_t count,
+                                                      const std::string &cursor) const {
+  auto traced = trace.call(trace_operation_t::search_by_name_page, name_prefix, count, cursor);
+  auto measure = stats_recorder.measure(operation_t::search_by_name, name_prefix.size());
+  return traced.done(measure.done(name_page(name_prefix, count, cursor)));
+}
+
+search_page_t phone_book_t::number_page(const std::string &number_prefix, size_t count,
+                                        const std::string &cursor) const {
+  std::optional<search_cursor_t> after = parse_cursor(cursor, search_cursor_t::kind_t::by_number);
+  search_page_t page;
+  if (mapped) {
+    auto [begin, end] = mapped->find_number(number_prefix);
+    if (after && begin != end) {
+      number_key_t after_number(after->number);
+      begin = std::upper_bound(begin, end, *after, [&](const search_cursor_t &position, uint32_t user_id) {
+        const snapshot_user_t &user = mapped->user(user_id);
+        if (position.total_call_duration_s != user.total_call_duration_s) {
+          return position.total_call_duration_s > user.total_call_duration_s;
+        }
+        if (int cmp = std::string_view(position.name).compare(mapped->name(user)); cmp != 0) {
+          return cmp < 0;
+        }
+        return after_number < user.number;
+      });
+    }
+    fill_page(
+        page, begin, end, count, search_cursor_t::kind_t::by_number, [](uint32_t) { return true; },
+        [this](uint32_t user_id) { return mapped_user_info(*mapped, user_id); });
+    return page;
+  }
+  const number_trie_t::users_t *matches = number_trie.find(number_prefix);
+  if (matches == nullptr) {
+    return page;
+  }
+  auto begin = after ? matches->upper_bound(number_rank_key_t::position_t{after->total_call_duration_s, after->name,
+                                                                           number_key_t(after->number)})
+                     : matches->begin();
+  fill_page(
+      page, begin, matches->end(), count, search_cursor_t::kind_t::by_number,
+      [](const number_rank_key_t &) { return true; },
+      [](const number_rank_key_t &key) {
+        return user_info_t{{key.number.str(), key.name.str()}, key.total_call_duration_s};
+      });
+  return page;
+}
+
+search_page_t phone_book_t::name_page(const std::string &name_prefix, size_t count, const std::string &cursor) const {
+  std::optional<search_cursor_t> after = parse_cursor(cursor, search_cursor_t::kind_t::by_name);
+  search_page_t page;
+  if (mapped) {
+    auto end = mapped->name_order().second;
+    auto begin = mapped->lower_bound_name(name_prefix);
+    if (after) {
+      number_key_t after_number(after->number);
+      begin = std::upper_bound(begin, end, *after, [&](const search_cursor_t &position, uint32_t user_id) {
+        const snapshot_user_t &user = mapped->user(user_id);
+        if (int cmp = std::string_view(position.name).compare(mapped->name(user)); cmp != 0) {
+          return cmp < 0;
+        }
+        if (position.total_call_duration_s != user.total_call_duration_s) {
+          return position.total_call_duration_s > user.total_call_duration_s;
+        }
+        return after_number < user.number;
+      });
+    }
+    fill_page(
+        page, begin, end, count, search_cursor_t::kind_t::by_name,
+        [&](uint32_t user_id) {
+          return mapped->name(mapped->user(user_id)).compare(0, name_prefix.size(), name_prefix) == 0;
+        },
+        [this](uint32_t user_id) { return mapped_user_info(*mapped, user_id); });
+    return page;
+  }
+  auto begin = after ? name_index.upper_bound({after->name, after->total_call_duration_s, number_key_t(after->number)})
+                     : name_index.lower_bound(name_prefix);
+  fill_page(
+      page, begin, name_index.end(), count, search_cursor_t::kind_t::by_name,
+      [&](const name_key_t &key) { return key.name.view().compare(0, name_prefix.size(), name_prefix) == 0; },
+      [](const name_key_t &key) {
+        return user_info_t{{key.number.str(), key.name.str()}, key.total_call_duration_s};
+      });
+  return page;
+}
+
+std::vector<user_info_t> phone_book_t::search_users_by_name_substring(const std::string &fragment,
+                                                                     size_t count) const {
+  auto traced = trace.call(trace_operation_t::search_by_name_substring, fragment, count);
+  auto measure = stats_recorder.measure(operation_t::search_by_name_substring, fragment.size());
+  std::vector<user_info_t> result;
+  auto contains = [&fragment](std::string_view name) { return name.find(fragment) != std::string_view::npos; };
+  if (mapped) {
+    const uint32_t *order = mapped->name_order().first;
+    mapped_names_t mapped_names(*mapped);
+    if (fragment.empty()) {
+      for (uint32_t position = 0; position < mapped_names.size() && result.size() < count; ++position) {
+        result.push_back(mapped_user_info(*mapped, order[position]));
+      }
+      return traced.done(measure.done(std::move(result)));
+    }
+    // ids of the index are positions in name order, so candidates already follow the search rules
+    for (uint32_t position : mapped_grams->candidates(fragment, mapped_names)) {
+      if (result.size() == count) {
+        break;
+      }
+      if (fragment.size() <= name_gram_index_t::max_gram_size || contains(mapped_names.view(position))) {
+        result.push_back(mapped_user_info(*mapped, order[position]));
+      }
+    }
+    return traced.done(measure.done(std::move(result)));
+  }
+  auto info_of = [](const name_key_t &key) {
+    return user_info_t{{key.number.str(), key.name.str()}, key.total_call_duration_s};
+  };
+  size_t bound = fragment.empty() ? names.size() : name_grams.count_upper_bound(fragment, names);
+  if (bound == 0 || count == 0) {
+    return traced.done(measure.done(std::move(result)));
+  }
+  // the bound is exact for short fragments: walking the index in order then checks about count * size / bound
+  // keys, which beats ordering all bound matching names only if the fragment is frequent
+  auto walked = static_cast<double>(count) * static_cast<double>(name_index.size()) / static_cast<double>(bound);
+  bool frequent = fragment.size() <= name_gram_index_t::max_gram_size && walked < static_cast<double>(bound);
+  if (fragment.empty() || frequent) {
+    // matches clustered late in the order would make the walk visit the whole index: past bound keys
+    // the posting lists are used instead, so the walk costs at most about as much as they do
+    size_t limit = fragment.empty() ? name_index.size() : bound;
+    auto it = name_index.lower_bound("");
+    for (size_t walked_keys = 0; it != name_index.end() && result.size() < count && walked_keys < limit;
+         ++it, ++walked_keys) {
+      if (contains(it->name.view())) {
+        result.push_back(info_of(*it));
+      }
+    }
+    if (result.size() == count || it == name_index.end()) {
+      return traced.done(measure.done(std::move(result)));
+    }
+    result.clear();
+  }
+  std::vector<uint32_t> name_ids = name_grams.candidates(fragment, names);
+  std::sort(name_ids.begin(), name_ids.end(),
+            [this](uint32_t a, uint32_t b) { return names.view(a) < names.view(b); });
+  for (uint32_t name_id : name_ids) {
+    // trigrams of a longer fragment may occur apart from each other
+    name_ref_t name = names.ref(name_id);
+    if (fragment.size() > name_gram_index_t::max_gram_size && !contains(name.view())) {
+      continue;
+    }
+    // keys with the same name are consecutive and come first among keys starting with it
+    for (auto it = name_index.lower_bound(name.view()); it != name_index.end() && it->name == name; ++it) {
+      if (result.size() == count) {
+        return traced.done(measure.done(std::move(result)));
+      }
+      result.push_back(info_of(*it));
+    }
+  }
+  return traced.done(measure.done(std::move(result)));
+}
+
+std::vector<user_info_t> phone_book_t::search_users_by_name_fuzzy(const std::string &name_prefix, size_t max_distance,
+                                                                 size_t count) const {
+  auto traced = trace.call(trace_operation_t::search_by_name_fuzzy, name_prefix, max_distance, count);
+  auto measure = stats_recorder.measure(operation_t::search_by_name_fuzzy, name_prefix.size());
+  // one walk with the max_distance automaton, resumed deeper only while closer users are not enough
+  levenshtein_automaton_t automaton(name_prefix, max_distance);
+  std::vector<user_info_t> result;
+  if (mapped) {
+    auto lower_bound = [this](std::string_view prefix) { return mapped->lower_bound_name(prefix); };
+    auto name_of = [this](uint32_t user_id) { return mapped->name(mapped->user(user_id)); };
+    fuzzy_search_t search(automaton, mapped->name_order().second, lower_bound, name_of);
+    result = search.users(count, [this](uint32_t user_id) { return mapped_user_info(*mapped, user_id); });
+  } else {
+    auto lower_bound = [this](std::string_view prefix) { return name_index.lower_bound(prefix); };
+    auto name_of = [](const name_key_t &key) { return key.name.view(); };
+    fuzzy_search_t search(automaton, name_index.end(), lower_bound, name_of);
+    result = search.users(count, [](const name_key_t &key) {
+      return user_info_t{{key.number.str(), key.name.str()}, key.total_call_duration_s};
+    });
+  }
+  return traced.done(measure.done(std::move(result)));
+}
+
+void phone_book_t::update_name_grams() const {
+  if (mapped) {
+    mapped_grams->update(mapped_names_t(*mapped));
+    return;
+  }
+  name_grams.update(names);
+}
+
+void phone_book_t::clear() {
+  auto traced = trace.call(trace_operation_t::clear);
+  auto measure = stats_recorder.measure(operation_t::clear);
+  mapped.reset();
+  mapped_grams.reset();
+  query_cache.clear();
+  if (arena != nullptr && arena.use_count() == 1) {
+    // nothing outside the parts refers to the arena: they are abandoned without visiting their nodes,
+    // none of their destructors would free anything but arena memory. The gram index keeps its mutex
+    arena->reset();
+    new (&names) name_pool_t(resource);
+    new (&users) persistent_vector_t<user_record_t>(resource);
+    new (&users_by_number) sharded_map_t<number_key_t, uint32_t, number_key_hash_t>(resource);
+    new (&number_trie) number_trie_t(resource);
+    new (&name_index) name_index_t(resource);
+    name_grams.abandon(resource);
+    new (&calls) cow_ptr_t<call_log_t>(resource);
+    new (&user_calls) persistent_vector_t<append_list_t>(resource);
+    measure.done();
+    traced.done();
+    return;
+  }
+  if (arena != nullptr) {
+    // copies still use the arena: it stays with them and the book continues in a new one
+    arena = std::make_shared<arena_resource_t>();
+    resource = arena.get();
+  }
+  names = name_pool_t(resource);
+  users = persistent_vector_t<user_record_t>(resource);
+  users_by_number = sharded_map_t<number_key_t, uint32_t, number_key_hash_t>(resource);
+  number_trie = number_trie_t(resource);
+  name_index = name_index_t(resource);
+  name_grams = name_gram_index_t(resource);
+  calls = cow_ptr_t<call_log_t>(resource);
+  user_calls = persistent_vector_t<append_list_t>(resource);
+  measure.done();
+  traced.done();
+}
+
+size_t phone_book_t::size() const {
+  return mapped ? mapped->users_count() : users_by_number.size();
+}
+
+bool phone_book_t::empty() const {
+  return size() == 0;
+}
+
+void phone_book_t::save(const std::string &path) const {
+  if (mapped) {
+    phone_book_t loaded = *this;
+    loaded.materialize();
+    loaded.save(path);
+    return;
+  }
+  snapshot_writer_t writer;
+  writer.users.reserve(users.size());
+  std::vector<uint32_t> name_offsets(names.size(), std::numeric_limits<uint32_t>::max());
+  for (size_t id = 0; id < users.size(); ++id) {
+    const user_record_t &user = users[id];
+    uint32_t &name_offset = name_offsets[user.name_id];
+    if (name_offset == std::numeric_limits<uint32_t>::max()) {
+      name_offset = writer.add_name(names.view(user.name_id));
+    }
+    writer.users.push_back({user.number, name_offset, user.removed ? snapshot_user_t::removed_flag : 0,
+                            user.total_call_duration_s});
+  }
+  writer.user_calls_begin.reserve(users.size() + 1);
+  writer.user_call_positions.reserve(calls->size());
+  for (size_t id = 0; id < users.size(); ++id) {
+    writer.user_calls_begin.push_back(writer.user_call_positions.size());
+    const append_list_t &positions = user_calls[id];
+    for (size_t i = 0; i < positions.size(); ++i) {
+      writer.user_call_positions.push_back(positions[i]);
+    }
+  }
+  writer.user_calls_begin.push_back(writer.user_call_positions.size());
+  writer.call_users.reserve(calls->size());
+  writer.call_durations.reserve(calls->size());
+  for (size_t pos = 0; pos < calls->size(); ++pos) {
+    writer.call_users.push_back(calls->user_id(pos));
+    writer.call_durations.push_back(calls->duration_s(pos));
+  }
+  auto next_child = uint32_t{1};
+  number_trie.visit_breadth_first(
+      [&](const number_key_t &path, size_t depth, const number_trie_t::users_t &node_users, size_t children_count) {
+        writer.trie_nodes.push_back({path, static_cast<uint32_t>(depth), next_child,
+                                     static_cast<uint32_t>(children_count), static_cast<uint32_t>(node_users.size()),
+                                     writer.trie_ids.size()});
+        next_child += static_cast<uint32_t>(children_count);
+        for (const number_rank_key_t &key : node_users) {
+          writer.trie_ids.push_back(*users_by_number.find(key.number));
+        }
+      });
+  writer.number_order.reserve(users_by_number.size());
+  for (size_t id = 0; id < users.size(); ++id) {
+    if (!users[id].removed) {
+      writer.number_order.push_back(static_cast<uint32_t>(id));
+    }
+  }
+  std::sort(writer.number_order.begin(), writer.number_order.end(),
+            [this](uint32_t a, uint32_t b) { return users[a].number < users[b].number; });
+  writer.name_order.reserve(users_by_number.size());
+  for (auto it = name_index.lower_bound(""); it != name_index.end(); ++it) {
+    writer.name_order.push_back(*users_by_number.find(it->number));
+  }
+  writer.write(path);
+}
+
+phone_book_t phone_book_t::open_mapped(const std::string &path, bool verify) {
+  auto snapshot = std::make_shared<const mapped_snapshot_t>(path);
+  if (verify) {
+    snapshot->verify();
+  }
+  phone_book_t book;
+  book.mapped = std::move(snapshot);
+  book.mapped_grams = std::make_shared<const name_gram_index_t>();
+  return book;
+}
+
+void phone_book_t::enable_query_cache(const query_cache_options_t &options) {
+  query_cache = query_cache_t(options);
+}
+
+query_cache_stats_t phone_book_t::query_cache_stats() const {
+  return query_cache.stats();
+}
+
+phone_book_stats_t phone_book_t::stats() const {
+  return stats_recorder.snapshot();
+}
+
+void phone_book_t::start_trace(const std::string &path) {
+  trace.start(path);
+}
+
+void phone_book_t::stop_trace() {
+  trace.stop();
+}
+
+call_view_t phone_book_t::view_call(size_t pos) const {
+  if (mapped) {
+    return {mapped->user(mapped->call_user_id(pos)).number.view(), mapped->call_duration_s(pos)};
+  }
+  return {users[calls->user_id(pos)].number.view(), calls->duration_s(pos)};
+}
+
+uint32_t phone_book_t::next_call_position() const {
+  if (calls->size() > std::numeric_limits<uint32_t>::max()) {
+    throw std::length_error("call log exceeds 2^32 records");
+  }
+  return static_cast<uint32_t>(calls->size());
+}
+
+size_t phone_book_t::calls_count() const {
+  return mapped ? mapped->calls_count() : calls->size();
+}
+
+phone_book_t::call_range_t phone_book_t::calls_range(size_t start_pos, size_t count) const {
+  start_pos = std::min(start_pos, calls_count());
+  return {this, start_pos, start_pos + std::min(count, calls_count() - start_pos)};
+}
+
+void phone_book_t::materialize() {
+  if (!mapped) {
+    return;
+  }
+  std::shared_ptr<const mapped_snapshot_t> snapshot = std::move(mapped);
+  mapped.reset();
+  mapped_grams.reset();
+  size_t users_count = snapshot->users_count();
+  size_t user_ids_count = snapshot->user_ids_count();
+  users.reserve(user_ids_count);
+  user_calls.reserve(user_ids_count);
+  users_by_number.reserve(users_count);
+  for (size_t id = 0; id < user_ids_count; ++id) {
+    const snapshot_user_t &user = snapshot->user(id);
+    bool removed = (user.flags & snapshot_user_t::removed_flag) != 0;
+    users.push_back({user.number, names.intern(snapshot->name(user)), user.total_call_duration_s, removed});
+    user_calls.push_back({});
+    if (!removed) {
+      users_by_number.emplace(user.number, static_cast<uint32_t>(id));
+    }
+  }
+  // both orders are stored in the snapshot, so indexes are built without sorting
+  std::vector<name_key_t> name_keys;
+  name_keys.reserve(users_count);
+  for (auto [it, end] = snapshot->name_order(); it != end; ++it) {
+    const user_record_t &user = users[*it];
+    name_keys.push_back({names.ref(user.name_id), user.total_call_duration_s, user.number});
+  }
+  name_index.insert_sorted(name_keys);
+  std::vector<number_rank_key_t> rank_keys;
+  rank_keys.reserve(users_count);
+  for (auto [it, end] = snapshot->find_number(""); it != end; ++it) {
+    const user_record_t &user = users[*it];
+    rank_keys.push_back({user.total_call_duration_s, names.ref(user.name_id), user.number});
+  }
+  number_trie.insert_sorted(rank_keys);
+  call_log_t &log = calls.write();
+  for (size_t pos = 0; pos < snapshot->calls_count(); ++pos) {
+    user_calls.write(snapshot->call_user_id(pos)).push_back(static_cast<uint32_t>(pos), resource);
+    log.push_back(snapshot->call_user_id(pos), snapshot->call_duration_s(pos));
+  }
+}
@@ -1,7 +1,28 @@
 #pragma once
 
+#include "append-list.h"
+#include "arena-resource.h"
+#include "call-log.h"
+#include "cow-ptr.h"
+#include "name-gram-index.h"
+#include "name-index.h"
+#include "name-pool.h"
+#include "number-key.h"
+#include "number-trie.h"
+#include "persistent-vector.h"
+#include "query-cache.h"
+#include "search-cursor.h"
+#include "sharded-map.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "trace.h"
+
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 
 /**
@@ -19,6 +40,25 @@ struct call_t {
   }
 };
 
+/**
+ * Non-owning call-record, number refers to phone book's storage.
+ * Valid until the next mutation of the phone book it was obtained from
+ */
+struct call_view_t {
+  std::string_view number;
+  double duration_s{0};
+
+  friend bool operator==(const call_view_t &a, const call_view_t &b) {
+    return a.number == b.number && a.duration_s == b.duration_s;
+  }
+  friend bool operator==(const call_view_t &a, const call_t &b) {
+    return a.number == b.number && a.duration_s == b.duration_s;
+  }
+  friend std::ostream &operator<<(std::ostream &stream, const call_view_t &a) {
+    return stream << "call_view_t { number: " << a.number << ";  " << "duration_s: " << a.duration_s << "; }";
+  }
+};
+
 /**
  * Structure for user with defined equality operator and output operator
  */
@@ -49,25 +89,51 @@ struct user_info_t {
   }
 };
 
+/**
+ * Page of search results with the token to request the following page
+ */
+struct search_page_t {
+  std::vector<user_info_t> users;
+  // empty if there are no more results
+  std::string next_cursor;
+};
+
 /**
  * Class of phone book you have to implement
  */
 class phone_book_t {
 public:
+  class call_range_t;
+
   /**
    * Create empty phone book
    */
-  phone_book_t() = default;
+  phone_book_t() : phone_book_t(std::pmr::get_default_resource()) {}
 
   /**
-   * Copy constructor
+   * Create empty phone book with all internal structures allocated from resource.
+   * Copies of the book allocate from it too, so it must outlive them all and be safe for the threads modifying them
+   * @param resource -- memory resource for internal structures
+   */
+  explicit phone_book_t(std::pmr::memory_resource *resource);
+
+  /**
+   * Create empty phone book in arena mode: internal structures are bump-allocated from an arena owned by the book
+   * and shared with its copies. clear() rewinds the arena in O(1) if no copy shares it, and the next fill
+   * reuses its memory. Copies must be modified from one thread at a time
+   */
+  static phone_book_t with_arena();
+
+  /**
+   * Copy constructor. Takes O(1): internal structures are shared and a modification of either book
+   * clones only the parts it touches
    */
   phone_book_t(const phone_book_t &other) = default;
 
   /**
-   * Copy assignment
+   * Copy assignment. Takes O(1) as copy constructor does
    */
-  phone_book_t &operator=(const phone_book_t &other) = default;
+  phone_book_t &operator=(const phone_book_t &other);
 
   /**
    * Destructor
@@ -90,6 +156,39 @@ public:
    */
   bool add_call(const call_t &call);
 
+  /**
+   * Creates users in their order by the rules of create_user, but updates indexes once per batch
+   * @param new_users -- users to create
+   * @return for every user: was it actually created
+   */
+  std::vector<bool> create_users(const std::vector<user_t> &new_users);
+
+  /**
+   * Adds call-history records in their order by the rules of add_call,
+   * but repositions every touched user in indexes once per batch
+   * @param new_calls -- call-history records to addition
+   * @return for every call-record: was it actually added
+   */
+  std::vector<bool> add_calls(const std::vector<call_t> &new_calls);
+
+  /**
+   * Removes user with specified number from indexes in O(log n). Calls of the user stay in the history:
+   * get_calls returns them with its number, while get_calls_for_user and searches no longer see the user.
+   * A user created later with the same number starts with no calls
+   * @param number -- number of the user
+   * @return was user actually removed
+   */
+  bool remove_user(const std::string &number);
+
+  /**
+   * Changes name of user with specified number and repositions it in indexes in O(log n).
+   * Calls of the user and its total call duration are kept
+   * @param number -- number of the user
+   * @param new_name -- new name of the user
+   * @return was user with specified number found
+   */
+  bool rename_user(const std::string &number, const std::string &new_name);
+
   /**
    * All calls are sorted in ORDER of their addition.
    * Return at most count call-record starts from start_pos (zero-indexed) in ORDER
@@ -99,6 +198,31 @@ public:
    */
   std::vector<call_t> get_calls(size_t start_pos, size_t count) const;
 
+  /**
+   * Same call-records as get_calls, but without copying: returns a lightweight range over the stored history.
+   * The range and the call_view_t it yields are valid until the next mutation of the phone book
+   * @param start_pos -- zero-indexed start position of call-records sorted in ORDER
+   * @param count -- number of call-records to view
+   * @return view of calls[start_pos ... start_pos + count - 1]
+   */
+  call_range_t view_calls(size_t start_pos, size_t count) const;
+
+  /**
+   * Calls of one user are sorted in ORDER of their addition.
+   * Return at most count call-records of the user with specified number starting from start_pos (zero-indexed).
+   * Takes O(count) for any start_pos
+   * @param number -- number of the user
+   * @param start_pos -- zero-indexed start position among calls of the user
+   * @param count -- number of call-records to return
+   * @return user_calls[start_pos ... start_pos + count - 1], empty if there is no such user
+   */
+  std::vector<call_t> get_calls_for_user(const std::string &number, size_t start_pos, size_t count) const;
+
+  /**
+   * @return number of call-records of the user with specified number, 0 if there is no such user
+   */
+  size_t count_calls_for_user(const std::string &number) const;
+
   /**
    * Find at most count users with number starts with number_prefix sorted by:
    *    total call duration
@@ -110,6 +234,18 @@ public:
    */
   std::vector<user_info_t> search_users_by_number(const std::string &number_prefix, size_t count) const;
 
+  /**
+   * Same as search_users_by_number for every prefix, resolved in one pass over the number index:
+   * common parts of prefixes are walked once and prefixes ending in one index node share its ranking.
+   * Every distinct node still has its first count users read and built into results, which is most of the cost,
+   * so a request is cheaper than separate calls by the walks and the page cursors saved, not several times
+   * @param number_prefixes prefixes for users' number to search, in any order and possibly repeated
+   * @param count desired number of users to find for every prefix
+   * @return vector of search result for every prefix in the order of number_prefixes
+   */
+  std::vector<std::vector<user_info_t>> search_users_by_number_multi(const std::vector<std::string> &number_prefixes,
+                                                                     size_t count) const;
+
   /**
    * Find at most count users with name starts with name_prefix sorted by:
    *    name
@@ -122,7 +258,60 @@ public:
   std::vector<user_info_t> search_users_by_name(const std::string &name_prefix, size_t count) const;
 
   /**
-   * Make your phone book empty
+   * Find at most count users with name containing fragment, sorted by search_users_by_name rules.
+   * Candidates come from n-gram posting lists, so the cost does not depend on the length of names.
+   * A book opened with open_mapped indexes its names on the first such search, copies of it share that index
+   * @param fragment substring of users' name to search
+   * @param count desired number of users to find
+   * @return vector of search result, sorted by search_users_by_name rules
+   */
+  std::vector<user_info_t> search_users_by_name_substring(const std::string &fragment, size_t count) const;
+
+  /**
+   * Find at most count users with name starting within max_distance byte insertions, deletions and replacements
+   * of name_prefix, sorted by that distance and then by search_users_by_name rules.
+   * The name index is walked as a trie under a Levenshtein automaton, so the cost grows with the length
+   * of name_prefix and max_distance rather than with the count of users
+   * @param name_prefix prefix of users' name to search, possibly mistyped
+   * @param max_distance largest distance to the prefix of a name that still matches
+   * @param count desired number of users to find
+   * @return vector of search result, sorted by distance and then by search_users_by_name rules
+   */
+  std::vector<user_info_t> search_users_by_name_fuzzy(const std::string &name_prefix, size_t max_distance,
+                                                      size_t count) const;
+
+  /**
+   * Page of search_users_by_number results: at most count users following cursor.
+   * Takes O(log n + count) for any page
+   * @param number_prefix prefix for users' number to search
+   * @param count desired number of users on the page
+   * @param cursor empty for the first page or next_cursor of the previous page
+   * @return page of search result sorted by search_users_by_number rules
+   * @throws std::invalid_argument if cursor was not returned by a search by number
+   */
+  search_page_t search_users_by_number_page(const std::string &number_prefix, size_t count,
+                                            const std::string &cursor = {}) const;
+
+  /**
+   * Page of search_users_by_name results: at most count users following cursor.
+   * Takes O(log n + count) for any page
+   * @param name_prefix prefix for users' name to search
+   * @param count desired number of users on the page
+   * @param cursor empty for the first page or next_cursor of the previous page
+   * @return page of search result sorted by search_users_by_name rules
+   * @throws std::invalid_argument if cursor was not returned by a search by name
+   */
+  search_page_t search_users_by_name_page(const std::string &name_prefix, size_t count,
+                                          const std::string &cursor = {}) const;
+
+  /**
+   * Index names added since the last search by substring, which that search would do otherwise.
+   * Copies made afterwards share the index instead of each building it on its first such search
+   */
+  void update_name_grams() const;
+
+  /**
+   * Make your phone book empty. Takes O(1) in arena mode if no copy shares the arena
    */
   void clear();
 
@@ -136,5 +325,193 @@ public:
    */
   bool empty() const;
 
+  /**
+   * @return count of calls in the history of your phone book
+   */
+  size_t calls_count() const;
+
+  /**
+   * Write the book to path in the snapshot format that open_mapped can query in place.
+   * The file at path is replaced atomically, books mapping the previous one keep reading it
+   * @throws std::runtime_error if the file cannot be written
+   */
+  void save(const std::string &path) const;
+
+  /**
+   * Open a snapshot written by save without loading it: queries read the mapped file directly,
+   * and the book is copied into memory on its first modification. Opening takes O(1) and checks only
+   * the header and section bounds, so a file corrupted inside its sections can make queries misbehave
+   * @param verify -- read the whole file first to check its checksum and every index stored in it
+   * @throws std::runtime_error if the file cannot be mapped, is not a snapshot of a supported version
+   * or is found corrupted
+   */
+  static phone_book_t open_mapped(const std::string &path, bool verify = false);
+
+  /**
+   * Cache results of search_users_by_number and search_users_by_name for short prefixes and small counts.
+   * A modification drops only the cached results it changes. Copies of the book start with an empty cache
+   * and report to the same counters
+   * @param options -- which queries are cached, capacity 0 disables the cache
+   */
+  void enable_query_cache(const query_cache_options_t &options = {});
+
+  /**
+   * @return hit, miss and eviction counters of the query cache of this book and its copies,
+   * zeros if the cache was never enabled
+   */
+  query_cache_stats_t query_cache_stats() const;
+
+  /**
+   * Counters, latencies, result sizes and prefix lengths of operations of this book and its copies.
+   * Collected only if the book is built with PHONE_BOOK_STATS defined, otherwise enabled is false
+   * and the operations are not instrumented at all
+   * @return snapshot of statistics, safe to take while other threads query the book
+   */
+  phone_book_stats_t stats() const;
+
+  /**
+   * Record every call of the methods above that modify or query the book, with its arguments and result size,
+   * to a binary trace at path that read_trace and the replay tool read back. Copies made later record to the same
+   * trace. Calls that throw are not recorded, neither are size, empty, calls_count, persistence, cache
+   * and statistics calls. Must not run concurrently with calls of the book
+   * @throws std::runtime_error if the file cannot be created
+   */
+  void start_trace(const std::string &path);
+
+  /**
+   * Flush and close the trace, this book and copies sharing the trace stop recording
+   */
+  void stop_trace();
+
 private:
+  /**
+   * Stored contact: number is kept inline, name is interned in the name pool,
+   * total duration is maintained by add_call. Ids are never reused: a removed user stays as a tombstone
+   * for its calls in the log
+   */
+  struct user_record_t {
+    number_key_t number;
+    uint32_t name_id{0};
+    double total_call_duration_s{0};
+    bool removed{false};
+  };
+
+  call_view_t view_call(size_t pos) const;
+
+  call_range_t calls_range(size_t start_pos, size_t count) const;
+
+  /**
+   * Pages of search_users_by_number_page and search_users_by_name_page without tracing and statistics,
+   * which also serve the plain searches
+   */
+  search_page_t number_page(const std::string &number_prefix, size_t count, const std::string &cursor) const;
+
+  search_page_t name_page(const std::string &name_prefix, size_t count, const std::string &cursor) const;
+
+  /**
+   * @return position the next call will take in the log, positions are indexed by 32 bits
+   * @throws std::length_error if the log is full
+   */
+  uint32_t next_call_position() const;
+
+  /**
+   * Copy the mapped snapshot into memory structures before the first modification
+   */
+  void materialize();
+
+  // owner of resource in arena mode, declared first to outlive the parts allocated from it
+  std::shared_ptr<arena_resource_t> arena;
+  std::pmr::memory_resource *resource;
+  // all parts are persistent: copies share them and a modification clones only what it touches
+  name_pool_t names;
+  persistent_vector_t<user_record_t> users;
+  // ids of users not removed
+  sharded_map_t<number_key_t, uint32_t, number_key_hash_t> users_by_number;
+  number_trie_t number_trie;
+  name_index_t name_index;
+  name_gram_index_t name_grams;
+  cow_ptr_t<call_log_t> calls;
+  // positions of calls in the log by user id
+  persistent_vector_t<append_list_t> user_calls;
+  // snapshot answering queries instead of the parts above until the first modification
+  std::shared_ptr<const mapped_snapshot_t> mapped;
+  // grams of the mapped names by their positions in name order, shared by all copies of the opened book
+  std::shared_ptr<const name_gram_index_t> mapped_grams;
+  query_cache_t query_cache;
+  stats_recorder_t stats_recorder;
+  trace_recorder_t trace;
+};
+
+/**
+ * Range of call-history records returned by phone_book_t::view_calls
+ */
+class phone_book_t::call_range_t {
+public:
+  class iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = call_view_t;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = call_view_t;
+
+    iterator() = default;
+
+    call_view_t operator*() const {
+      return book->view_call(pos);
+    }
+
+    iterator &operator++() {
+      ++pos;
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator old = *this;
+      ++pos;
+      return old;
+    }
+
+    friend bool operator==(const iterator &a, const iterator &b) {
+      return a.pos == b.pos;
+    }
+    friend bool operator!=(const iterator &a, const iterator &b) {
+      return a.pos != b.pos;
+    }
+
+  private:
+    friend class call_range_t;
+
+    iterator(const phone_book_t *book, size_t pos) : book(book), pos(pos) {}
+
+    const phone_book_t *book{nullptr};
+    size_t pos{0};
+  };
+
+  iterator begin() const {
+    return {book, begin_pos};
+  }
+  iterator end() const {
+    return {book, end_pos};
+  }
+
+  call_view_t operator[](size_t i) const {
+    return book->view_call(begin_pos + i);
+  }
+
+  size_t size() const {
+    return end_pos - begin_pos;
+  }
+  bool empty() const {
+    return begin_pos == end_pos;
+  }
+
+private:
+  friend class phone_book_t;
+
+  call_range_t(const phone_book_t *book, size_t begin_pos, size_t end_pos)
+      : book(book), begin_pos(begin_pos), end_pos(end_pos) {}
+
+  const phone_book_t *book;
+  size_t begin_pos;
+  size_t end_pos;
 };
@@ -0,0 +1,135 @@
+#include "query-cache.h"
+#include "phone-book.h"
+
+#include <algorithm>
+#include <tuple>
+#include <utility>
+
+query_cache_t::query_cache_t() : options{0} {}
+
+query_cache_t::query_cache_t(const query_cache_options_t &options)
+    : options(options), counters(std::make_shared<counters_t>()) {}
+
+query_cache_t::query_cache_t(const query_cache_t &other) : options(other.options), counters(other.counters) {}
+
+query_cache_t &query_cache_t::operator=(const query_cache_t &other) {
+  if (this != &other) {
+    std::lock_guard lock(mutex);
+    options = other.options;
+    counters = other.counters;
+    entries.clear();
+    recent.clear();
+  }
+  return *this;
+}
+
+query_cache_t::~query_cache_t() = default;
+
+std::optional<std::vector<user_info_t>> query_cache_t::find(kind_t kind, std::string_view prefix,
+                                                            size_t count) const {
+  if (!cached(prefix, count)) {
+    return std::nullopt;
+  }
+  std::lock_guard lock(mutex);
+  auto it = entries.find(key_of(kind, prefix));
+  if (it == entries.end() || !it->second->serves(count)) {
+    counters->misses.fetch_add(1, std::memory_order_relaxed);
+    return std::nullopt;
+  }
+  counters->hits.fetch_add(1, std::memory_order_relaxed);
+  recent.splice(recent.begin(), recent, it->second);
+  const std::vector<user_info_t> &users = it->second->users;
+  return std::vector<user_info_t>(users.begin(), users.begin() + std::min(count, users.size()));
+}
+
+void query_cache_t::insert(kind_t kind, std::string_view prefix, size_t count,
+                           const std::vector<user_info_t> &users) const {
+  if (!cached(prefix, count)) {
+    return;
+  }
+  std::lock_guard lock(mutex);
+  std::string key = key_of(kind, prefix);
+  if (auto it = entries.find(key); it != entries.end()) {
+    // a concurrent query may have cached as many results already
+    if (it->second->count >= count) {
+      return;
+    }
+    recent.erase(it->second);
+    entries.erase(it);
+  }
+  recent.push_front({key, count, users});
+  entries.emplace(std::move(key), recent.begin());
+  while (entries.size() > options.capacity) {
+    entries.erase(recent.back().key);
+    recent.pop_back();
+    counters->evictions.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void query_cache_t::update(const user_view_t *old_user, const user_view_t *new_user) {
+  std::lock_guard lock(mutex);
+  if (entries.empty()) {
+    return;
+  }
+  for (const user_view_t *user : {old_user, new_user}) {
+    if (user != nullptr) {
+      invalidate(kind_t::by_number, user->number, old_user, new_user);
+      invalidate(kind_t::by_name, user->name, old_user, new_user);
+    }
+  }
+}
+
+void query_cache_t::clear() {
+  std::lock_guard lock(mutex);
+  entries.clear();
+  recent.clear();
+}
+
+query_cache_stats_t query_cache_t::stats() const {
+  std::lock_guard lock(mutex);
+  if (!counters) {
+    return {};
+  }
+  return {counters->hits.load(std::memory_order_relaxed), counters->misses.load(std::memory_order_relaxed),
+          counters->invalidations.load(std::memory_order_relaxed), counters->evictions.load(std::memory_order_relaxed),
+          entries.size()};
+}
+
+std::string query_cache_t::key_of(kind_t kind, std::string_view prefix) {
+  std::string key(1, static_cast<char>(kind));
+  key.append(prefix);
+  return key;
+}
+
+void query_cache_t::invalidate(kind_t kind, std::string_view value, const user_view_t *old_user,
+                               const user_view_t *new_user) {
+  for (size_t size = 0; size <= std::min(value.size(), options.max_prefix_size); ++size) {
+    auto it = entries.find(key_of(kind, value.substr(0, size)));
+    if (it == entries.end() || !affected(kind, *it->second, old_user, new_user)) {
+      continue;
+    }
+    recent.erase(it->second);
+    entries.erase(it);
+    counters->invalidations.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+bool query_cache_t::affected(kind_t kind, const entry_t &entry, const user_view_t *old_user,
+                             const user_view_t *new_user) {
+  // a complete entry has all matching users, otherwise it has the first count users,
+  // which change only if the user was among them or enters them
+  if (entry.complete()) {
+    return true;
+  }
+  const user_info_t &last = entry.users.back();
+  user_view_t last_user{last.user.number, last.user.name, last.total_call_duration_s};
+  return (old_user != nullptr && !less(kind, last_user, *old_user)) ||
+         (new_user != nullptr && less(kind, *new_user, last_user));
+}
+
+bool query_cache_t::less(kind_t kind, const user_view_t &a, const user_view_t &b) {
+  if (kind == kind_t::by_number) {
+    return std::tie(b.total_call_duration_s, a.name, a.number) < std::tie(a.total_call_duration_s, b.name, b.number);
+  }
+  return std::tie(a.name, b.total_call_duration_s, a.number) < std::tie(b.name, a.total_call_duration_s, b.number);
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct user_info_t;
+
+/**
+ * Which search results are cached: queries with longer prefixes or larger count go to the indexes directly
+ */
+struct query_cache_options_t {
+  // count of cached queries, the least recently used one is evicted first; 0 disables the cache
+  size_t capacity{1024};
+  size_t max_prefix_size{2};
+  size_t max_count{100};
+};
+
+/**
+ * Counters of a query cache shared by copies of the book
+ */
+struct query_cache_stats_t {
+  uint64_t hits{0};
+  uint64_t misses{0};
+  // entries dropped because a modification changed their results
+  uint64_t invalidations{0};
+  // entries dropped to stay within capacity
+  uint64_t evictions{0};
+  // entries cached now
+  size_t entries{0};
+};
+
+/**
+ * Bounded cache of top-count results of search_users_by_number and search_users_by_name by prefix.
+ * An entry of count results also serves any smaller count, and all results if there were fewer matches.
+ * Modifications pass the old and new state of the touched user: only entries of prefixes of its number
+ * or name are looked at, and only those the user was in or now ranks into are dropped.
+ * Lookups are safe for concurrent queries on one book, modifications are made by its only writer
+ */
+class query_cache_t {
+public:
+  enum class kind_t : char { by_number, by_name };
+
+  /**
+   * State of a user seen by modifications, views are valid during the call only
+   */
+  struct user_view_t {
+    std::string_view number;
+    std::string_view name;
+    double total_call_duration_s{0};
+  };
+
+  /**
+   * Disabled cache
+   */
+  query_cache_t();
+
+  explicit query_cache_t(const query_cache_options_t &options);
+
+  /**
+   * A copy starts empty: entries of a book stay valid only until its own next modification
+   */
+  query_cache_t(const query_cache_t &other);
+
+  query_cache_t &operator=(const query_cache_t &other);
+
+  ~query_cache_t();
+
+  bool enabled() const {
+    return options.capacity != 0;
+  }
+
+  /**
+   * @return first count results of the query if they are cached, nullopt on a miss or if the query is not cached
+   */
+  std::optional<std::vector<user_info_t>> find(kind_t kind, std::string_view prefix, size_t count) const;
+
+  /**
+   * Cache results of the query found by the indexes after a miss
+   */
+  void insert(kind_t kind, std::string_view prefix, size_t count, const std::vector<user_info_t> &users) const;
+
+  /**
+   * Drop entries whose results change when a user changes from old to new state,
+   * old is nullptr for a created user and new is nullptr for a removed one
+   */
+  void update(const user_view_t *old_user, const user_view_t *new_user);
+
+  void clear();
+
+  query_cache_stats_t stats() const;
+
+private:
+  struct entry_t {
+    std::string key;
+    // count of the query the results were found for
+    size_t count;
+    std::vector<user_info_t> users;
+
+    /**
+     * @return are there fewer users matching the prefix than count
+     */
+    bool complete() const {
+      return users.size() < count;
+    }
+
+    bool serves(size_t requested) const {
+      return requested <= users.size() || complete();
+    }
+  };
+
+  struct counters_t {
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> invalidations{0};
+    std::atomic<uint64_t> evictions{0};
+  };
+
+  using recent_t = std::list<entry_t>;
+
+  bool cached(std::string_view prefix, size_t count) const {
+    return enabled() && prefix.size() <= options.max_prefix_size && count != 0 && count <= options.max_count;
+  }
+
+  static std::string key_of(kind_t kind, std::string_view prefix);
+
+  /**
+   * Drop entries of prefixes of value in kind that old or new user is ranked within
+   */
+  void invalidate(kind_t kind, std::string_view value, const user_view_t *old_user, const user_view_t *new_user);
+
+  static bool affected(kind_t kind, const entry_t &entry, const user_view_t *old_user, const user_view_t *new_user);
+
+  /**
+   * Order of search results of kind
+   */
+  static bool less(kind_t kind, const user_view_t &a, const user_view_t &b);
+
+  query_cache_options_t options;
+  mutable std::mutex mutex;
+  // most recently used first
+  mutable recent_t recent;
+  mutable std::unordered_map<std::string, recent_t::iterator> entries;
+  // shared by copies, nullptr while disabled
+  std::shared_ptr<counters_t> counters;
+};
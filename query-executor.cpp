@@ -0,0 +1,282 @@
+#include "query-executor.h"
+
+#include <algorithm>
+#include <exception>
+#include <numeric>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+namespace {
+
+// tasks per worker thread a batch is split into, so idle workers have something to steal
+constexpr size_t tasks_per_thread = 4;
+
+bool starts_with(std::string_view value, std::string_view prefix) {
+  return value.substr(0, prefix.size()) == prefix;
+}
+
+/**
+ * Queries answered by one run: same kind and prefix, or same start position of get_calls
+ */
+auto key_of(const query_t &query) {
+  size_t start_pos = query.kind == query_t::kind_t::get_calls ? query.start_pos : 0;
+  return std::make_tuple(query.kind, std::string_view(query.prefix), start_pos);
+}
+
+/**
+ * @return is query a search of kind by a prefix starting with prefix
+ */
+bool extends(const query_t &query, query_t::kind_t kind, std::string_view prefix) {
+  return query.kind == kind && starts_with(query.prefix, prefix);
+}
+
+std::string_view searched_field(query_t::kind_t kind, const user_info_t &info) {
+  return kind == query_t::kind_t::search_by_number ? info.user.number : info.user.name;
+}
+
+/**
+ * Results of an earlier search of a task
+ */
+struct answered_t {
+  query_t::kind_t kind;
+  std::string_view prefix;
+  size_t count;
+  std::vector<user_info_t> users;
+
+  /**
+   * @return do users hold the first count results of query
+   */
+  bool covers(const query_t &query) const {
+    if (!extends(query, kind, prefix)) {
+      return false;
+    }
+    if (users.size() < count) {
+      // all users matching this prefix are here
+      return true;
+    }
+    // users matching query are contiguous in order by name, and the last user is past all of them
+    return kind == query_t::kind_t::search_by_name && !users.empty() && users.back().user.name > query.prefix &&
+           !starts_with(users.back().user.name, query.prefix);
+  }
+
+  /**
+   * @return first count users matching query, if they are covered
+   */
+  std::vector<user_info_t> filter(const query_t &query, size_t query_count) const {
+    std::vector<user_info_t> result;
+    for (const user_info_t &info : users) {
+      if (result.size() == query_count) {
+        break;
+      }
+      if (starts_with(searched_field(kind, info), query.prefix)) {
+        result.push_back(info);
+      }
+    }
+    return result;
+  }
+};
+
+// buckets of a kind of query: by first byte of a search prefix, the empty prefix in its own bucket
+constexpr size_t buckets_per_kind = 257;
+constexpr size_t buckets_count = 3 * buckets_per_kind;
+
+/**
+ * Queries answered by one run or filtered from each other are in one bucket
+ */
+size_t bucket_of(const query_t &query) {
+  size_t bucket = query.kind == query_t::kind_t::get_calls ? query.start_pos % buckets_per_kind
+                  : query.prefix.empty()                  ? 0
+                                                           : 1 + static_cast<unsigned char>(query.prefix[0]);
+  return static_cast<size_t>(query.kind) * buckets_per_kind + bucket;
+}
+
+template <typename T>
+std::vector<T> first(const std::vector<T> &values, size_t count) {
+  return {values.begin(), values.begin() + static_cast<ptrdiff_t>(std::min(count, values.size()))};
+}
+
+} // namespace
+
+struct query_executor_t::batch_t {
+  phone_book_t book;
+  std::vector<query_t> queries;
+  // indexes of queries sorted by key, larger counts first
+  std::vector<size_t> order;
+  std::vector<std::promise<query_result_t>> promises;
+};
+
+query_executor_t::query_executor_t(size_t threads_count) {
+  threads_count = std::max<size_t>(threads_count, 1);
+  for (size_t i = 0; i < threads_count; ++i) {
+    queues.push_back(std::make_unique<queue_t>());
+  }
+  for (size_t i = 0; i < threads_count; ++i) {
+    threads.emplace_back([this, i] { work(i); });
+  }
+}
+
+query_executor_t::~query_executor_t() {
+  {
+    std::lock_guard lock(mutex);
+    stopped = true;
+  }
+  ready.notify_all();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+size_t query_executor_t::threads_count() const {
+  return threads.size();
+}
+
+std::vector<std::future<query_result_t>> query_executor_t::submit(const phone_book_t &book,
+                                                                  std::vector<query_t> queries) {
+  auto batch = std::make_shared<batch_t>(batch_t{book, std::move(queries), {}, {}});
+  batch->promises.resize(batch->queries.size());
+  std::vector<std::future<query_result_t>> results;
+  results.reserve(batch->queries.size());
+  for (std::promise<query_result_t> &promise : batch->promises) {
+    results.push_back(promise.get_future());
+  }
+  if (batch->queries.empty()) {
+    return results;
+  }
+
+  // counting sort by bucket: queries sharing work are in one bucket, and buckets are sorted by workers
+  std::vector<size_t> offsets(buckets_count + 1);
+  for (const query_t &query : batch->queries) {
+    ++offsets[bucket_of(query) + 1];
+  }
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+  batch->order.resize(batch->queries.size());
+  std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+  for (size_t i = 0; i < batch->queries.size(); ++i) {
+    batch->order[next[bucket_of(batch->queries[i])]++] = i;
+  }
+
+  // tasks of whole buckets of about equal size
+  size_t tasks_count = threads.size() * tasks_per_thread;
+  size_t task_size = (batch->queries.size() + tasks_count - 1) / tasks_count;
+  std::vector<std::function<void()>> tasks;
+  for (size_t bucket = 0, begin = 0; bucket < buckets_count; ++bucket) {
+    size_t end = offsets[bucket + 1];
+    if (end - begin >= task_size || (bucket + 1 == buckets_count && end != begin)) {
+      tasks.emplace_back([task = task_t{batch, begin, end}] { run(task); });
+      begin = end;
+    }
+  }
+  push(std::move(tasks));
+  return results;
+}
+
+void query_executor_t::run(const task_t &task) {
+  batch_t &batch = *task.batch;
+  // queries sharing a key are neighbours, larger counts first, and extended prefixes follow their prefixes
+  std::sort(batch.order.begin() + task.begin, batch.order.begin() + task.end, [&](size_t a, size_t b) {
+    return std::tuple_cat(key_of(batch.queries[a]), std::tie(batch.queries[b].count)) <
+           std::tuple_cat(key_of(batch.queries[b]), std::tie(batch.queries[a].count));
+  });
+  // searches of the task whose prefixes are prefixes of the current one, shortest first
+  std::vector<answered_t> answered;
+  for (size_t begin = task.begin; begin < task.end;) {
+    const query_t &query = batch.queries[batch.order[begin]];
+    size_t end = begin + 1;
+    while (end < task.end && key_of(batch.queries[batch.order[end]]) == key_of(query)) {
+      ++end;
+    }
+    // the first query of a run has the largest count
+    size_t count = query.count;
+    try {
+      query_result_t result;
+      if (query.kind == query_t::kind_t::get_calls) {
+        result.calls = batch.book.get_calls(query.start_pos, count);
+      } else {
+        // in sorted order a prefix that is not extended by this one is not extended by later ones either
+        while (!answered.empty() && !extends(query, answered.back().kind, answered.back().prefix)) {
+          answered.pop_back();
+        }
+        auto covering = std::find_if(answered.rbegin(), answered.rend(), [&](const answered_t &earlier) {
+          return earlier.covers(query);
+        });
+        if (covering != answered.rend()) {
+          result.users = covering->filter(query, count);
+        } else if (query.kind == query_t::kind_t::search_by_number) {
+          result.users = batch.book.search_users_by_number(query.prefix, count);
+        } else {
+          result.users = batch.book.search_users_by_name(query.prefix, count);
+        }
+        // keep the results only if the next run can be filtered from them
+        if (end < task.end && extends(batch.queries[batch.order[end]], query.kind, query.prefix)) {
+          answered.push_back({query.kind, query.prefix, count, result.users});
+        }
+      }
+      for (size_t i = begin + 1; i < end; ++i) {
+        size_t index = batch.order[i];
+        size_t query_count = batch.queries[index].count;
+        batch.promises[index].set_value({first(result.calls, query_count), first(result.users, query_count)});
+      }
+      batch.promises[batch.order[begin]].set_value(std::move(result));
+    } catch (...) {
+      for (size_t i = begin; i < end; ++i) {
+        batch.promises[batch.order[i]].set_exception(std::current_exception());
+      }
+    }
+    begin = end;
+  }
+}
+
+void query_executor_t::push(std::vector<std::function<void()>> tasks) {
+  for (std::function<void()> &task : tasks) {
+    queue_t &queue = *queues[next_queue];
+    next_queue = (next_queue + 1) % queues.size();
+    std::lock_guard lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard lock(mutex);
+    pending += tasks.size();
+  }
+  ready.notify_all();
+}
+
+bool query_executor_t::pop(size_t worker, std::function<void()> &task) {
+  {
+    queue_t &own = *queues[worker];
+    std::lock_guard lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < queues.size(); ++i) {
+    queue_t &victim = *queues[(worker + i) % queues.size()];
+    std::lock_guard lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void query_executor_t::work(size_t worker) {
+  for (;;) {
+    {
+      std::unique_lock lock(mutex);
+      ready.wait(lock, [this] { return stopped || pending != 0; });
+      if (pending == 0) {
+        return;
+      }
+      // a task is reserved for this worker, it is in one of the queues until popped
+      --pending;
+    }
+    std::function<void()> task;
+    while (!pop(worker, task)) {
+    }
+    task();
+  }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "phone-book.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * One query of a batch: get_calls(start_pos, count), search_users_by_number(prefix, count)
+ * or search_users_by_name(prefix, count)
+ */
+struct query_t {
+  enum class kind_t : char { get_calls, search_by_number, search_by_name };
+
+  kind_t kind{kind_t::get_calls};
+  // number or name prefix of a search
+  std::string prefix;
+  // start position of get_calls
+  size_t start_pos{0};
+  size_t count{0};
+};
+
+/**
+ * Result of a query: calls of get_calls, users of a search
+ */
+struct query_result_t {
+  std::vector<call_t> calls;
+  std::vector<user_info_t> users;
+};
+
+/**
+ * Runs batches of queries on a work-stealing thread pool.
+ * A batch sees the book as it was when submitted: queries run on an O(1) copy of it,
+ * so the caller may modify the book right away. Queries of a batch are split into tasks by kind and
+ * first byte of the prefix, and every task is sorted by kind and prefix, so that its queries share work:
+ * equal queries are answered once for their largest count, and a search whose prefix extends
+ * the prefix of an earlier search in the task is filtered from its results when they hold all its matches.
+ * Batches are submitted from one thread at a time, as for phone_book_t
+ */
+class query_executor_t {
+public:
+  /**
+   * @param threads_count -- count of worker threads, at least one
+   */
+  explicit query_executor_t(size_t threads_count = std::thread::hardware_concurrency());
+
+  query_executor_t(const query_executor_t &) = delete;
+  query_executor_t &operator=(const query_executor_t &) = delete;
+
+  /**
+   * Waits for queries submitted before
+   */
+  ~query_executor_t();
+
+  /**
+   * Run queries against the current state of book
+   * @return futures of results in the order of queries, an exception of a query is stored in its future
+   */
+  std::vector<std::future<query_result_t>> submit(const phone_book_t &book, std::vector<query_t> queries);
+
+  size_t threads_count() const;
+
+private:
+  /**
+   * Queue of a worker: the worker pops its own tasks from the back, idle workers steal from the front
+   */
+  struct queue_t {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  struct batch_t;
+
+  /**
+   * Range of batch order holding the queries of one task, sorted by the worker running it
+   */
+  struct task_t {
+    std::shared_ptr<batch_t> batch;
+    size_t begin;
+    size_t end;
+  };
+
+  static void run(const task_t &task);
+
+  void push(std::vector<std::function<void()>> tasks);
+
+  bool pop(size_t worker, std::function<void()> &task);
+
+  void work(size_t worker);
+
+  std::vector<std::unique_ptr<queue_t>> queues;
+  std::mutex mutex;
+  std::condition_variable ready;
+  // tasks pushed and not yet popped, changed under mutex
+  size_t pending{0};
+  bool stopped{false};
+  // queue the next pushed task goes to
+  size_t next_queue{0};
+  std::vector<std::thread> threads;
+};
@@ -0,0 +1,51 @@
+#include "trace-replay.h"
+
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+
+/**
+ * Replays a trace written by phone_book_t::start_trace into an empty phone book and prints throughput
+ * and latency percentiles by operation. Usage: replay <trace> [--timed]
+ */
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3 || (argc == 3 && std::strcmp(argv[2], "--timed") != 0)) {
+    std::cerr << "usage: " << argv[0] << " <trace> [--timed]\n"
+              << "  --timed  keep the recorded intervals between calls instead of replaying at full speed\n";
+    return 2;
+  }
+  replay_options_t options;
+  options.timed = argc == 3;
+  try {
+    std::vector<trace_record_t> records = read_trace(argv[1]);
+    phone_book_t book;
+    replay_report_t report = replay_trace(records, book, options);
+
+    double elapsed_s = std::chrono::duration<double>(report.elapsed).count();
+    std::cout << report.calls() << " calls in " << std::fixed << std::setprecision(3) << elapsed_s << " s, "
+              << std::setprecision(0) << static_cast<double>(report.calls()) / elapsed_s << " calls/s, "
+              << report.mismatches() << " mismatches\n\n";
+    std::cout << std::left << std::setw(32) << "operation" << std::right << std::setw(10) << "calls"
+              << std::setw(12) << "calls/s" << std::setw(12) << "p50 ns" << std::setw(12) << "p99 ns"
+              << std::setw(12) << "p99.9 ns" << std::setw(12) << "max ns" << std::setw(12) << "mismatches" << '\n';
+    for (size_t i = 0; i < trace_operations_count; ++i) {
+      const replay_operation_stats_t &operation = report.operations[i];
+      if (operation.calls == 0) {
+        continue;
+      }
+      // throughput of the operation alone: its calls over the time spent in them
+      double busy_s = static_cast<double>(operation.latency_ns.sum) / 1e9;
+      std::cout << std::left << std::setw(32) << trace_operation_name(static_cast<trace_operation_t>(i))
+                << std::right << std::setw(10) << operation.calls << std::setw(12)
+                << (busy_s == 0 ? 0 : static_cast<double>(operation.calls) / busy_s) << std::setw(12)
+                << operation.latency_ns.percentile(0.5) << std::setw(12) << operation.latency_ns.percentile(0.99)
+                << std::setw(12) << operation.latency_ns.percentile(0.999) << std::setw(12)
+                << operation.latency_ns.max << std::setw(12) << operation.mismatches << '\n';
+    }
+    return report.mismatches() == 0 ? 0 : 1;
+  } catch (const std::exception &e) {
+    std::cerr << argv[0] << ": " << e.what() << '\n';
+    return 1;
+  }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "number-key.h"
+
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/**
+ * Sort key of the last user of a search page: the next page starts right after it.
+ * Encoded into an opaque printable token bound to the kind of search it came from
+ */
+struct search_cursor_t {
+  enum class kind_t : char { by_number = 'N', by_name = 'A' };
+
+  kind_t kind{kind_t::by_number};
+  double total_call_duration_s{0};
+  std::string name;
+  std::string number;
+
+  std::string encode() const {
+    std::string bytes(1, static_cast<char>(kind));
+    uint64_t duration_bits = 0;
+    std::memcpy(&duration_bits, &total_call_duration_s, sizeof(duration_bits));
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      bytes += static_cast<char>(duration_bits >> shift);
+    }
+    bytes += static_cast<char>(number.size());
+    bytes += number;
+    bytes += name;
+
+    static constexpr char digits[] = "0123456789abcdef";
+    std::string token;
+    token.reserve(bytes.size() * 2);
+    for (unsigned char c : bytes) {
+      token += digits[c >> 4];
+      token += digits[c & 15];
+    }
+    return token;
+  }
+
+  /**
+   * @return cursor of a token made by encode for the same kind of search or nullopt otherwise
+   */
+  static std::optional<search_cursor_t> decode(std::string_view token, kind_t kind) {
+    if (token.size() % 2 != 0) {
+      return std::nullopt;
+    }
+    std::string bytes;
+    bytes.reserve(token.size() / 2);
+    for (size_t i = 0; i < token.size(); i += 2) {
+      int high = hex_value(token[i]);
+      int low = hex_value(token[i + 1]);
+      if (high < 0 || low < 0) {
+        return std::nullopt;
+      }
+      bytes += static_cast<char>(high << 4 | low);
+    }
+    static constexpr size_t fixed_size = 1 + sizeof(uint64_t) + 1;
+    if (bytes.size() < fixed_size || bytes[0] != static_cast<char>(kind)) {
+      return std::nullopt;
+    }
+    search_cursor_t cursor;
+    cursor.kind = kind;
+    uint64_t duration_bits = 0;
+    for (size_t i = 1; i <= sizeof(uint64_t); ++i) {
+      duration_bits = duration_bits << 8 | static_cast<unsigned char>(bytes[i]);
+    }
+    std::memcpy(&cursor.total_call_duration_s, &duration_bits, sizeof(duration_bits));
+    size_t number_size = static_cast<unsigned char>(bytes[fixed_size - 1]);
+    if (number_size > number_key_t::max_length || bytes.size() < fixed_size + number_size) {
+      return std::nullopt;
+    }
+    cursor.number = bytes.substr(fixed_size, number_size);
+    cursor.name = bytes.substr(fixed_size + number_size);
+    return cursor;
+  }
+
+private:
+  static int hex_value(char c) {
+    if ('0' <= c && c <= '9') {
+      return c - '0';
+    }
+    if ('a' <= c && c <= 'f') {
+      return c - 'a' + 10;
+    }
+    return -1;
+  }
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "arena-resource.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <unordered_map>
+
+/**
+ * Hash map split by key hash into 64 groups of 64 copy-on-write shards, allocated on their first key.
+ * Copying takes O(64): the first modification of a group after a copy clones its 64 shard pointers
+ * and the shard it touches, about size / 4096 entries, so rewriting a copy of n keys clones them in O(n) total.
+ * Groups, shards and their nodes are allocated from the memory resource
+ */
+template <typename K, typename V, typename Hash = std::hash<K>>
+class sharded_map_t {
+public:
+  static constexpr size_t groups_count = 64;
+  static constexpr size_t shards_count = groups_count * 64;
+
+  using shard_t = std::pmr::unordered_map<K, V, Hash>;
+
+  explicit sharded_map_t(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+      : resource(resource) {}
+
+  /**
+   * @return pointer to value of key or nullptr if there is no such key
+   */
+  const V *find(const K &key) const {
+    const shard_t *shard = find_shard(shard_of(key));
+    if (shard == nullptr) {
+      return nullptr;
+    }
+    auto it = shard->find(key);
+    return it == shard->end() ? nullptr : &it->second;
+  }
+
+  bool contains(const K &key) const {
+    return find(key) != nullptr;
+  }
+
+  /**
+   * @return was key actually inserted
+   */
+  bool emplace(const K &key, const V &value) {
+    size_t shard = shard_of(key);
+    if (const shard_t *found = find_shard(shard); found != nullptr && found->count(key) != 0) {
+      return false;
+    }
+    write_shard(shard).emplace(key, value);
+    ++count;
+    return true;
+  }
+
+  /**
+   * @return value of key for modification, inserted value-initialized if there is no such key
+   */
+  V &write(const K &key) {
+    auto [it, inserted] = write_shard(shard_of(key)).try_emplace(key);
+    count += inserted;
+    return it->second;
+  }
+
+  /**
+   * @return was key actually erased
+   */
+  bool erase(const K &key) {
+    size_t shard = shard_of(key);
+    if (const shard_t *found = find_shard(shard); found == nullptr || found->count(key) == 0) {
+      return false;
+    }
+    write_shard(shard).erase(key);
+    --count;
+    return true;
+  }
+
+  void reserve(size_t capacity) {
+    size_t per_shard = capacity / shards_count;
+    if (per_shard == 0) {
+      return;
+    }
+    for (size_t shard = 0; shard < shards_count; ++shard) {
+      const shard_t *found = find_shard(shard);
+      if (found == nullptr || found->bucket_count() * found->max_load_factor() < per_shard) {
+        write_shard(shard).reserve(per_shard);
+      }
+    }
+  }
+
+  size_t size() const {
+    return count;
+  }
+
+  bool empty() const {
+    return count == 0;
+  }
+
+  void clear() {
+    for (auto &group : groups) {
+      group.reset();
+    }
+    count = 0;
+  }
+
+private:
+  static constexpr size_t group_size = shards_count / groups_count;
+
+  // null shards are empty
+  using group_t = std::array<std::shared_ptr<shard_t>, group_size>;
+
+  const shard_t *find_shard(size_t shard) const {
+    const std::shared_ptr<group_t> &group = groups[shard / group_size];
+    return group ? (*group)[shard % group_size].get() : nullptr;
+  }
+
+  /**
+   * @return shard for modification, allocated or cloned with its group first if it is missing or shared
+   */
+  shard_t &write_shard(size_t shard) {
+    std::shared_ptr<group_t> &group = groups[shard / group_size];
+    if (!group) {
+      group = allocate_shared_in<group_t>(resource);
+    } else if (group.use_count() > 1) {
+      group = allocate_shared_in<group_t>(resource, *group);
+    }
+    std::shared_ptr<shard_t> &ptr = (*group)[shard % group_size];
+    if (!ptr) {
+      ptr = allocate_shared_in<shard_t>(resource);
+    } else if (ptr.use_count() > 1) {
+      ptr = allocate_shared_in<shard_t>(resource, *ptr);
+    }
+    return *ptr;
+  }
+
+  size_t shard_of(const K &key) const {
+    // top bits of the mixed hash, buckets inside a shard are chosen by the low ones
+    return static_cast<size_t>((static_cast<uint64_t>(Hash{}(key)) * 0x9e3779b97f4a7c15ULL) >> 52);
+  }
+
+  static_assert(shards_count == 4096, "shard_of takes the top 12 bits of hash");
+
+  std::array<std::shared_ptr<group_t>, groups_count> groups;
+  std::pmr::memory_resource *resource;
+  size_t count{0};
+};
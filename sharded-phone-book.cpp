@@ -0,0 +1,373 @@
+#include "sharded-phone-book.h"
+#include "levenshtein-automaton.h"
+
+#include <algorithm>
+#include <queue>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+namespace {
+
+bool less_by_name(const user_info_t &a, const user_info_t &b) {
+  return std::tie(a.user.name, b.total_call_duration_s, a.user.number) <
+         std::tie(b.user.name, a.total_call_duration_s, b.user.number);
+}
+
+bool less_by_number(const user_info_t &a, const user_info_t &b) {
+  return std::tie(b.total_call_duration_s, a.user.name, a.user.number) <
+         std::tie(a.total_call_duration_s, b.user.name, b.user.number);
+}
+
+/**
+ * Wait until every task of pending finished, so none of them still reads the caller's locals
+ * when the result of one rethrows its exception
+ */
+template <typename T>
+void wait_all(std::vector<std::future<T>> &pending) {
+  for (auto &task : pending) {
+    task.wait();
+  }
+}
+
+} // namespace
+
+sharded_phone_book_t::worker_t::worker_t() {
+  thread = std::thread([this] { run(); });
+}
+
+sharded_phone_book_t::worker_t::~worker_t() {
+  {
+    std::lock_guard lock(mutex);
+    stopped = true;
+  }
+  ready.notify_one();
+  thread.join();
+}
+
+void sharded_phone_book_t::worker_t::run() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock lock(mutex);
+      ready.wait(lock, [this] { return stopped || !tasks.empty(); });
+      if (tasks.empty()) {
+        return;
+      }
+      task = std::move(tasks.front());
+      tasks.pop_front();
+    }
+    task();
+  }
+}
+
+sharded_phone_book_t::sharded_phone_book_t(size_t shards_count) {
+  shards_count = std::max<size_t>(shards_count, 1);
+  for (size_t i = 0; i < shards_count; ++i) {
+    shards.push_back(std::make_unique<shard_t>());
+  }
+}
+
+sharded_phone_book_t::~sharded_phone_book_t() = default;
+
+bool sharded_phone_book_t::create_user(const std::string &number, const std::string &name) {
+  shard_t &shard = *shards[shard_of(number)];
+  return shard.worker.submit([&] { return shard.book.create_user(number, name); }).get();
+}
+
+bool sharded_phone_book_t::add_call(const call_t &call) {
+  settle();
+  shard_t &shard = *shards[shard_of(call.number)];
+  if (!shard.worker.submit([&] { return shard.book.add_call(call); }).get()) {
+    return false;
+  }
+  shard.call_seqs.push_back(calls_count++);
+  return true;
+}
+
+std::future<bool> sharded_phone_book_t::create_user_async(const std::string &number, const std::string &name) {
+  shard_t &shard = *shards[shard_of(number)];
+  unsettled = true;
+  return shard.worker.submit([&shard, number, name] { return shard.book.create_user(number, name); });
+}
+
+std::future<bool> sharded_phone_book_t::add_call_async(const call_t &call) {
+  shard_t &shard = *shards[shard_of(call.number)];
+  unsettled = true;
+  return shard.worker.submit([&shard, call, submission = submitted_calls++] {
+    if (!shard.book.add_call(call)) {
+      return false;
+    }
+    shard.accepted_calls.push_back(submission);
+    return true;
+  });
+}
+
+std::vector<bool> sharded_phone_book_t::create_users(const std::vector<user_t> &new_users) {
+  std::vector<std::vector<size_t>> positions(shards.size());
+  for (size_t i = 0; i < new_users.size(); ++i) {
+    positions[shard_of(new_users[i].number)].push_back(i);
+  }
+  std::vector<std::future<std::vector<bool>>> done;
+  for (size_t s = 0; s < shards.size(); ++s) {
+    done.push_back(shards[s]->worker.submit([&, s] {
+      std::vector<user_t> part;
+      part.reserve(positions[s].size());
+      for (size_t i : positions[s]) {
+        part.push_back(new_users[i]);
+      }
+      return shards[s]->book.create_users(part);
+    }));
+  }
+  wait_all(done);
+  std::vector<bool> created(new_users.size());
+  for (size_t s = 0; s < shards.size(); ++s) {
+    std::vector<bool> part_created = done[s].get();
+    for (size_t j = 0; j < positions[s].size(); ++j) {
+      created[positions[s][j]] = part_created[j];
+    }
+  }
+  return created;
+}
+
+std::vector<bool> sharded_phone_book_t::add_calls(const std::vector<call_t> &new_calls) {
+  settle();
+  std::vector<std::vector<size_t>> positions(shards.size());
+  for (size_t i = 0; i < new_calls.size(); ++i) {
+    positions[shard_of(new_calls[i].number)].push_back(i);
+  }
+  std::vector<std::future<std::vector<bool>>> done;
+  for (size_t s = 0; s < shards.size(); ++s) {
+    done.push_back(shards[s]->worker.submit([&, s] {
+      std::vector<call_t> part;
+      part.reserve(positions[s].size());
+      for (size_t i : positions[s]) {
+        part.push_back(new_calls[i]);
+      }
+      return shards[s]->book.add_calls(part);
+    }));
+  }
+  wait_all(done);
+  std::vector<bool> added(new_calls.size());
+  for (size_t s = 0; s < shards.size(); ++s) {
+    std::vector<bool> part_added = done[s].get();
+    for (size_t j = 0; j < positions[s].size(); ++j) {
+      added[positions[s][j]] = part_added[j];
+    }
+  }
+  // shards appended their calls in batch order, so sequence numbers are handed out in the same order
+  for (size_t i = 0; i < new_calls.size(); ++i) {
+    if (added[i]) {
+      shards[shard_of(new_calls[i].number)]->call_seqs.push_back(calls_count++);
+    }
+  }
+  return added;
+}
+
+bool sharded_phone_book_t::remove_user(const std::string &number) {
+  shard_t &shard = *shards[shard_of(number)];
+  return shard.worker.submit([&] { return shard.book.remove_user(number); }).get();
+}
+
+bool sharded_phone_book_t::rename_user(const std::string &number, const std::string &new_name) {
+  shard_t &shard = *shards[shard_of(number)];
+  return shard.worker.submit([&] { return shard.book.rename_user(number, new_name); }).get();
+}
+
+std::vector<call_t> sharded_phone_book_t::get_calls(size_t start_pos, size_t count) const {
+  settle();
+  std::vector<call_t> result;
+  if (start_pos >= calls_count) {
+    return result;
+  }
+  count = std::min<uint64_t>(count, calls_count - start_pos);
+  result.reserve(count);
+  // k-way merge of shard call logs by sequence number, starting from the first call at or after start_pos
+  std::vector<phone_book_t::call_range_t> ranges;
+  std::vector<size_t> local_start(shards.size());
+  using head_t = std::pair<uint64_t, size_t>;
+  std::priority_queue<head_t, std::vector<head_t>, std::greater<>> heads;
+  for (size_t s = 0; s < shards.size(); ++s) {
+    const auto &seqs = shards[s]->call_seqs;
+    local_start[s] = std::lower_bound(seqs.begin(), seqs.end(), start_pos) - seqs.begin();
+    ranges.push_back(shards[s]->book.view_calls(local_start[s], count));
+    if (!ranges[s].empty()) {
+      heads.emplace(seqs[local_start[s]], s);
+    }
+  }
+  std::vector<size_t> taken(shards.size());
+  while (result.size() < count) {
+    size_t s = heads.top().second;
+    heads.pop();
+    call_view_t call = ranges[s][taken[s]++];
+    result.push_back({std::string(call.number), call.duration_s});
+    if (taken[s] < ranges[s].size()) {
+      heads.emplace(shards[s]->call_seqs[local_start[s] + taken[s]], s);
+    }
+  }
+  return result;
+}
+
+std::vector<call_t> sharded_phone_book_t::get_calls_for_user(const std::string &number, size_t start_pos,
+                                                             size_t count) const {
+  settle();
+  return shards[shard_of(number)]->book.get_calls_for_user(number, start_pos, count);
+}
+
+std::vector<user_info_t> sharded_phone_book_t::search_users_by_number(const std::string &number_prefix,
+                                                                      size_t count) const {
+  return search(
+      count, [&](const phone_book_t &book) { return book.search_users_by_number(number_prefix, count); },
+      less_by_number);
+}
+
+std::vector<std::vector<user_info_t>>
+sharded_phone_book_t::search_users_by_number_multi(const std::vector<std::string> &number_prefixes,
+                                                   size_t count) const {
+  std::vector<std::future<std::vector<std::vector<user_info_t>>>> pending;
+  for (const auto &shard : shards) {
+    pending.push_back(shard->worker.submit([&book = shard->book, &number_prefixes, count] {
+      return book.search_users_by_number_multi(number_prefixes, count);
+    }));
+  }
+  wait_all(pending);
+  std::vector<std::vector<std::vector<user_info_t>>> found;
+  for (auto &shard_found : pending) {
+    found.push_back(shard_found.get());
+  }
+  std::vector<std::vector<user_info_t>> result(number_prefixes.size());
+  for (size_t i = 0; i < number_prefixes.size(); ++i) {
+    std::vector<std::vector<user_info_t>> prefix_found;
+    for (auto &shard_found : found) {
+      prefix_found.push_back(std::move(shard_found[i]));
+    }
+    result[i] = merge(std::move(prefix_found), count, less_by_number);
+  }
+  return result;
+}
+
+std::vector<user_info_t> sharded_phone_book_t::search_users_by_name(const std::string &name_prefix,
+                                                                    size_t count) const {
+  return search(
+      count, [&](const phone_book_t &book) { return book.search_users_by_name(name_prefix, count); }, less_by_name);
+}
+
+std::vector<user_info_t> sharded_phone_book_t::search_users_by_name_substring(const std::string &fragment,
+                                                                              size_t count) const {
+  return search(
+      count, [&](const phone_book_t &book) { return book.search_users_by_name_substring(fragment, count); },
+      less_by_name);
+}
+
+std::vector<user_info_t> sharded_phone_book_t::search_users_by_name_fuzzy(const std::string &name_prefix,
+                                                                          size_t max_distance, size_t count) const {
+  levenshtein_automaton_t automaton(name_prefix, max_distance);
+  return search(
+      count,
+      [&](const phone_book_t &book) { return book.search_users_by_name_fuzzy(name_prefix, max_distance, count); },
+      [&](const user_info_t &a, const user_info_t &b) {
+        size_t a_distance = automaton.prefix_distance(a.user.name);
+        size_t b_distance = automaton.prefix_distance(b.user.name);
+        return a_distance != b_distance ? a_distance < b_distance : less_by_name(a, b);
+      });
+}
+
+void sharded_phone_book_t::clear() {
+  settle();
+  std::vector<std::future<void>> done;
+  for (auto &shard : shards) {
+    done.push_back(shard->worker.submit([&book = shard->book] { book.clear(); }));
+    shard->call_seqs.clear();
+  }
+  wait_all(done);
+  for (auto &shard_done : done) {
+    shard_done.get();
+  }
+  calls_count = 0;
+}
+
+size_t sharded_phone_book_t::size() const {
+  settle();
+  size_t result = 0;
+  for (const auto &shard : shards) {
+    result += shard->book.size();
+  }
+  return result;
+}
+
+bool sharded_phone_book_t::empty() const {
+  return size() == 0;
+}
+
+size_t sharded_phone_book_t::shards_count() const {
+  return shards.size();
+}
+
+size_t sharded_phone_book_t::shard_of(const std::string &number) const {
+  return std::hash<std::string_view>{}(number) % shards.size();
+}
+
+void sharded_phone_book_t::settle() const {
+  if (!unsettled) {
+    return;
+  }
+  unsettled = false;
+  std::vector<std::future<void>> done;
+  for (const auto &shard : shards) {
+    done.push_back(shard->worker.submit([] {}));
+  }
+  wait_all(done);
+  // every shard accepted its calls in submission order, so ordering all of them by submission
+  // extends every call_seqs in ascending order
+  std::vector<std::pair<uint64_t, size_t>> accepted;
+  for (size_t s = 0; s < shards.size(); ++s) {
+    for (uint64_t submission : shards[s]->accepted_calls) {
+      accepted.emplace_back(submission, s);
+    }
+    shards[s]->accepted_calls.clear();
+  }
+  std::sort(accepted.begin(), accepted.end());
+  for (const auto &[submission, s] : accepted) {
+    shards[s]->call_seqs.push_back(calls_count++);
+  }
+}
+
+template <typename F, typename Less>
+std::vector<user_info_t> sharded_phone_book_t::search(size_t count, const F &search_shard, Less less) const {
+  std::vector<std::future<std::vector<user_info_t>>> pending;
+  for (const auto &shard : shards) {
+    pending.push_back(shard->worker.submit([&book = shard->book, &search_shard] { return search_shard(book); }));
+  }
+  wait_all(pending);
+  std::vector<std::vector<user_info_t>> found;
+  for (auto &shard_found : pending) {
+    found.push_back(shard_found.get());
+  }
+  return merge(std::move(found), count, less);
+}
+
+template <typename Less>
+std::vector<user_info_t> sharded_phone_book_t::merge(std::vector<std::vector<user_info_t>> found, size_t count,
+                                                     Less less) {
+  // every shard returned its own first count users in the same order, so the first count of the union is among them
+  using head_t = std::pair<size_t, size_t>;
+  auto greater = [&](const head_t &a, const head_t &b) {
+    return less(found[b.first][b.second], found[a.first][a.second]);
+  };
+  std::priority_queue<head_t, std::vector<head_t>, decltype(greater)> heads(greater);
+  for (size_t s = 0; s < found.size(); ++s) {
+    if (!found[s].empty()) {
+      heads.emplace(s, 0);
+    }
+  }
+  std::vector<user_info_t> result;
+  while (result.size() < count && !heads.empty()) {
+    auto [s, i] = heads.top();
+    heads.pop();
+    result.push_back(std::move(found[s][i]));
+    if (i + 1 < found[s].size()) {
+      heads.emplace(s, i + 1);
+    }
+  }
+  return result;
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include "phone-book.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Phone book partitioned by number hash into shards, each owned by its worker thread.
+ * Batches are split by shard and applied by all workers in parallel, single items queued by the async methods
+ * are applied by their shards' workers while the caller goes on, searches are run on every shard
+ * and merged by the ordering rules of phone_book_t. Calls get global sequence numbers in the order
+ * they were submitted, so get_calls returns them in insertion order across shards.
+ * Methods are called from one thread at a time, as for phone_book_t
+ */
+class sharded_phone_book_t {
+public:
+  /**
+   * @param shards_count -- count of shards and worker threads, at least one
+   */
+  explicit sharded_phone_book_t(size_t shards_count = std::thread::hardware_concurrency());
+
+  sharded_phone_book_t(const sharded_phone_book_t &) = delete;
+  sharded_phone_book_t &operator=(const sharded_phone_book_t &) = delete;
+
+  ~sharded_phone_book_t();
+
+  /**
+   * Same as phone_book_t::create_user, waits for the owning worker, so single calls do not run in parallel
+   */
+  bool create_user(const std::string &number, const std::string &name);
+
+  /**
+   * Same as phone_book_t::add_call, waits for the owning worker, so single calls do not run in parallel
+   */
+  bool add_call(const call_t &call);
+
+  /**
+   * Same as create_user without waiting: the owning worker applies it after everything submitted before,
+   * so users spread over shards are created in parallel
+   * @return result of phone_book_t::create_user, ready once the worker applied it
+   */
+  std::future<bool> create_user_async(const std::string &number, const std::string &name);
+
+  /**
+   * Same as add_call without waiting: the owning worker applies it after everything submitted before.
+   * The call takes its place in get_calls in the order of submission
+   * @return result of phone_book_t::add_call, ready once the worker applied it
+   */
+  std::future<bool> add_call_async(const call_t &call);
+
+  /**
+   * Same as phone_book_t::create_users, shards apply their parts in parallel
+   */
+  std::vector<bool> create_users(const std::vector<user_t> &new_users);
+
+  /**
+   * Same as phone_book_t::add_calls, shards apply their parts in parallel
+   */
+  std::vector<bool> add_calls(const std::vector<call_t> &new_calls);
+
+  /**
+   * Same as phone_book_t::remove_user, waits for the owning worker
+   */
+  bool remove_user(const std::string &number);
+
+  /**
+   * Same as phone_book_t::rename_user, waits for the owning worker
+   */
+  bool rename_user(const std::string &number, const std::string &new_name);
+
+  /**
+   * Same as phone_book_t::get_calls
+   */
+  std::vector<call_t> get_calls(size_t start_pos, size_t count) const;
+
+  /**
+   * Same as phone_book_t::get_calls_for_user, answered by the shard of the number
+   */
+  std::vector<call_t> get_calls_for_user(const std::string &number, size_t start_pos, size_t count) const;
+
+  /**
+   * Same as phone_book_t::search_users_by_number
+   */
+  std::vector<user_info_t> search_users_by_number(const std::string &number_prefix, size_t count = -1) const;
+
+  /**
+   * Same as phone_book_t::search_users_by_number_multi, every shard resolves all prefixes in one pass
+   */
+  std::vector<std::vector<user_info_t>> search_users_by_number_multi(const std::vector<std::string> &number_prefixes,
+                                                                     size_t count = -1) const;
+
+  /**
+   * Same as phone_book_t::search_users_by_name
+   */
+  std::vector<user_info_t> search_users_by_name(const std::string &name_prefix, size_t count = -1) const;
+
+  /**
+   * Same as phone_book_t::search_users_by_name_substring
+   */
+  std::vector<user_info_t> search_users_by_name_substring(const std::string &fragment, size_t count = -1) const;
+
+  /**
+   * Same as phone_book_t::search_users_by_name_fuzzy
+   */
+  std::vector<user_info_t> search_users_by_name_fuzzy(const std::string &name_prefix, size_t max_distance,
+                                                      size_t count = -1) const;
+
+  void clear();
+
+  size_t size() const;
+
+  bool empty() const;
+
+  size_t shards_count() const;
+
+private:
+  /**
+   * Thread running tasks for one shard in their order
+   */
+  class worker_t {
+  public:
+    worker_t();
+    ~worker_t();
+
+    template <typename F>
+    auto submit(F &&f) -> std::future<decltype(f())> {
+      auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::forward<F>(f));
+      auto result = task->get_future();
+      {
+        std::lock_guard lock(mutex);
+        tasks.emplace_back([task] { (*task)(); });
+      }
+      ready.notify_one();
+      return result;
+    }
+
+  private:
+    void run();
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::function<void()>> tasks;
+    bool stopped{false};
+    std::thread thread;
+  };
+
+  struct shard_t {
+    phone_book_t book;
+    // global sequence numbers of the shard's calls, ascending
+    std::vector<uint64_t> call_seqs;
+    // submission numbers of calls of add_call_async accepted by the worker and not given sequence numbers yet,
+    // ascending; appended by the worker
+    std::vector<uint64_t> accepted_calls;
+    worker_t worker;
+  };
+
+  size_t shard_of(const std::string &number) const;
+
+  /**
+   * Wait until workers applied everything submitted by the async methods and give sequence numbers
+   * to the calls they accepted, so the shards can be read and call_seqs extended directly
+   */
+  void settle() const;
+
+  /**
+   * Run search_shard on every shard and merge the results ordered by less into the first count
+   */
+  template <typename F, typename Less>
+  std::vector<user_info_t> search(size_t count, const F &search_shard, Less less) const;
+
+  /**
+   * Merge first count users of every shard ordered by less into the first count
+   */
+  template <typename Less>
+  static std::vector<user_info_t> merge(std::vector<std::vector<user_info_t>> found, size_t count, Less less);
+
+  std::vector<std::unique_ptr<shard_t>> shards;
+  // settled lazily by reads
+  mutable uint64_t calls_count{0};
+  uint64_t submitted_calls{0};
+  mutable bool unsettled{false};
+};
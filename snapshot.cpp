@@ -0,0 +1,348 @@
+#include "snapshot.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t section_alignment = 8;
+
+size_t aligned(size_t size) {
+  return (size + section_alignment - 1) / section_alignment * section_alignment;
+}
+
+std::runtime_error file_error(const std::string &what, const std::string &path) {
+  return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+/**
+ * FNV-1a of bytes continuing hash
+ */
+uint32_t checksum(const void *bytes, size_t bytes_count, uint32_t hash = 2166136261u) {
+  for (const char *it = static_cast<const char *>(bytes), *end = it + bytes_count; it != end; ++it) {
+    hash = (hash ^ static_cast<unsigned char>(*it)) * 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * Make a rename into the directory of path durable
+ */
+void sync_directory_of(const std::string &path) {
+  size_t slash = path.find_last_of('/');
+  std::string directory = slash == std::string::npos ? "." : path.substr(0, std::max<size_t>(slash, 1));
+  int fd = ::open(directory.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    ::fsync(fd);
+    ::close(fd);
+  }
+}
+
+std::runtime_error corrupted() {
+  return std::runtime_error("corrupted phone book snapshot: reference out of section bounds");
+}
+
+} // namespace
+
+uint32_t snapshot_writer_t::add_name(std::string_view name) {
+  size_t offset = names.size();
+  if (offset + sizeof(uint32_t) + name.size() > std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("snapshot names section exceeds 4 GiB");
+  }
+  auto length = static_cast<uint32_t>(name.size());
+  names.append(reinterpret_cast<const char *>(&length), sizeof(length));
+  names.append(name);
+  names.resize((names.size() + sizeof(uint32_t) - 1) / sizeof(uint32_t) * sizeof(uint32_t));
+  return static_cast<uint32_t>(offset);
+}
+
+void snapshot_writer_t::write(const std::string &path) const {
+  snapshot_header_t header{};
+  std::copy(std::begin(snapshot_header_t::expected_magic), std::end(snapshot_header_t::expected_magic),
+            header.magic);
+  header.version = snapshot_header_t::current_version;
+  header.byte_order = snapshot_header_t::expected_byte_order;
+
+  std::vector<std::pair<const void *, size_t>> sections;
+  size_t offset = aligned(sizeof(header));
+  auto add_section = [&](const auto &items, uint64_t &section_offset) {
+    section_offset = offset;
+    size_t bytes = items.size() * sizeof(items[0]);
+    sections.emplace_back(items.data(), bytes);
+    offset += aligned(bytes);
+  };
+  add_section(users, header.users_offset);
+  add_section(names, header.names_offset);
+  add_section(call_users, header.call_users_offset);
+  add_section(call_durations, header.call_durations_offset);
+  add_section(trie_nodes, header.trie_nodes_offset);
+  add_section(trie_ids, header.trie_ids_offset);
+  add_section(name_order, header.name_order_offset);
+  add_section(number_order, header.number_order_offset);
+  add_section(user_calls_begin, header.user_calls_begin_offset);
+  add_section(user_call_positions, header.user_call_positions_offset);
+  header.users_count = users.size();
+  header.live_users_count = name_order.size();
+  header.names_size = names.size();
+  header.calls_count = call_users.size();
+  header.trie_nodes_count = trie_nodes.size();
+  header.trie_ids_count = trie_ids.size();
+  header.file_size = offset;
+  static constexpr char padding[section_alignment] = {};
+  header.checksum = checksum(nullptr, 0);
+  for (const auto &[bytes, bytes_count] : sections) {
+    header.checksum = checksum(bytes, bytes_count, header.checksum);
+    header.checksum = checksum(padding, aligned(bytes_count) - bytes_count, header.checksum);
+  }
+
+  // truncating path in place would change the file under books that have it mapped; the temporary name
+  // is unique, so books saving to the same path at once do not write into one file
+  std::string tmp_path = path + ".XXXXXX";
+  int fd = ::mkstemp(tmp_path.data());
+  if (fd < 0) {
+    throw file_error("cannot create", path);
+  }
+  std::unique_ptr<FILE, int (*)(FILE *)> file(::fchmod(fd, 0644) == 0 ? ::fdopen(fd, "wb") : nullptr, &std::fclose);
+  if (!file) {
+    std::runtime_error error = file_error("cannot create", tmp_path);
+    ::close(fd);
+    std::remove(tmp_path.c_str());
+    throw error;
+  }
+  auto put = [&file](const void *bytes, size_t bytes_count) {
+    size_t padding_size = aligned(bytes_count) - bytes_count;
+    // empty sections may have no storage at all
+    return (bytes_count == 0 || std::fwrite(bytes, 1, bytes_count, file.get()) == bytes_count) &&
+           std::fwrite(padding, 1, padding_size, file.get()) == padding_size;
+  };
+  bool written = put(&header, sizeof(header));
+  for (const auto &[bytes, bytes_count] : sections) {
+    written = written && put(bytes, bytes_count);
+  }
+  // the snapshot replaces an older one by rename, so it has to be on disk first
+  written = written && std::fflush(file.get()) == 0 && ::fsync(::fileno(file.get())) == 0;
+  if (!written || std::fclose(file.release()) != 0 || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::runtime_error error = file_error("cannot write", path);
+    std::remove(tmp_path.c_str());
+    throw error;
+  }
+  // the rename itself is durable only once the directory is
+  sync_directory_of(path);
+}
+
+mapped_snapshot_t::mapped_snapshot_t(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw file_error("cannot open", path);
+  }
+  struct stat info {};
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    throw file_error("cannot stat", path);
+  }
+  size = static_cast<size_t>(info.st_size);
+  if (size < sizeof(snapshot_header_t)) {
+    ::close(fd);
+    throw std::runtime_error("not a phone book snapshot: " + path);
+  }
+  data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    data = nullptr;
+    throw file_error("cannot map", path);
+  }
+  try {
+    const snapshot_header_t &h = header();
+    if (!std::equal(std::begin(h.magic), std::end(h.magic), std::begin(snapshot_header_t::expected_magic)) ||
+        h.byte_order != snapshot_header_t::expected_byte_order || h.file_size != size) {
+      throw std::runtime_error("not a phone book snapshot: " + path);
+    }
+    if (h.version != snapshot_header_t::current_version) {
+      throw std::runtime_error("unsupported phone book snapshot version " + std::to_string(h.version) + ": " + path);
+    }
+    check_section(h.users_offset, h.users_count, sizeof(snapshot_user_t));
+    check_section(h.names_offset, h.names_size, 1);
+    check_section(h.call_users_offset, h.calls_count, sizeof(uint32_t));
+    check_section(h.call_durations_offset, h.calls_count, sizeof(double));
+    check_section(h.trie_nodes_offset, h.trie_nodes_count, sizeof(snapshot_trie_node_t));
+    check_section(h.trie_ids_offset, h.trie_ids_count, sizeof(uint32_t));
+    if (h.live_users_count > h.users_count) {
+      throw std::runtime_error("corrupted phone book snapshot: more live users than user ids");
+    }
+    check_section(h.name_order_offset, h.live_users_count, sizeof(uint32_t));
+    check_section(h.number_order_offset, h.live_users_count, sizeof(uint32_t));
+    check_section(h.user_calls_begin_offset, h.users_count + 1, sizeof(uint64_t));
+    check_section(h.user_call_positions_offset, h.calls_count, sizeof(uint32_t));
+    if (h.trie_nodes_count == 0) {
+      throw std::runtime_error("phone book snapshot without trie root");
+    }
+  } catch (...) {
+    ::munmap(data, size);
+    throw;
+  }
+}
+
+mapped_snapshot_t::~mapped_snapshot_t() {
+  ::munmap(data, size);
+}
+
+std::pair<const uint32_t *, const uint32_t *> mapped_snapshot_t::find_number(std::string_view prefix) const {
+  const snapshot_trie_node_t *nodes = section<snapshot_trie_node_t>(header().trie_nodes_offset);
+  const snapshot_trie_node_t *node = nodes;
+  while (node->depth < prefix.size()) {
+    size_t depth = node->depth;
+    const snapshot_trie_node_t *children = nodes + node->first_child;
+    const snapshot_trie_node_t *next = std::find_if(
+        children, children + node->children_count,
+        [&](const snapshot_trie_node_t &child) { return child.path.view()[depth] == prefix[depth]; });
+    if (next == children + node->children_count) {
+      return {nullptr, nullptr};
+    }
+    node = next;
+    size_t end = std::min<size_t>(node->depth, prefix.size());
+    if (node->path.view().substr(depth, end - depth) != prefix.substr(depth, end - depth)) {
+      return {nullptr, nullptr};
+    }
+  }
+  const uint32_t *ids = section<uint32_t>(header().trie_ids_offset) + node->users_begin;
+  return {ids, ids + node->users_count};
+}
+
+const uint32_t *mapped_snapshot_t::lower_bound_name(std::string_view prefix) const {
+  auto [begin, end] = name_order();
+  return std::partition_point(begin, end, [&](uint32_t id) { return name(user(id)) < prefix; });
+}
+
+std::pair<const uint32_t *, const uint32_t *> mapped_snapshot_t::find_user_calls(const number_key_t &number) const {
+  const uint32_t *order = section<uint32_t>(header().number_order_offset);
+  const uint32_t *it =
+      std::partition_point(order, order + users_count(), [&](uint32_t id) { return user(id).number < number; });
+  if (it == order + users_count() || !(user(*it).number == number)) {
+    return {nullptr, nullptr};
+  }
+  const uint64_t *begin = section<uint64_t>(header().user_calls_begin_offset) + *it;
+  const uint32_t *positions = section<uint32_t>(header().user_call_positions_offset);
+  return {positions + begin[0], positions + begin[1]};
+}
+
+void mapped_snapshot_t::verify() const {
+  size_t sections_offset = aligned(sizeof(snapshot_header_t));
+  if (checksum(section<char>(sections_offset), size - sections_offset) != header().checksum) {
+    throw std::runtime_error("corrupted phone book snapshot: checksum mismatch");
+  }
+  check_references();
+  check_orders();
+}
+
+void mapped_snapshot_t::check_section(uint64_t offset, uint64_t count, size_t item_size) const {
+  if (offset % section_alignment != 0 || offset > size || count > (size - offset) / item_size) {
+    throw std::runtime_error("corrupted phone book snapshot: section out of file bounds");
+  }
+}
+
+void mapped_snapshot_t::check_references() const {
+  const snapshot_header_t &h = header();
+  auto check_ids = [](const uint32_t *ids, uint64_t count, uint64_t bound) {
+    if (std::any_of(ids, ids + count, [bound](uint32_t id) { return id >= bound; })) {
+      throw corrupted();
+    }
+  };
+  for (uint64_t id = 0; id < h.users_count; ++id) {
+    const snapshot_user_t &user = this->user(static_cast<uint32_t>(id));
+    if (user.number.size() > number_key_t::max_length || user.name_offset % sizeof(uint32_t) != 0 ||
+        h.names_size < sizeof(uint32_t) || user.name_offset > h.names_size - sizeof(uint32_t)) {
+      throw corrupted();
+    }
+    uint32_t length = 0;
+    std::memcpy(&length, section<char>(h.names_offset) + user.name_offset, sizeof(length));
+    if (length > h.names_size - sizeof(uint32_t) - user.name_offset) {
+      throw corrupted();
+    }
+  }
+  check_ids(section<uint32_t>(h.call_users_offset), h.calls_count, h.users_count);
+  check_ids(section<uint32_t>(h.trie_ids_offset), h.trie_ids_count, h.users_count);
+  check_ids(section<uint32_t>(h.name_order_offset), h.live_users_count, h.users_count);
+  check_ids(section<uint32_t>(h.number_order_offset), h.live_users_count, h.users_count);
+  check_ids(section<uint32_t>(h.user_call_positions_offset), h.calls_count, h.calls_count);
+  const uint64_t *calls_begin = section<uint64_t>(h.user_calls_begin_offset);
+  if (calls_begin[0] != 0 || calls_begin[h.users_count] > h.calls_count ||
+      !std::is_sorted(calls_begin, calls_begin + h.users_count + 1)) {
+    throw corrupted();
+  }
+  // find_number descends by depth, so children must be deeper than their parent and have its path
+  const snapshot_trie_node_t *nodes = section<snapshot_trie_node_t>(h.trie_nodes_offset);
+  if (nodes[0].depth != 0) {
+    throw corrupted();
+  }
+  for (uint64_t i = 0; i < h.trie_nodes_count; ++i) {
+    const snapshot_trie_node_t &node = nodes[i];
+    if (node.path.size() > number_key_t::max_length || node.depth > node.path.size() ||
+        node.users_begin > h.trie_ids_count || node.users_count > h.trie_ids_count - node.users_begin) {
+      throw corrupted();
+    }
+    if (node.children_count == 0) {
+      continue;
+    }
+    if (node.first_child <= i || node.first_child > h.trie_nodes_count ||
+        node.children_count > h.trie_nodes_count - node.first_child) {
+      throw corrupted();
+    }
+    for (uint64_t child = node.first_child; child < node.first_child + node.children_count; ++child) {
+      if (nodes[child].depth <= node.depth) {
+        throw corrupted();
+      }
+    }
+  }
+}
+
+void mapped_snapshot_t::check_orders() const {
+  const snapshot_header_t &h = header();
+  size_t live_users_count = 0;
+  for (uint64_t id = 0; id < h.users_count; ++id) {
+    live_users_count += (user(static_cast<uint32_t>(id)).flags & snapshot_user_t::removed_flag) == 0;
+  }
+  const snapshot_trie_node_t &root = *section<snapshot_trie_node_t>(h.trie_nodes_offset);
+  if (live_users_count != h.live_users_count || root.users_count != live_users_count) {
+    throw std::runtime_error("corrupted phone book snapshot: users count mismatch");
+  }
+  auto check_order = [this](const uint32_t *ids, const auto &less) {
+    for (size_t i = 0; i < users_count(); ++i) {
+      if ((user(ids[i]).flags & snapshot_user_t::removed_flag) != 0 ||
+          (i != 0 && !less(user(ids[i - 1]), user(ids[i])))) {
+        throw std::runtime_error("corrupted phone book snapshot: users out of order");
+      }
+    }
+  };
+  check_order(name_order().first, [this](const snapshot_user_t &a, const snapshot_user_t &b) {
+    if (int cmp = name(a).compare(name(b)); cmp != 0) {
+      return cmp < 0;
+    }
+    if (a.total_call_duration_s != b.total_call_duration_s) {
+      return a.total_call_duration_s > b.total_call_duration_s;
+    }
+    return a.number < b.number;
+  });
+  check_order(section<uint32_t>(h.number_order_offset),
+              [](const snapshot_user_t &a, const snapshot_user_t &b) { return a.number < b.number; });
+  check_order(section<uint32_t>(h.trie_ids_offset) + root.users_begin,
+              [this](const snapshot_user_t &a, const snapshot_user_t &b) {
+                if (a.total_call_duration_s != b.total_call_duration_s) {
+                  return a.total_call_duration_s > b.total_call_duration_s;
+                }
+                if (int cmp = name(a).compare(name(b)); cmp != 0) {
+                  return cmp < 0;
+                }
+                return a.number < b.number;
+              });
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include "number-key.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * On-disk snapshot of a phone book, laid out to be queried in place after mmap.
+ * The file is a header followed by 8-aligned sections, every reference is an index or an offset
+ * inside the file, so the layout does not depend on the address it is mapped at.
+ * The header holds the FNV-1a checksum of everything after it, checked by mapped_snapshot_t::verify. Sections:
+ *    users -- snapshot_user_t by user id, removed users stay as tombstones referenced by their calls
+ *    names -- name records: u32 length and bytes, aligned to 4
+ *    call users, call durations -- call log as two columns
+ *    trie nodes -- number trie in breadth-first order, children of a node are consecutive
+ *    trie ids -- user ids of every trie node ordered by total call duration desc, name asc, number asc
+ *    name order -- ids of users not removed ordered by name asc, total call duration desc, number asc
+ *    number order -- ids of users not removed ordered by number
+ *    user calls begin -- for every user id and one past the last, where its calls start in user call positions
+ *    user call positions -- positions in the call log of the calls of every user in order of addition
+ */
+struct snapshot_header_t {
+  static constexpr char expected_magic[8] = {'P', 'H', 'O', 'N', 'E', 'B', 'K', '\0'};
+  static constexpr uint32_t current_version = 4;
+  // written in native byte order, reads back differently on a machine of the other endianness
+  static constexpr uint32_t expected_byte_order = 0x01020304;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t file_size;
+
+  uint64_t users_offset, users_count, live_users_count;
+  uint64_t names_offset, names_size;
+  uint64_t call_users_offset, call_durations_offset, calls_count;
+  uint64_t trie_nodes_offset, trie_nodes_count;
+  uint64_t trie_ids_offset, trie_ids_count;
+  uint64_t name_order_offset;
+  uint64_t number_order_offset;
+  uint64_t user_calls_begin_offset, user_call_positions_offset;
+  uint32_t checksum;
+  uint32_t reserved;
+};
+
+struct snapshot_user_t {
+  static constexpr uint32_t removed_flag = 1;
+
+  number_key_t number;
+  uint32_t name_offset;
+  uint32_t flags;
+  double total_call_duration_s;
+};
+
+/**
+ * Node for prefix path[0 .. depth), users of its subtree are trie ids [users_begin, users_begin + users_count)
+ */
+struct snapshot_trie_node_t {
+  number_key_t path;
+  uint32_t depth;
+  uint32_t first_child;
+  uint32_t children_count;
+  uint32_t users_count;
+  uint64_t users_begin;
+};
+
+static_assert(std::is_trivially_copyable_v<snapshot_header_t> && std::is_trivially_copyable_v<snapshot_user_t> &&
+                  std::is_trivially_copyable_v<snapshot_trie_node_t>,
+              "snapshot records are written and mapped as raw bytes");
+static_assert(sizeof(snapshot_user_t) == 40 && sizeof(snapshot_trie_node_t) == 48, "snapshot layout changed");
+
+/**
+ * Sections of a snapshot collected in memory and written to a file at once
+ */
+struct snapshot_writer_t {
+  /**
+   * Append name record
+   * @return offset of the record in names section
+   */
+  uint32_t add_name(std::string_view name);
+
+  /**
+   * Write the snapshot to a temporary file next to path, sync it and rename it over path,
+   * so books mapping the previous file at path keep reading it unchanged
+   * @throws std::runtime_error if the file cannot be written
+   */
+  void write(const std::string &path) const;
+
+  std::vector<snapshot_user_t> users;
+  std::string names;
+  std::vector<uint32_t> call_users;
+  std::vector<double> call_durations;
+  std::vector<snapshot_trie_node_t> trie_nodes;
+  std::vector<uint32_t> trie_ids;
+  std::vector<uint32_t> name_order;
+  std::vector<uint32_t> number_order;
+  std::vector<uint64_t> user_calls_begin;
+  std::vector<uint32_t> user_call_positions;
+};
+
+/**
+ * Read-only mapping of a snapshot file. Opening checks only the header and that every section lies inside
+ * the file, so it takes O(1) and queries read only the pages they touch. Indexes and offsets stored in the
+ * sections are trusted by queries unless verify checked them
+ */
+class mapped_snapshot_t {
+public:
+  /**
+   * @throws std::runtime_error if the file cannot be mapped, is not a snapshot of the current version
+   * or its sections do not fit in it
+   */
+  explicit mapped_snapshot_t(const std::string &path);
+
+  mapped_snapshot_t(const mapped_snapshot_t &) = delete;
+  mapped_snapshot_t &operator=(const mapped_snapshot_t &) = delete;
+
+  ~mapped_snapshot_t();
+
+  /**
+   * Read the whole file to check its checksum, that every index and offset stored in it points inside
+   * its target and that the stored orders are sorted, so queries are safe on any file that passes
+   * @throws std::runtime_error if the snapshot is corrupted
+   */
+  void verify() const;
+
+  /**
+   * @return count of users not removed
+   */
+  size_t users_count() const {
+    return header().live_users_count;
+  }
+
+  /**
+   * @return count of user ids including removed users
+   */
+  size_t user_ids_count() const {
+    return header().users_count;
+  }
+
+  const snapshot_user_t &user(uint32_t id) const {
+    return section<snapshot_user_t>(header().users_offset)[id];
+  }
+
+  std::string_view name(const snapshot_user_t &user) const {
+    const char *record = section<char>(header().names_offset) + user.name_offset;
+    return {record + sizeof(uint32_t), *reinterpret_cast<const uint32_t *>(record)};
+  }
+
+  size_t calls_count() const {
+    return header().calls_count;
+  }
+
+  uint32_t call_user_id(size_t pos) const {
+    return section<uint32_t>(header().call_users_offset)[pos];
+  }
+
+  double call_duration_s(size_t pos) const {
+    return section<double>(header().call_durations_offset)[pos];
+  }
+
+  /**
+   * @return ids of users with number starting with prefix in number search order
+   */
+  std::pair<const uint32_t *, const uint32_t *> find_number(std::string_view prefix) const;
+
+  /**
+   * @return ids of all users not removed in name search order
+   */
+  std::pair<const uint32_t *, const uint32_t *> name_order() const {
+    const uint32_t *begin = section<uint32_t>(header().name_order_offset);
+    return {begin, begin + users_count()};
+  }
+
+  /**
+   * @return first position in name order with name not less than prefix
+   */
+  const uint32_t *lower_bound_name(std::string_view prefix) const;
+
+  /**
+   * @return positions in the call log of the calls of the user with number in order of addition,
+   * empty if there is no such user
+   */
+  std::pair<const uint32_t *, const uint32_t *> find_user_calls(const number_key_t &number) const;
+
+private:
+  const snapshot_header_t &header() const {
+    return *static_cast<const snapshot_header_t *>(data);
+  }
+
+  template <typename T>
+  const T *section(uint64_t offset) const {
+    return reinterpret_cast<const T *>(static_cast<const char *>(data) + offset);
+  }
+
+  void check_section(uint64_t offset, uint64_t count, size_t item_size) const;
+
+  /**
+   * @throws std::runtime_error if an index or offset stored in a section points outside of its target
+   */
+  void check_references() const;
+
+  /**
+   * @throws std::runtime_error if name order, number order and ids of the trie root are not strictly ordered
+   * permutations of the users not removed, as materializing the book relies on
+   */
+  void check_orders() const;
+
+  void *data{nullptr};
+  size_t size{0};
+};
@@ -0,0 +1,320 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * Distribution of recorded values: log-linear buckets, every power of two range is split into sub_buckets
+ * equal parts, so a value is known up to 1 / sub_buckets of itself
+ */
+struct histogram_snapshot_t {
+  static constexpr size_t sub_bucket_bits = 3;
+  static constexpr size_t sub_buckets = size_t{1} << sub_bucket_bits;
+  static constexpr size_t buckets_count = (64 - sub_bucket_bits + 1) * sub_buckets;
+
+  static size_t bucket_of(uint64_t value) {
+    if (value < sub_buckets) {
+      return static_cast<size_t>(value);
+    }
+    size_t exponent = 63 - static_cast<size_t>(__builtin_clzll(value));
+    size_t sub_bucket = static_cast<size_t>(value >> (exponent - sub_bucket_bits)) & (sub_buckets - 1);
+    return (exponent - sub_bucket_bits + 1) * sub_buckets + sub_bucket;
+  }
+
+  /**
+   * @return the smallest value of bucket
+   */
+  static uint64_t lower_bound(size_t bucket) {
+    if (bucket < sub_buckets) {
+      return bucket;
+    }
+    size_t exponent = bucket / sub_buckets + sub_bucket_bits - 1;
+    return (sub_buckets + bucket % sub_buckets) << (exponent - sub_bucket_bits);
+  }
+
+  double mean() const {
+    return count == 0 ? 0 : static_cast<double>(sum) / static_cast<double>(count);
+  }
+
+  /**
+   * @return lower bound of the bucket holding the value at quantile q in [0, 1]
+   */
+  uint64_t percentile(double q) const {
+    if (count == 0) {
+      return 0;
+    }
+    auto rank = static_cast<uint64_t>(q * static_cast<double>(count - 1));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < buckets.size(); ++bucket) {
+      seen += buckets[bucket];
+      if (seen > rank) {
+        return lower_bound(bucket);
+      }
+    }
+    return max;
+  }
+
+  uint64_t count{0};
+  uint64_t sum{0};
+  uint64_t max{0};
+  // empty if nothing was recorded
+  std::vector<uint64_t> buckets;
+};
+
+/**
+ * Histogram recorded concurrently without locks
+ */
+class log_linear_histogram_t {
+public:
+  void record(uint64_t value) {
+    buckets[histogram_snapshot_t::bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(value, std::memory_order_relaxed);
+    for (uint64_t seen = max.load(std::memory_order_relaxed);
+         seen < value && !max.compare_exchange_weak(seen, value, std::memory_order_relaxed);) {
+    }
+  }
+
+  /**
+   * @return recorded values, consistent per field while recording goes on
+   */
+  histogram_snapshot_t snapshot() const {
+    histogram_snapshot_t result;
+    result.count = count.load(std::memory_order_relaxed);
+    result.sum = sum.load(std::memory_order_relaxed);
+    result.max = max.load(std::memory_order_relaxed);
+    if (result.count != 0) {
+      result.buckets.resize(buckets.size());
+      for (size_t i = 0; i < buckets.size(); ++i) {
+        result.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+      }
+    }
+    return result;
+  }
+
+private:
+  std::array<std::atomic<uint64_t>, histogram_snapshot_t::buckets_count> buckets{};
+  std::atomic<uint64_t> count{0};
+  std::atomic<uint64_t> sum{0};
+  std::atomic<uint64_t> max{0};
+};
+
+/**
+ * Statistics of one kind of operation. Accepted and rejected count items of modifications,
+ * result sizes and prefix lengths are recorded for queries
+ */
+struct operation_stats_t {
+  uint64_t calls{0};
+  uint64_t accepted{0};
+  uint64_t rejected{0};
+  histogram_snapshot_t latency_ns;
+  histogram_snapshot_t result_size;
+  histogram_snapshot_t prefix_length;
+};
+
+/**
+ * Statistics of phone_book_t, collected only if it is built with PHONE_BOOK_STATS defined
+ */
+struct phone_book_stats_t {
+  bool enabled{false};
+  operation_stats_t create_user;
+  operation_stats_t add_call;
+  operation_stats_t create_users;
+  operation_stats_t add_calls;
+  operation_stats_t remove_user;
+  operation_stats_t rename_user;
+  operation_stats_t clear;
+  operation_stats_t get_calls;
+  operation_stats_t view_calls;
+  operation_stats_t get_calls_for_user;
+  operation_stats_t count_calls_for_user;
+  operation_stats_t search_users_by_number;
+  operation_stats_t search_users_by_number_multi;
+  operation_stats_t search_users_by_name;
+  operation_stats_t search_users_by_name_substring;
+  operation_stats_t search_users_by_name_fuzzy;
+};
+
+enum class operation_t {
+  create_user,
+  add_call,
+  create_users,
+  add_calls,
+  remove_user,
+  rename_user,
+  clear,
+  get_calls,
+  view_calls,
+  get_calls_for_user,
+  count_calls_for_user,
+  search_by_number,
+  search_by_number_multi,
+  search_by_name,
+  search_by_name_substring,
+  search_by_name_fuzzy
+};
+
+#ifdef PHONE_BOOK_STATS
+
+/**
+ * Recorder of operation statistics shared by copies of a phone book, safe for concurrent queries
+ */
+class stats_recorder_t {
+  struct counters_t {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<uint64_t> rejected{0};
+    log_linear_histogram_t latency_ns;
+    log_linear_histogram_t result_size;
+    log_linear_histogram_t prefix_length;
+  };
+
+  static constexpr size_t operations_count = static_cast<size_t>(operation_t::search_by_name_fuzzy) + 1;
+
+public:
+  /**
+   * Measurement of one operation: started on creation, recorded by done
+   */
+  class measure_t {
+  public:
+    measure_t(counters_t &counters, size_t prefix_length)
+        : counters(counters), prefix_length(prefix_length), start(std::chrono::steady_clock::now()) {}
+
+    /**
+     * Record the operation with its result
+     * @return result
+     */
+    template <typename R>
+    R &&done(R &&result) {
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      counters.calls.fetch_add(1, std::memory_order_relaxed);
+      counters.latency_ns.record(static_cast<uint64_t>(std::chrono::nanoseconds(elapsed).count()));
+      if (prefix_length != no_prefix) {
+        counters.prefix_length.record(prefix_length);
+      }
+      record_result(result);
+      return std::forward<R>(result);
+    }
+
+    /**
+     * Record the operation without result
+     */
+    void done() {
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      counters.calls.fetch_add(1, std::memory_order_relaxed);
+      counters.latency_ns.record(static_cast<uint64_t>(std::chrono::nanoseconds(elapsed).count()));
+    }
+
+  private:
+    static constexpr size_t no_prefix = static_cast<size_t>(-1);
+
+    friend class stats_recorder_t;
+
+    void record_result(bool accepted) {
+      (accepted ? counters.accepted : counters.rejected).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void record_result(size_t count) {
+      counters.result_size.record(count);
+    }
+
+    void record_result(const std::vector<bool> &accepted) {
+      auto accepted_count = static_cast<uint64_t>(std::count(accepted.begin(), accepted.end(), true));
+      counters.accepted.fetch_add(accepted_count, std::memory_order_relaxed);
+      counters.rejected.fetch_add(accepted.size() - accepted_count, std::memory_order_relaxed);
+    }
+
+    template <typename page_t>
+    auto record_result(const page_t &page) -> decltype(page.users.size(), void()) {
+      counters.result_size.record(page.users.size());
+    }
+
+    template <typename T>
+    void record_result(const std::vector<T> &result) {
+      counters.result_size.record(result.size());
+    }
+
+    template <typename range_t>
+    auto record_result(const range_t &range) -> decltype(range.begin(), range.size(), void()) {
+      counters.result_size.record(range.size());
+    }
+
+    counters_t &counters;
+    size_t prefix_length;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  stats_recorder_t() : operations(std::make_shared<std::array<counters_t, operations_count>>()) {}
+
+  measure_t measure(operation_t operation, size_t prefix_length = measure_t::no_prefix) const {
+    return {(*operations)[static_cast<size_t>(operation)], prefix_length};
+  }
+
+  phone_book_stats_t snapshot() const {
+    phone_book_stats_t stats;
+    stats.enabled = true;
+    auto fill = [this](operation_t operation, operation_stats_t &result) {
+      const counters_t &counters = (*operations)[static_cast<size_t>(operation)];
+      result.calls = counters.calls.load(std::memory_order_relaxed);
+      result.accepted = counters.accepted.load(std::memory_order_relaxed);
+      result.rejected = counters.rejected.load(std::memory_order_relaxed);
+      result.latency_ns = counters.latency_ns.snapshot();
+      result.result_size = counters.result_size.snapshot();
+      result.prefix_length = counters.prefix_length.snapshot();
+    };
+    fill(operation_t::create_user, stats.create_user);
+    fill(operation_t::add_call, stats.add_call);
+    fill(operation_t::create_users, stats.create_users);
+    fill(operation_t::add_calls, stats.add_calls);
+    fill(operation_t::remove_user, stats.remove_user);
+    fill(operation_t::rename_user, stats.rename_user);
+    fill(operation_t::clear, stats.clear);
+    fill(operation_t::get_calls, stats.get_calls);
+    fill(operation_t::view_calls, stats.view_calls);
+    fill(operation_t::get_calls_for_user, stats.get_calls_for_user);
+    fill(operation_t::count_calls_for_user, stats.count_calls_for_user);
+    fill(operation_t::search_by_number, stats.search_users_by_number);
+    fill(operation_t::search_by_number_multi, stats.search_users_by_number_multi);
+    fill(operation_t::search_by_name, stats.search_users_by_name);
+    fill(operation_t::search_by_name_substring, stats.search_users_by_name_substring);
+    fill(operation_t::search_by_name_fuzzy, stats.search_users_by_name_fuzzy);
+    return stats;
+  }
+
+private:
+  // copies of a book report to the same counters, so copying stays O(1)
+  std::shared_ptr<std::array<counters_t, operations_count>> operations;
+};
+
+#else
+
+/**
+ * Recorder compiled without PHONE_BOOK_STATS: every call is empty and inlined away
+ */
+class stats_recorder_t {
+public:
+  struct measure_t {
+    template <typename R>
+    R &&done(R &&result) {
+      return std::forward<R>(result);
+    }
+
+    void done() {}
+  };
+
+  measure_t measure(operation_t, size_t = 0) const {
+    return {};
+  }
+
+  phone_book_stats_t snapshot() const {
+    return {};
+  }
+};
+
+#endif
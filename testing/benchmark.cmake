@@ -0,0 +1,22 @@
+configure_file(testing/benchmark-CMakeLists.txt.in benchmark-download/CMakeLists.txt)
+execute_process(COMMAND ${CMAKE_COMMAND} -G "${CMAKE_GENERATOR}" .
+		RESULT_VARIABLE result
+		WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/benchmark-download)
+if (result)
+	message(FATAL_ERROR "CMake step for benchmark failed: ${result}")
+endif ()
+execute_process(COMMAND ${CMAKE_COMMAND} --build .
+		RESULT_VARIABLE result
+		WORKING_DIRECTORY ${CMAKE_CURRENT_BINARY_DIR}/benchmark-download)
+if (result)
+	message(FATAL_ERROR "Build step for benchmark failed: ${result}")
+endif ()
+
+set(BENCHMARK_ENABLE_TESTING OFF CACHE BOOL "" FORCE)
+set(BENCHMARK_ENABLE_GTEST_TESTS OFF CACHE BOOL "" FORCE)
+set(BENCHMARK_ENABLE_INSTALL OFF CACHE BOOL "" FORCE)
+add_subdirectory(
+		${CMAKE_CURRENT_BINARY_DIR}/benchmark-src
+		${CMAKE_CURRENT_BINARY_DIR}/benchmark-build
+		EXCLUDE_FROM_ALL
+)
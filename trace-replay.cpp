@@ -0,0 +1,284 @@
+#include "trace-replay.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+
+namespace {
+
+/**
+ * Reads values encoded by trace_encoder_t, a read past the end of the trace throws
+ */
+class trace_reader_t {
+public:
+  explicit trace_reader_t(std::string_view bytes) : rest(bytes) {}
+
+  bool done() const {
+    return rest.empty();
+  }
+
+  uint8_t get_byte() {
+    need(1);
+    auto value = static_cast<uint8_t>(rest[0]);
+    rest.remove_prefix(1);
+    return value;
+  }
+
+  uint64_t get_varint() {
+    uint64_t value = 0;
+    for (size_t shift = 0;; shift += 7) {
+      if (shift >= 64) {
+        throw std::runtime_error("malformed trace: varint is too long");
+      }
+      uint8_t byte = get_byte();
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        return value;
+      }
+    }
+  }
+
+  double get_double() {
+    uint64_t bits = 0;
+    for (size_t i = 0; i < sizeof(bits); ++i) {
+      bits |= static_cast<uint64_t>(get_byte()) << (8 * i);
+    }
+    double value = 0;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  std::string get_string() {
+    uint64_t size = get_varint();
+    need(size);
+    std::string value(rest.substr(0, size));
+    rest.remove_prefix(size);
+    return value;
+  }
+
+  user_t get_user() {
+    user_t user;
+    user.number = get_string();
+    user.name = get_string();
+    return user;
+  }
+
+  call_t get_call() {
+    call_t call;
+    call.number = get_string();
+    call.duration_s = get_double();
+    return call;
+  }
+
+  template <typename T, typename get_t>
+  std::vector<T> get_vector(get_t get) {
+    uint64_t size = get_varint();
+    // every item takes at least a byte, which bounds the reservation by the trace size
+    need(size);
+    std::vector<T> values;
+    values.reserve(size);
+    for (uint64_t i = 0; i < size; ++i) {
+      values.push_back((this->*get)());
+    }
+    return values;
+  }
+
+private:
+  void need(uint64_t size) const {
+    if (rest.size() < size) {
+      throw std::runtime_error("malformed trace: record is truncated");
+    }
+  }
+
+  std::string_view rest;
+};
+
+trace_record_t read_record(trace_reader_t &reader, int64_t &start_ns) {
+  trace_record_t record;
+  uint8_t operation = reader.get_byte();
+  if (operation >= trace_operations_count) {
+    throw std::runtime_error("malformed trace: unknown operation " + std::to_string(operation));
+  }
+  record.operation = static_cast<trace_operation_t>(operation);
+  uint64_t delta = reader.get_varint();
+  start_ns += static_cast<int64_t>(delta >> 1) ^ -static_cast<int64_t>(delta & 1);
+  record.start_ns = start_ns;
+  switch (record.operation) {
+  case trace_operation_t::create_user:
+    record.users.push_back(reader.get_user());
+    break;
+  case trace_operation_t::add_call:
+    record.calls.push_back(reader.get_call());
+    break;
+  case trace_operation_t::create_users:
+    record.users = reader.get_vector<user_t>(&trace_reader_t::get_user);
+    break;
+  case trace_operation_t::add_calls:
+    record.calls = reader.get_vector<call_t>(&trace_reader_t::get_call);
+    break;
+  case trace_operation_t::remove_user:
+  case trace_operation_t::count_calls_for_user:
+    record.keys.push_back(reader.get_string());
+    break;
+  case trace_operation_t::rename_user:
+    record.keys.push_back(reader.get_string());
+    record.keys.push_back(reader.get_string());
+    break;
+  case trace_operation_t::clear:
+    break;
+  case trace_operation_t::get_calls:
+  case trace_operation_t::view_calls:
+    record.start_pos = reader.get_varint();
+    record.count = reader.get_varint();
+    break;
+  case trace_operation_t::get_calls_for_user:
+    record.keys.push_back(reader.get_string());
+    record.start_pos = reader.get_varint();
+    record.count = reader.get_varint();
+    break;
+  case trace_operation_t::search_by_number:
+  case trace_operation_t::search_by_name:
+  case trace_operation_t::search_by_name_substring:
+    record.keys.push_back(reader.get_string());
+    record.count = reader.get_varint();
+    break;
+  case trace_operation_t::search_by_number_multi:
+    record.keys = reader.get_vector<std::string>(&trace_reader_t::get_string);
+    record.count = reader.get_varint();
+    break;
+  case trace_operation_t::search_by_number_page:
+  case trace_operation_t::search_by_name_page:
+    record.keys.push_back(reader.get_string());
+    record.count = reader.get_varint();
+    record.cursor = reader.get_string();
+    break;
+  case trace_operation_t::search_by_name_fuzzy:
+    record.keys.push_back(reader.get_string());
+    record.max_distance = reader.get_varint();
+    record.count = reader.get_varint();
+    break;
+  }
+  record.result_size = reader.get_varint();
+  return record;
+}
+
+/**
+ * @return result size of the call of record
+ */
+uint64_t call(const trace_record_t &record, phone_book_t &book) {
+  switch (record.operation) {
+  case trace_operation_t::create_user:
+    return trace_result_size(book.create_user(record.users[0].number, record.users[0].name));
+  case trace_operation_t::add_call:
+    return trace_result_size(book.add_call(record.calls[0]));
+  case trace_operation_t::create_users:
+    return trace_result_size(book.create_users(record.users));
+  case trace_operation_t::add_calls:
+    return trace_result_size(book.add_calls(record.calls));
+  case trace_operation_t::remove_user:
+    return trace_result_size(book.remove_user(record.keys[0]));
+  case trace_operation_t::rename_user:
+    return trace_result_size(book.rename_user(record.keys[0], record.keys[1]));
+  case trace_operation_t::clear:
+    book.clear();
+    return 0;
+  case trace_operation_t::get_calls:
+    return trace_result_size(book.get_calls(record.start_pos, record.count));
+  case trace_operation_t::view_calls:
+    return trace_result_size(book.view_calls(record.start_pos, record.count));
+  case trace_operation_t::get_calls_for_user:
+    return trace_result_size(book.get_calls_for_user(record.keys[0], record.start_pos, record.count));
+  case trace_operation_t::count_calls_for_user:
+    return trace_result_size(book.count_calls_for_user(record.keys[0]));
+  case trace_operation_t::search_by_number:
+    return trace_result_size(book.search_users_by_number(record.keys[0], record.count));
+  case trace_operation_t::search_by_number_multi:
+    return trace_result_size(book.search_users_by_number_multi(record.keys, record.count));
+  case trace_operation_t::search_by_number_page:
+    return trace_result_size(book.search_users_by_number_page(record.keys[0], record.count, record.cursor));
+  case trace_operation_t::search_by_name:
+    return trace_result_size(book.search_users_by_name(record.keys[0], record.count));
+  case trace_operation_t::search_by_name_page:
+    return trace_result_size(book.search_users_by_name_page(record.keys[0], record.count, record.cursor));
+  case trace_operation_t::search_by_name_substring:
+    return trace_result_size(book.search_users_by_name_substring(record.keys[0], record.count));
+  case trace_operation_t::search_by_name_fuzzy:
+    return trace_result_size(book.search_users_by_name_fuzzy(record.keys[0], record.max_distance, record.count));
+  }
+  return 0;
+}
+
+} // namespace
+
+std::vector<trace_record_t> read_trace(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("cannot open trace " + path + ": " + std::strerror(errno));
+  }
+  std::string bytes{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+  if (file.bad()) {
+    throw std::runtime_error("cannot read trace " + path);
+  }
+  std::string_view view(bytes);
+  if (view.substr(0, trace_encoder_t::magic.size()) != trace_encoder_t::magic) {
+    throw std::runtime_error("not a phone book trace: " + path);
+  }
+  trace_reader_t reader(view.substr(trace_encoder_t::magic.size()));
+  std::vector<trace_record_t> records;
+  int64_t start_ns = 0;
+  while (!reader.done()) {
+    records.push_back(read_record(reader, start_ns));
+  }
+  return records;
+}
+
+uint64_t replay_report_t::calls() const {
+  uint64_t result = 0;
+  for (const replay_operation_stats_t &operation : operations) {
+    result += operation.calls;
+  }
+  return result;
+}
+
+uint64_t replay_report_t::mismatches() const {
+  uint64_t result = 0;
+  for (const replay_operation_stats_t &operation : operations) {
+    result += operation.mismatches;
+  }
+  return result;
+}
+
+replay_report_t replay_trace(const std::vector<trace_record_t> &records, phone_book_t &book,
+                             const replay_options_t &options) {
+  replay_report_t report;
+  std::array<log_linear_histogram_t, trace_operations_count> latencies;
+  auto begin = std::chrono::steady_clock::now();
+  int64_t first_start_ns = records.empty() ? 0 : records.front().start_ns;
+  for (const trace_record_t &record : records) {
+    if (options.timed) {
+      std::this_thread::sleep_until(begin + std::chrono::nanoseconds(record.start_ns - first_start_ns));
+    }
+    replay_operation_stats_t &stats = report.operations[static_cast<size_t>(record.operation)];
+    auto start = std::chrono::steady_clock::now();
+    bool matches = false;
+    try {
+      matches = call(record, book) == record.result_size;
+    } catch (const std::exception &) {
+      // the traced call succeeded, since calls that throw are not traced
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    latencies[static_cast<size_t>(record.operation)].record(
+        static_cast<uint64_t>(std::chrono::nanoseconds(elapsed).count()));
+    ++stats.calls;
+    stats.mismatches += !matches;
+  }
+  report.elapsed = std::chrono::steady_clock::now() - begin;
+  for (size_t i = 0; i < trace_operations_count; ++i) {
+    report.operations[i].latency_ns = latencies[i].snapshot();
+  }
+  return report;
+}
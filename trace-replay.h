@@ -0,0 +1,70 @@
+#pragma once
+
+#include "phone-book.h"
+#include "stats.h"
+#include "trace.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Call read from a trace written by phone_book_t::start_trace
+ */
+struct trace_record_t {
+  trace_operation_t operation{};
+  // start of the call in nanoseconds since the trace was started
+  int64_t start_ns{0};
+  // users of create_user and create_users
+  std::vector<user_t> users;
+  // calls of add_call and add_calls
+  std::vector<call_t> calls;
+  // string arguments but the cursor in their order: numbers, names, prefixes or a fragment
+  std::vector<std::string> keys;
+  std::string cursor;
+  size_t start_pos{0};
+  size_t count{0};
+  size_t max_distance{0};
+  uint64_t result_size{0};
+};
+
+/**
+ * Read all records of a trace
+ * @throws std::runtime_error if the file cannot be read or is not a complete trace
+ */
+std::vector<trace_record_t> read_trace(const std::string &path);
+
+struct replay_options_t {
+  // keep the recorded intervals between the starts of calls instead of calling as fast as possible
+  bool timed{false};
+};
+
+/**
+ * Replayed calls of one operation
+ */
+struct replay_operation_stats_t {
+  uint64_t calls{0};
+  // calls whose result size differs from the recorded one or that threw
+  uint64_t mismatches{0};
+  histogram_snapshot_t latency_ns;
+};
+
+struct replay_report_t {
+  std::chrono::nanoseconds elapsed{0};
+  std::array<replay_operation_stats_t, trace_operations_count> operations;
+
+  uint64_t calls() const;
+
+  uint64_t mismatches() const;
+};
+
+/**
+ * Call the methods of book recorded in records, in their order. The book should be in the state the traced one
+ * started in for result sizes to match
+ * @return latencies and mismatches of the calls by operation
+ */
+replay_report_t replay_trace(const std::vector<trace_record_t> &records, phone_book_t &book,
+                             const replay_options_t &options = {});
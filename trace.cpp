@@ -0,0 +1,127 @@
+#include "trace.h"
+#include "phone-book.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+const char *trace_operation_name(trace_operation_t operation) {
+  switch (operation) {
+  case trace_operation_t::create_user:
+    return "create_user";
+  case trace_operation_t::add_call:
+    return "add_call";
+  case trace_operation_t::create_users:
+    return "create_users";
+  case trace_operation_t::add_calls:
+    return "add_calls";
+  case trace_operation_t::remove_user:
+    return "remove_user";
+  case trace_operation_t::rename_user:
+    return "rename_user";
+  case trace_operation_t::clear:
+    return "clear";
+  case trace_operation_t::get_calls:
+    return "get_calls";
+  case trace_operation_t::view_calls:
+    return "view_calls";
+  case trace_operation_t::get_calls_for_user:
+    return "get_calls_for_user";
+  case trace_operation_t::count_calls_for_user:
+    return "count_calls_for_user";
+  case trace_operation_t::search_by_number:
+    return "search_users_by_number";
+  case trace_operation_t::search_by_number_multi:
+    return "search_users_by_number_multi";
+  case trace_operation_t::search_by_number_page:
+    return "search_users_by_number_page";
+  case trace_operation_t::search_by_name:
+    return "search_users_by_name";
+  case trace_operation_t::search_by_name_page:
+    return "search_users_by_name_page";
+  case trace_operation_t::search_by_name_substring:
+    return "search_users_by_name_substring";
+  case trace_operation_t::search_by_name_fuzzy:
+    return "search_users_by_name_fuzzy";
+  }
+  return "unknown";
+}
+
+void trace_encoder_t::put(double value) {
+  uint64_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(bits));
+  for (size_t i = 0; i < sizeof(bits); ++i) {
+    bytes.push_back(static_cast<char>(bits >> (8 * i)));
+  }
+}
+
+void trace_encoder_t::put(const user_t &user) {
+  put(std::string_view(user.number));
+  put(std::string_view(user.name));
+}
+
+void trace_encoder_t::put(const call_t &call) {
+  put(std::string_view(call.number));
+  put(call.duration_s);
+}
+
+uint64_t trace_result_size(const std::vector<bool> &accepted) {
+  return static_cast<uint64_t>(std::count(accepted.begin(), accepted.end(), true));
+}
+
+trace_writer_t::trace_writer_t(const std::string &path)
+    : file(path, std::ios::binary | std::ios::trunc), started(std::chrono::steady_clock::now()) {
+  if (!file) {
+    throw std::runtime_error("cannot create trace " + path + ": " + std::strerror(errno));
+  }
+  buffer.bytes.append(trace_encoder_t::magic);
+}
+
+trace_writer_t::~trace_writer_t() {
+  close();
+}
+
+void trace_writer_t::write(trace_operation_t operation, std::chrono::steady_clock::time_point start,
+                           std::string_view arguments, uint64_t result_size) {
+  int64_t start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(start - started).count();
+  std::lock_guard lock(mutex);
+  if (!file.is_open()) {
+    return;
+  }
+  // calls of several threads are written as they end, so starts may go back
+  int64_t delta_ns = start_ns - previous_ns;
+  previous_ns = start_ns;
+  buffer.bytes.push_back(static_cast<char>(operation));
+  buffer.put((static_cast<uint64_t>(delta_ns) << 1) ^ static_cast<uint64_t>(delta_ns >> 63));
+  buffer.bytes.append(arguments);
+  buffer.put(result_size);
+  if (buffer.bytes.size() >= buffer_size) {
+    flush();
+  }
+}
+
+void trace_writer_t::close() {
+  std::lock_guard lock(mutex);
+  if (file.is_open()) {
+    flush();
+    file.close();
+  }
+}
+
+void trace_writer_t::flush() {
+  file.write(buffer.bytes.data(), static_cast<std::streamsize>(buffer.bytes.size()));
+  buffer.bytes.clear();
+}
+
+void trace_recorder_t::start(const std::string &path) {
+  stop();
+  writer = std::make_shared<trace_writer_t>(path);
+}
+
+void trace_recorder_t::stop() {
+  if (writer) {
+    writer->close();
+    writer.reset();
+  }
+}
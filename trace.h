@@ -0,0 +1,232 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct call_t;
+struct user_t;
+
+/**
+ * Traced calls of phone_book_t, the page searches are traced apart from the plain ones they serve
+ */
+enum class trace_operation_t : uint8_t {
+  create_user,
+  add_call,
+  create_users,
+  add_calls,
+  remove_user,
+  rename_user,
+  clear,
+  get_calls,
+  view_calls,
+  get_calls_for_user,
+  count_calls_for_user,
+  search_by_number,
+  search_by_number_multi,
+  search_by_number_page,
+  search_by_name,
+  search_by_name_page,
+  search_by_name_substring,
+  search_by_name_fuzzy
+};
+
+constexpr size_t trace_operations_count = static_cast<size_t>(trace_operation_t::search_by_name_fuzzy) + 1;
+
+/**
+ * @return name of operation as in phone_book_t
+ */
+const char *trace_operation_name(trace_operation_t operation);
+
+/**
+ * Encoding of trace records: integers are varints, doubles are 8 bytes little-endian, strings are prefixed by size.
+ * A file is the magic followed by records of: operation, zigzag varint of the start time in nanoseconds
+ * since the previous record, arguments in the order of the traced method and the result size
+ */
+class trace_encoder_t {
+public:
+  static constexpr std::string_view magic{"PBTRACE1"};
+
+  void put(uint64_t value) {
+    for (; value >= 0x80; value >>= 7) {
+      bytes.push_back(static_cast<char>(value | 0x80));
+    }
+    bytes.push_back(static_cast<char>(value));
+  }
+
+  void put(double value);
+
+  void put(std::string_view value) {
+    put(static_cast<uint64_t>(value.size()));
+    bytes.append(value);
+  }
+
+  void put(const user_t &user);
+
+  void put(const call_t &call);
+
+  template <typename T>
+  void put(const std::vector<T> &values) {
+    put(static_cast<uint64_t>(values.size()));
+    for (const T &value : values) {
+      put(value);
+    }
+  }
+
+  std::string bytes;
+};
+
+/**
+ * Result size of a traced call: accepted items of modifications, found items of queries
+ */
+inline uint64_t trace_result_size(bool accepted) {
+  return accepted;
+}
+
+inline uint64_t trace_result_size(size_t count) {
+  return count;
+}
+
+uint64_t trace_result_size(const std::vector<bool> &accepted);
+
+template <typename page_t>
+auto trace_result_size(const page_t &page) -> decltype(page.users.size(), uint64_t()) {
+  return page.users.size();
+}
+
+template <typename T>
+uint64_t trace_result_size(const std::vector<T> &found) {
+  return found.size();
+}
+
+template <typename T>
+uint64_t trace_result_size(const std::vector<std::vector<T>> &found) {
+  uint64_t result = 0;
+  for (const std::vector<T> &prefix_found : found) {
+    result += prefix_found.size();
+  }
+  return result;
+}
+
+template <typename range_t>
+auto trace_result_size(const range_t &range) -> decltype(range.size(), range.begin(), uint64_t()) {
+  return range.size();
+}
+
+/**
+ * Trace file written by copies of a book from any threads
+ */
+class trace_writer_t {
+public:
+  /**
+   * @throws std::runtime_error if the file cannot be created
+   */
+  explicit trace_writer_t(const std::string &path);
+
+  /**
+   * Flushes and closes the file
+   */
+  ~trace_writer_t();
+
+  /**
+   * Append a record of a call started at start with encoded arguments and result size
+   */
+  void write(trace_operation_t operation, std::chrono::steady_clock::time_point start, std::string_view arguments,
+             uint64_t result_size);
+
+  /**
+   * Flush and close the file, later records are dropped
+   */
+  void close();
+
+private:
+  static constexpr size_t buffer_size = 1 << 16;
+
+  void flush();
+
+  std::mutex mutex;
+  std::ofstream file;
+  std::chrono::steady_clock::time_point started;
+  // start time of the previous record, nanoseconds since started
+  int64_t previous_ns{0};
+  trace_encoder_t buffer;
+};
+
+/**
+ * Recorder of calls of a book shared by its copies, disabled until a trace is started
+ */
+class trace_recorder_t {
+public:
+  /**
+   * Record of one call: started on creation by trace_recorder_t::call, written by done.
+   * A call that throws is not written
+   */
+  class record_t {
+  public:
+    /**
+     * Write the call with the size of its result
+     * @return result
+     */
+    template <typename R>
+    R &&done(R &&result) {
+      if (writer) {
+        writer->write(operation, start, arguments.bytes, trace_result_size(result));
+      }
+      return std::forward<R>(result);
+    }
+
+    /**
+     * Write a call without result
+     */
+    void done() {
+      if (writer) {
+        writer->write(operation, start, arguments.bytes, 0);
+      }
+    }
+
+  private:
+    friend class trace_recorder_t;
+
+    std::shared_ptr<trace_writer_t> writer;
+    trace_operation_t operation{};
+    std::chrono::steady_clock::time_point start;
+    trace_encoder_t arguments;
+  };
+
+  /**
+   * Start a call of operation with its arguments, encoded only while tracing
+   */
+  template <typename... args_t>
+  record_t call(trace_operation_t operation, const args_t &...args) const {
+    record_t result;
+    result.writer = writer;
+    if (result.writer) {
+      result.operation = operation;
+      result.start = std::chrono::steady_clock::now();
+      (result.arguments.put(args), ...);
+    }
+    return result;
+  }
+
+  /**
+   * Record calls of this book and of copies made later to a new trace file, replacing the current one.
+   * Modifies the recorder, so it must not run concurrently with calls of the book
+   * @throws std::runtime_error if the file cannot be created
+   */
+  void start(const std::string &path);
+
+  /**
+   * Flush and close the trace file, copies sharing it stop recording too
+   */
+  void stop();
+
+private:
+  // shared by copies, nullptr while not tracing
+  std::shared_ptr<trace_writer_t> writer;
+};
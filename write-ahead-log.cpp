@@ -0,0 +1,289 @@
+#include "write-ahead-log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+struct log_header_t {
+  static constexpr char expected_magic[8] = {'P', 'H', 'O', 'N', 'E', 'W', 'A', 'L'};
+  static constexpr uint32_t current_version = 1;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t users_count;
+  uint64_t calls_count;
+};
+
+std::runtime_error file_error(const std::string &what, const std::string &path) {
+  return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+uint32_t checksum(std::string_view bytes) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (char c : bytes) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+  }
+  return hash;
+}
+
+template <typename T>
+void put(std::string &out, const T &value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void put_string(std::string &out, std::string_view value) {
+  put(out, static_cast<uint32_t>(value.size()));
+  out.append(value);
+}
+
+/**
+ * Reads values from a record payload, any read past its end makes the reader invalid
+ */
+class payload_reader_t {
+public:
+  explicit payload_reader_t(std::string_view payload) : rest(payload) {}
+
+  template <typename T>
+  T get() {
+    T value{};
+    if (rest.size() < sizeof(T)) {
+      valid = false;
+      rest = {};
+      return value;
+    }
+    std::memcpy(&value, rest.data(), sizeof(T));
+    rest.remove_prefix(sizeof(T));
+    return value;
+  }
+
+  std::string_view get_string() {
+    auto size = get<uint32_t>();
+    if (rest.size() < size) {
+      valid = false;
+      rest = {};
+      return {};
+    }
+    std::string_view value = rest.substr(0, size);
+    rest.remove_prefix(size);
+    return value;
+  }
+
+  bool finished() const {
+    return valid && rest.empty();
+  }
+
+private:
+  std::string_view rest;
+  bool valid{true};
+};
+
+bool write_all(int fd, std::string_view bytes) {
+  while (!bytes.empty()) {
+    ssize_t written = ::write(fd, bytes.data(), bytes.size());
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    bytes.remove_prefix(static_cast<size_t>(written));
+  }
+  return true;
+}
+
+void sync_directory_of(const std::string &path) {
+  size_t slash = path.find_last_of('/');
+  std::string directory = slash == std::string::npos ? "." : path.substr(0, std::max<size_t>(slash, 1));
+  int fd = ::open(directory.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    ::fsync(fd);
+    ::close(fd);
+  }
+}
+
+} // namespace
+
+void write_ahead_log_t::create(const std::string &path, const log_base_t &base) {
+  log_header_t header{};
+  std::copy(std::begin(log_header_t::expected_magic), std::end(log_header_t::expected_magic), header.magic);
+  header.version = log_header_t::current_version;
+  header.users_count = base.users_count;
+  header.calls_count = base.calls_count;
+
+  std::string tmp_path = path + ".tmp";
+  int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw file_error("cannot create", tmp_path);
+  }
+  bool written = write_all(fd, {reinterpret_cast<const char *>(&header), sizeof(header)}) && ::fsync(fd) == 0;
+  written = ::close(fd) == 0 && written;
+  if (!written || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    throw file_error("cannot write", path);
+  }
+  sync_directory_of(path);
+}
+
+bool write_ahead_log_t::replay(const std::string &path, const log_base_t &state,
+                               const std::function<void(const log_record_t &)> &apply) {
+  if (::access(path.c_str(), F_OK) != 0 && errno == ENOENT) {
+    return false;
+  }
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    throw file_error("cannot open", path);
+  }
+  std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (file.bad()) {
+    throw file_error("cannot read", path);
+  }
+
+  log_header_t header{};
+  if (bytes.size() < sizeof(header)) {
+    throw std::runtime_error("not a phone book log: " + path);
+  }
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  if (!std::equal(std::begin(header.magic), std::end(header.magic), std::begin(log_header_t::expected_magic))) {
+    throw std::runtime_error("not a phone book log: " + path);
+  }
+  if (header.version != log_header_t::current_version) {
+    throw std::runtime_error("unsupported phone book log version " + std::to_string(header.version) + ": " + path);
+  }
+  if (header.users_count != state.users_count || header.calls_count != state.calls_count) {
+    // every record changes the counts, so a state past the base is a snapshot saved with the whole log
+    if (header.users_count <= state.users_count && header.calls_count <= state.calls_count) {
+      return false;
+    }
+    throw std::runtime_error("phone book log continues a state later than the snapshot: " + path);
+  }
+
+  size_t valid_end = sizeof(header);
+  while (bytes.size() - valid_end >= 2 * sizeof(uint32_t)) {
+    payload_reader_t frame(std::string_view(bytes).substr(valid_end, 2 * sizeof(uint32_t)));
+    auto size = frame.get<uint32_t>();
+    auto sum = frame.get<uint32_t>();
+    size_t payload_begin = valid_end + 2 * sizeof(uint32_t);
+    if (size > bytes.size() - payload_begin) {
+      break;
+    }
+    std::string_view payload = std::string_view(bytes).substr(payload_begin, size);
+    if (checksum(payload) != sum) {
+      break;
+    }
+    payload_reader_t reader(payload);
+    log_record_t record{};
+    record.type = static_cast<log_record_t::type_t>(reader.get<uint8_t>());
+    record.number = reader.get_string();
+    if (record.type == log_record_t::type_t::create_user) {
+      record.name = reader.get_string();
+    } else if (record.type == log_record_t::type_t::add_call) {
+      record.duration_s = reader.get<double>();
+    } else {
+      break;
+    }
+    if (!reader.finished()) {
+      break;
+    }
+    apply(record);
+    valid_end = payload_begin + size;
+  }
+  // a torn tail is a group that was not synced before a crash, later records go after the valid ones
+  if (valid_end < bytes.size() && ::truncate(path.c_str(), static_cast<off_t>(valid_end)) != 0) {
+    throw file_error("cannot truncate", path);
+  }
+  return true;
+}
+
+write_ahead_log_t::write_ahead_log_t(const std::string &path, group_commit_t group_commit)
+    : group_commit(group_commit), path(path) {
+  fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+  if (fd < 0) {
+    throw file_error("cannot open", path);
+  }
+  flusher = std::thread([this] { run(); });
+}
+
+write_ahead_log_t::~write_ahead_log_t() {
+  {
+    std::lock_guard lock(mutex);
+    stopped = true;
+  }
+  wake_flusher.notify_one();
+  flusher.join();
+  ::close(fd);
+}
+
+void write_ahead_log_t::append_create_user(std::string_view number, std::string_view name) {
+  append({log_record_t::type_t::create_user, number, name, 0});
+}
+
+void write_ahead_log_t::append_add_call(std::string_view number, double duration_s) {
+  append({log_record_t::type_t::add_call, number, {}, duration_s});
+}
+
+void write_ahead_log_t::sync() {
+  std::unique_lock lock(mutex);
+  uint64_t target = appended_records;
+  sync_requested = std::max(sync_requested, target);
+  wake_flusher.notify_one();
+  wake_waiters.wait(lock, [&] { return synced_records >= target; });
+  if (failed) {
+    throw std::runtime_error("cannot write log " + path);
+  }
+}
+
+void write_ahead_log_t::append(const log_record_t &record) {
+  std::lock_guard lock(mutex);
+  // the record is encoded in place, its size and checksum are filled in after the payload
+  size_t frame_begin = buffer.size();
+  size_t payload_begin = frame_begin + 2 * sizeof(uint32_t);
+  buffer.resize(payload_begin);
+  put(buffer, static_cast<uint8_t>(record.type));
+  put_string(buffer, record.number);
+  if (record.type == log_record_t::type_t::create_user) {
+    put_string(buffer, record.name);
+  } else {
+    put(buffer, record.duration_s);
+  }
+  auto size = static_cast<uint32_t>(buffer.size() - payload_begin);
+  uint32_t sum = checksum(std::string_view(buffer).substr(payload_begin));
+  std::memcpy(&buffer[frame_begin], &size, sizeof(size));
+  std::memcpy(&buffer[frame_begin + sizeof(size)], &sum, sizeof(sum));
+  ++appended_records;
+  if (++buffered_records == 1 || buffered_records >= group_commit.max_records) {
+    wake_flusher.notify_one();
+  }
+}
+
+void write_ahead_log_t::run() {
+  std::unique_lock lock(mutex);
+  for (;;) {
+    wake_flusher.wait(lock, [this] { return stopped || !buffer.empty(); });
+    if (buffer.empty()) {
+      return;
+    }
+    // the group is open from its first record until it is full, its delay is over or someone waits for it
+    wake_flusher.wait_for(lock, group_commit.max_delay, [this] {
+      return stopped || buffered_records >= group_commit.max_records || sync_requested > synced_records;
+    });
+    std::string group;
+    group.swap(buffer);
+    buffered_records = 0;
+    uint64_t group_end = appended_records;
+    lock.unlock();
+    bool written = write_all(fd, group) && ::fdatasync(fd) == 0;
+    lock.lock();
+    failed = failed || !written;
+    synced_records = group_end;
+    wake_waiters.notify_all();
+  }
+}
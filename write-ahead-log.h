@@ -0,0 +1,109 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+/**
+ * When buffered records are written and synced to disk: after max_records records or max_delay,
+ * whatever comes first
+ */
+struct group_commit_t {
+  size_t max_records{1024};
+  std::chrono::milliseconds max_delay{2};
+};
+
+/**
+ * State of the phone book a log continues: records apply on top of a book with exactly these counts
+ */
+struct log_base_t {
+  uint64_t users_count{0};
+  uint64_t calls_count{0};
+};
+
+/**
+ * Logged operation, views refer to the log buffer and are valid during the replay callback only
+ */
+struct log_record_t {
+  enum class type_t : uint8_t { create_user = 1, add_call = 2 };
+
+  type_t type;
+  std::string_view number;
+  std::string_view name;
+  double duration_s{0};
+};
+
+/**
+ * Append-only log of phone book operations with group commit.
+ * The file is a header with the log base followed by records: u32 payload size, u32 payload checksum
+ * and payload of type byte, u32 number length, number, then u32 name length and name or duration.
+ * Appending only encodes a record into the memory buffer, a background thread writes
+ * and syncs the buffer in groups
+ */
+class write_ahead_log_t {
+public:
+  /**
+   * Atomically replace the log at path with an empty one continuing base
+   * @throws std::runtime_error if the log cannot be written
+   */
+  static void create(const std::string &path, const log_base_t &base);
+
+  /**
+   * Apply the records of the log at path if it continues state, and cut a torn tail left by a crash
+   * @return false if there is no log or its records are already included in state, so nothing was applied
+   * @throws std::runtime_error if the log cannot be read or continues a state that is not reached
+   */
+  static bool replay(const std::string &path, const log_base_t &state,
+                     const std::function<void(const log_record_t &)> &apply);
+
+  /**
+   * Open an existing log for appending
+   * @throws std::runtime_error if the log cannot be opened
+   */
+  write_ahead_log_t(const std::string &path, group_commit_t group_commit = {});
+
+  write_ahead_log_t(const write_ahead_log_t &) = delete;
+  write_ahead_log_t &operator=(const write_ahead_log_t &) = delete;
+
+  /**
+   * Syncs everything appended
+   */
+  ~write_ahead_log_t();
+
+  void append_create_user(std::string_view number, std::string_view name);
+
+  void append_add_call(std::string_view number, double duration_s);
+
+  /**
+   * Wait until everything appended so far is on disk
+   * @throws std::runtime_error if the background thread failed to write the log
+   */
+  void sync();
+
+private:
+  void append(const log_record_t &record);
+
+  void run();
+
+  int fd{-1};
+  group_commit_t group_commit;
+  std::string path;
+
+  std::mutex mutex;
+  std::condition_variable wake_flusher;
+  std::condition_variable wake_waiters;
+  std::string buffer;
+  size_t buffered_records{0};
+  uint64_t appended_records{0};
+  uint64_t synced_records{0};
+  uint64_t sync_requested{0};
+  bool failed{false};
+  bool stopped{false};
+  std::thread flusher;
+};